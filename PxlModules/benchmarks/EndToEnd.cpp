@@ -0,0 +1,192 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules.hh"
+
+#include "utils/EventIndex.hpp"
+
+#include "microbench.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* Throughput of the full muon channel chain on events of the
+* SyntheticEventSource, without input files:
+*
+*   source -> TriggerSelection -> MuonSelection -> MuonVeto -> ElectronVeto
+*   -> JetSelection (2/3 jets) -> BTagSelection (1/2 b-tags) -> NeutrinoPz
+*   -> TopReconstruction -> EventVariables -> RootTreeWriter
+*
+* The modules are loaded from the PXL plugin directories. Reports events/s
+* and optionally writes the result as JSON in the format of the micro-
+* benchmarks (see internal/microbench). Also reports how often the EventIndex
+* was requested and rebuilt and how many objects it scanned per event.
+* PXLMODULES_TIMING=1 additionally prints the time per module.
+*
+* usage: EndToEnd [-n events] [-s seed] [-o output.root] [--json file] [--label text]
+*/
+
+struct Connection
+{
+    const char* sourceModule;
+    const char* source;
+    const char* sinkModule;
+};
+
+static pxl::Module* addModule(pxl::Analysis& analysis, const std::string& type, const std::string& name)
+{
+    pxl::Module* module = analysis.addModule(type,name,"0");
+    if (!module)
+    {
+        throw std::runtime_error("cannot create module of type '"+type+"'; are the plugins installed?");
+    }
+    return module;
+}
+
+int main(int argc, char** argv)
+{
+    int64_t nEvents = 20000;
+    int64_t seed = 12345;
+    std::string outputFile = "EndToEnd.root";
+    microbench::Options options;
+    for (int iarg = 1; iarg+1 < argc; iarg += 2)
+    {
+        const std::string arg = argv[iarg];
+        const std::string value = argv[iarg+1];
+        if (arg=="-n")
+        {
+            nEvents = atoll(value.c_str());
+        }
+        else if (arg=="-s")
+        {
+            seed = atoll(value.c_str());
+        }
+        else if (arg=="-o")
+        {
+            outputFile = value;
+        }
+        else if (arg=="--json")
+        {
+            options.jsonFile = value;
+        }
+        else if (arg=="--label")
+        {
+            options.label = value;
+        }
+        else
+        {
+            fprintf(stderr,"usage: %s [-n events] [-s seed] [-o output.root] [--json file] [--label text]\n",argv[0]);
+            return 1;
+        }
+    }
+    if (argc%2==0)
+    {
+        fprintf(stderr,"usage: %s [-n events] [-s seed] [-o output.root] [--json file] [--label text]\n",argv[0]);
+        return 1;
+    }
+
+    pxl::Core::initialize();
+    pxl::Hep::initialize();
+    pxl::PluginManager::instance().loadPlugins();
+
+    try
+    {
+        pxl::Analysis analysis;
+        pxl::Module* source = addModule(analysis,"SyntheticEventSource","source");
+        source->setOption("number of events",nEvents);
+        source->setOption("seed",seed);
+        addModule(analysis,"TriggerSelection","trigger");
+        addModule(analysis,"MuonSelection","muon");
+        addModule(analysis,"MuonVeto","muonVeto");
+        addModule(analysis,"ElectronVeto","electronVeto");
+        addModule(analysis,"JetSelection","jets");
+        addModule(analysis,"BTagSelection","btag");
+        addModule(analysis,"NeutrinoPz","neutrino");
+        addModule(analysis,"TopReconstruction","top");
+        addModule(analysis,"EventVariables","variables");
+        pxl::Module* writer = addModule(analysis,"RootTreeWriter","writer");
+        writer->setOption("root file",outputFile);
+        writer->setOption("variables",std::vector<std::string>({
+            "Reconstructed->TightMuon->KIN",
+            "Reconstructed->SelectedJet->KIN",
+            "Reconstructed->SelectedBJet->Pt",
+            "SingleTop->Top->KIN",
+            "SingleTop->W->Mass",
+            "SingleTop->UR"
+        }));
+
+        const Connection connections[] = {
+            {"source","output","trigger"},
+            {"trigger","selected","muon"},
+            {"muon","1 iso muon","muonVeto"},
+            {"muonVeto","other","electronVeto"},
+            {"electronVeto","other","jets"},
+            {"jets","2 Jets","btag"},
+            {"jets","3 Jets","btag"},
+            {"btag","1 b-Tags","neutrino"},
+            {"btag","2 b-Tags","neutrino"},
+            {"neutrino","output","top"},
+            {"top","selected","variables"},
+            {"variables","output","writer"}
+        };
+        for (const Connection& connection: connections)
+        {
+            if (!analysis.connectModules(connection.sourceModule,connection.source,connection.sinkModule,"input"))
+            {
+                throw std::runtime_error(std::string("cannot connect '")+connection.sourceModule+"' ("+connection.source+") to '"+connection.sinkModule+"'");
+            }
+        }
+
+        analysis.beginJob();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int64_t nProcessed = 0;
+        while (source->analyse(nullptr))
+        {
+            ++nProcessed;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        analysis.endJob();
+        analysis.shutdown();
+        if (nProcessed==0)
+        {
+            throw std::runtime_error("no events processed");
+        }
+
+        printf("processed %lld events in %.3f s: %.1f events/s\n",(long long)nProcessed,seconds,nProcessed/seconds);
+
+        uint64_t nRequests = 0;
+        uint64_t nBuilds = 0;
+        uint64_t nScannedObjects = 0;
+        EventIndex::getStatistics(nRequests,nBuilds,nScannedObjects);
+        printf("event index per event: %.2f requests, %.2f builds, %.1f objects scanned\n",
+            1.*nRequests/nProcessed,1.*nBuilds/nProcessed,1.*nScannedObjects/nProcessed);
+
+        if (!options.jsonFile.empty())
+        {
+            microbench::Result result;
+            result.name = "EndToEnd/muon channel";
+            result.iterations = nProcessed;
+            result.repetitions = 1;
+            result.nsMedian = 1e9*seconds/nProcessed;
+            result.nsMin = result.nsMedian;
+            result.nsMax = result.nsMedian;
+            result.itemsPerSecond = nProcessed/seconds;
+            if (!microbench::writeJSON(options.jsonFile,options,std::vector<microbench::Result>(1,result)))
+            {
+                fprintf(stderr,"cannot write '%s'\n",options.jsonFile.c_str());
+                return 1;
+            }
+        }
+    }
+    catch(std::exception &e)
+    {
+        fprintf(stderr,"%s\n",e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "microbench.h"
+
+/*
+* Micro-benchmarks of the hot kernels of the modules on synthetic events (see
+* ReconstructionKernels.cpp, SelectionKernels.cpp and OutputKernels.cpp).
+* The results can be written as JSON and compared to an earlier run:
+*
+*   KernelBenchmarks --json before.json --label <commit>
+*   KernelBenchmarks --json after.json --baseline before.json
+*
+* usage: KernelBenchmarks [--filter text] [--min-time s] [--repetitions n] [--json file] [--baseline file] [--label text]
+*/
+
+int main(int argc, char** argv)
+{
+    pxl::Core::initialize();
+    pxl::Hep::initialize();
+    return microbench::run(argc,argv);
+}
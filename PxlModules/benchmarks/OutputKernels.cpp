@@ -0,0 +1,174 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "utils/OutputStore.hpp"
+#include "utils/SyntaxTree.hpp"
+#include "utils/SyntheticEvents.hpp"
+
+#include "microbench.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+* Branch filling of the RootTreeWriter: storing values in the tree variables
+* by name and evaluating the syntax tree of the branch expressions on an
+* event. The trees are kept in memory and never filled, so only the lookup
+* and conversion of the values is measured.
+*/
+
+static const unsigned int N_VARIABLES = 60;
+
+static std::vector<std::string> makeVariableNames()
+{
+    std::vector<std::string> names;
+    for (unsigned int ivariable = 0; ivariable < N_VARIABLES; ++ivariable)
+    {
+        names.push_back("Reconstructed_1__SelectedJet_"+std::to_string(ivariable%6+1)+"__var"+std::to_string(ivariable));
+    }
+    return names;
+}
+
+static void benchmarkStoreFloat(microbench::State& state)
+{
+    const std::vector<std::string> names = makeVariableNames();
+    Tree tree(nullptr,"benchmark");
+    //book the branches before measuring
+    for (const std::string& name: names)
+    {
+        tree.storeVariable(name,0.f);
+    }
+    float value = 0;
+    while (state.keepRunning())
+    {
+        for (const std::string& name: names)
+        {
+            tree.storeVariable(name,value);
+            value += 1.f;
+        }
+    }
+    state.setItemsPerIteration(names.size());
+}
+
+//user records are stored as pxl::Variant and converted by type
+static void benchmarkStoreVariant(microbench::State& state)
+{
+    const std::vector<std::string> names = makeVariableNames();
+    std::vector<pxl::Variant> values;
+    for (unsigned int ivariable = 0; ivariable < names.size(); ++ivariable)
+    {
+        switch (ivariable%3)
+        {
+            case 0:
+                values.push_back(pxl::Variant(float(ivariable)));
+                break;
+            case 1:
+                values.push_back(pxl::Variant(double(ivariable)));
+                break;
+            default:
+                values.push_back(pxl::Variant(int(ivariable)));
+        }
+    }
+    Tree tree(nullptr,"benchmark");
+    for (unsigned int ivariable = 0; ivariable < names.size(); ++ivariable)
+    {
+        tree.storeVariable(names[ivariable],values[ivariable]);
+    }
+    while (state.keepRunning())
+    {
+        for (unsigned int ivariable = 0; ivariable < names.size(); ++ivariable)
+        {
+            tree.storeVariable(names[ivariable],values[ivariable]);
+        }
+    }
+    state.setItemsPerIteration(names.size());
+}
+
+static microbench::Registration storeRegistrations[] = {
+    {"Tree::storeVariable/float",benchmarkStoreFloat},
+    {"Tree::storeVariable/Variant",benchmarkStoreVariant}
+};
+
+//event view with a muon, four jets and the MET, each with user records as in the ntuples
+static pxl::Event* makeEvent(SyntheticEvents& generator)
+{
+    pxl::Event* event = new pxl::Event();
+    pxl::EventView* eventView = event->create<pxl::EventView>();
+    eventView->setName("Reconstructed");
+    eventView->setUserRecord("nPV",int(20));
+    eventView->setUserRecord("mtw_beforePz",float(60));
+
+    pxl::Particle* muon = eventView->create<pxl::Particle>();
+    const pxl::LorentzVector muonVector = generator.lepton();
+    muon->setName("TightMuon");
+    muon->setP4(muonVector.getPx(),muonVector.getPy(),muonVector.getPz(),muonVector.getE());
+    muon->setUserRecord("relIso",float(0.05));
+    muon->setUserRecord("isTight",true);
+
+    for (unsigned int ijet = 0; ijet < 4; ++ijet)
+    {
+        pxl::Particle* jet = eventView->create<pxl::Particle>();
+        const pxl::LorentzVector jetVector = generator.jet();
+        jet->setName("SelectedJet");
+        jet->setP4(jetVector.getPx(),jetVector.getPy(),jetVector.getPz(),jetVector.getE());
+        jet->setUserRecord("combinedInclusiveSecondaryVertexV2BJetTags",float(0.5));
+        jet->setUserRecord("partonFlavour",int(5));
+        jet->setUserRecord("hadronFlavour",int(5));
+        jet->setUserRecord("jecUncertainty",float(0.02));
+        jet->setUserRecord("jerFactor",float(1.05));
+        jet->setUserRecord("pileupJetIdfullDiscriminant",float(0.8));
+        jet->setUserRecord("nConstituents",int(25));
+        jet->setUserRecord("area",float(0.5));
+        jet->setUserRecord("dRmin",float(1.2));
+        jet->setUserRecord("charge",float(0.1));
+    }
+
+    pxl::Particle* met = eventView->create<pxl::Particle>();
+    const std::pair<double,double> missing = generator.met(generator.phi());
+    met->setName("MET");
+    met->setP4(missing.first,missing.second,0,std::sqrt(missing.first*missing.first+missing.second*missing.second));
+    return event;
+}
+
+static void benchmarkSyntaxTree(microbench::State& state, const std::vector<std::string>& expressions)
+{
+    SyntheticEvents generator;
+    std::vector<std::unique_ptr<pxl::Event>> events;
+    for (unsigned int ievent = 0; ievent < 64; ++ievent)
+    {
+        events.push_back(std::unique_ptr<pxl::Event>(makeEvent(generator)));
+    }
+    SyntaxTree syntaxTree;
+    for (const std::string& expression: expressions)
+    {
+        syntaxTree.buildTree(expression);
+    }
+    Tree tree(nullptr,"benchmark");
+    //book the branches before measuring
+    for (std::unique_ptr<pxl::Event>& event: events)
+    {
+        syntaxTree.evaluate(event.get(),&tree);
+    }
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        syntaxTree.evaluate(events[ievent].get(),&tree);
+        ievent = (ievent+1)%events.size();
+    }
+}
+
+static microbench::Registration syntaxTreeRegistrations[] = {
+    {"SyntaxNode::evaluate/KIN",[](microbench::State& state){ benchmarkSyntaxTree(state,{
+        "Reconstructed->SelectedJet->KIN",
+        "Reconstructed->TightMuon->Pt",
+        "Reconstructed->TightMuon->Eta",
+        "Reconstructed->MET->Pt"
+    }); }},
+    {"SyntaxNode::evaluate/ALL",[](microbench::State& state){ benchmarkSyntaxTree(state,{
+        "Reconstructed->SelectedJet->ALL",
+        "Reconstructed->TightMuon->ALL",
+        "Reconstructed->MET->ALL",
+        "Reconstructed->UR"
+    }); }}
+};
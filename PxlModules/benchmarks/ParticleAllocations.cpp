@@ -0,0 +1,129 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "utils/ParticlePool.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+* Heap allocations per event of the particles created by TopReconstruction
+* (W boson and top linked to their daughters, clones of two jets with their
+* user records, a centre of mass system with user records), once created as
+* pxl::Particle and once as PooledParticle. The difference is what the pool
+* saves; the PooledParticle count is what is left (user records, relations,
+* object owner of the event view). Needs libAllocationCounter.so preloaded:
+*
+*   LD_PRELOAD=libAllocationCounter.so ParticleAllocations [events]
+*/
+
+//defined by libAllocationCounter.so if preloaded, otherwise null
+extern "C" uint64_t pxlmodules_allocation_count() __attribute__((weak));
+
+//user records of a jet as used in the selection
+static const std::vector<std::string> jetUserRecords = {
+    "nConstituents","chargedHadronEnergyFraction","neutralHadronEnergyFraction",
+    "combinedInclusiveSecondaryVertexV2BJetTags","partonFlavour","jecFactor"
+};
+
+struct Inputs
+{
+    pxl::EventView eventView;
+    pxl::Particle* lepton;
+    pxl::Particle* neutrino;
+    pxl::Particle* bjet;
+    pxl::Particle* lightjet;
+};
+
+static pxl::Particle* createInput(pxl::EventView& eventView, const std::string& name, double px, double py, double pz, bool userRecords)
+{
+    pxl::Particle* particle = eventView.create<pxl::Particle>();
+    particle->setName(name);
+    particle->setP4(px,py,pz,std::sqrt(px*px+py*py+pz*pz+25.0));
+    if (userRecords)
+    {
+        for (const std::string& userRecord: jetUserRecords)
+        {
+            particle->setUserRecord(userRecord,1.0);
+        }
+    }
+    return particle;
+}
+
+template<class PARTICLE>
+static pxl::Particle* makeComposite(pxl::EventView& eventView, const std::string& name, pxl::Particle* p1, pxl::Particle* p2)
+{
+    pxl::Particle* composite = new PARTICLE();
+    eventView.insertObject(composite);
+    composite->setName(name);
+    composite->linkDaughter(p1);
+    composite->linkDaughter(p2);
+    composite->setP4FromDaughters();
+    return composite;
+}
+
+//the objects of one event in the 2 jet 1 b-tag category
+template<class PARTICLE>
+static void reconstruct(pxl::EventView& eventView, const Inputs& inputs)
+{
+    pxl::Particle* wboson = makeComposite<PARTICLE>(eventView,"W",inputs.lepton,inputs.neutrino);
+    pxl::Particle* lightjet = new PARTICLE(*inputs.lightjet);
+    pxl::Particle* bjet = new PARTICLE(*inputs.bjet);
+    eventView.insertObject(lightjet);
+    eventView.insertObject(bjet);
+    makeComposite<PARTICLE>(eventView,"Top",wboson,bjet);
+    pxl::Particle* shat = new PARTICLE();
+    eventView.insertObject(shat);
+    shat->setName("Shat");
+    for (pxl::Particle* particle: {bjet,lightjet,inputs.lepton,inputs.neutrino})
+    {
+        shat->addP4(particle);
+    }
+    for (const char* userRecord: {"minCosTheta","maxCosTheta","minDY","maxDY","minDEta","maxDEta","minDR","maxDR","minDPhi","maxDPhi"})
+    {
+        shat->setUserRecord(userRecord,0.5);
+    }
+}
+
+template<class PARTICLE>
+static double countAllocations(const Inputs& inputs, unsigned int nEvents)
+{
+    //fills the free list as the previous events would
+    for (unsigned int ievent = 0; ievent < 16; ++ievent)
+    {
+        pxl::EventView eventView;
+        reconstruct<PARTICLE>(eventView,inputs);
+    }
+    const uint64_t before = pxlmodules_allocation_count();
+    for (unsigned int ievent = 0; ievent < nEvents; ++ievent)
+    {
+        pxl::EventView eventView;
+        reconstruct<PARTICLE>(eventView,inputs);
+    }
+    return 1.*(pxlmodules_allocation_count()-before)/nEvents;
+}
+
+int main(int argc, char** argv)
+{
+    if (!pxlmodules_allocation_count)
+    {
+        fprintf(stderr,"libAllocationCounter.so is not preloaded\n");
+        return 1;
+    }
+    const unsigned int nEvents = argc>1 ? atoi(argv[1]) : 10000;
+
+    Inputs inputs;
+    inputs.lepton = createInput(inputs.eventView,"TightMuon",30,10,5,false);
+    inputs.neutrino = createInput(inputs.eventView,"Neutrino",-20,15,40,false);
+    inputs.bjet = createInput(inputs.eventView,"SelectedBJet",-40,-30,20,true);
+    inputs.lightjet = createInput(inputs.eventView,"SelectedJet",25,-5,200,true);
+
+    const double nParticle = countAllocations<pxl::Particle>(inputs,nEvents);
+    const double nPooled = countAllocations<PooledParticle>(inputs,nEvents);
+    printf("allocations per event: %.1f with pxl::Particle, %.1f with PooledParticle (%.1f saved)\n",nParticle,nPooled,nParticle-nPooled);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "reconstruction/CMSystem.hpp"
+#include "reconstruction/EventShapeVariables.hpp"
+#include "reconstruction/FoxWolfram.hpp"
+#include "reconstruction/NeutrinoPzSolver.hpp"
+
+#include "utils/SyntheticEvents.hpp"
+
+#include "microbench.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+* Kernels of EventVariables (event shapes, Fox-Wolfram moments), NeutrinoPz
+* and TopReconstruction (centre of mass composites).
+*/
+
+//lepton, neutrino and four jets as in the 2j/4j categories
+static const std::vector<std::vector<pxl::LorentzVector>>& getEvents()
+{
+    static std::vector<std::vector<pxl::LorentzVector>> events;
+    if (events.empty())
+    {
+        SyntheticEvents generator;
+        for (unsigned int ievent = 0; ievent < 256; ++ievent)
+        {
+            events.push_back(generator.event(4));
+        }
+    }
+    return events;
+}
+
+//the same events as momentum columns
+static const std::vector<EventShapeInput>& getEventShapeInputs()
+{
+    static std::vector<EventShapeInput> inputs;
+    if (inputs.empty())
+    {
+        for (const std::vector<pxl::LorentzVector>& vectors: getEvents())
+        {
+            inputs.push_back(EventShapeInput());
+            for (const pxl::LorentzVector& vector: vectors)
+            {
+                inputs.back().add(vector);
+            }
+        }
+    }
+    return inputs;
+}
+
+template<class FCT>
+static void benchmarkEventShape(microbench::State& state, FCT fct)
+{
+    const std::vector<EventShapeInput>& events = getEventShapeInputs();
+    std::vector<std::unique_ptr<EventShapeVariables>> shapes;
+    for (const EventShapeInput& input: events)
+    {
+        shapes.push_back(std::unique_ptr<EventShapeVariables>(new EventShapeVariables(input)));
+    }
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        microbench::doNotOptimize(fct(*shapes[ievent]));
+        ievent = (ievent+1)%shapes.size();
+    }
+}
+
+//all observables of an event as done by EventVariables::storeVariables
+static void benchmarkEventShapes(microbench::State& state)
+{
+    const std::vector<EventShapeInput>& events = getEventShapeInputs();
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        EventShapeVariables esv(events[ievent]);
+        microbench::doNotOptimize(esv.isotropy()+esv.circularity()+esv.sphericity()+esv.aplanarity()+esv.C()+esv.D());
+        ievent = (ievent+1)%events.size();
+    }
+}
+
+static microbench::Registration eventShapeRegistrations[] = {
+    {"EventShapeVariables/isotropy",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.isotropy(); }); }},
+    {"EventShapeVariables/circularity",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.circularity(); }); }},
+    {"EventShapeVariables/sphericity",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.sphericity(); }); }},
+    {"EventShapeVariables/aplanarity",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.aplanarity(); }); }},
+    {"EventShapeVariables/C",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.C(); }); }},
+    {"EventShapeVariables/D",[](microbench::State& state){ benchmarkEventShape(state,[](const EventShapeVariables& esv){ return esv.D(); }); }},
+    {"EventShapeVariables/all",benchmarkEventShapes}
+};
+
+static void benchmarkFoxWolfram(microbench::State& state, FoxWolfram::WeightType weightType)
+{
+    const std::vector<EventShapeInput>& events = getEventShapeInputs();
+    std::vector<FoxWolfram> moments;
+    for (const EventShapeInput& input: events)
+    {
+        moments.push_back(FoxWolfram(input));
+    }
+    //orders 1-5 as configured in the analysis
+    const unsigned int maxOrder = 5;
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        for (unsigned int iorder = 1; iorder <= maxOrder; ++iorder)
+        {
+            microbench::doNotOptimize(moments[ievent].getMoment(weightType,iorder));
+        }
+        ievent = (ievent+1)%moments.size();
+    }
+    state.setItemsPerIteration(maxOrder);
+}
+
+static microbench::Registration foxWolframRegistrations[] = {
+    {"FoxWolfram::getMoment/SHAT",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::SHAT); }},
+    {"FoxWolfram::getMoment/PT",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::PT); }},
+    {"FoxWolfram::getMoment/ETA",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::ETA); }},
+    {"FoxWolfram::getMoment/PSUM",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::PSUM); }},
+    {"FoxWolfram::getMoment/PZ",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::PZ); }},
+    {"FoxWolfram::getMoment/ONE",[](microbench::State& state){ benchmarkFoxWolfram(state,FoxWolfram::ONE); }}
+};
+
+struct NeutrinoInput
+{
+    pxl::LorentzVector lepton;
+    float metpx;
+    float metpy;
+};
+
+//the quadratic equation has real solutions for mT(lepton,MET)<mW and complex ones above
+static std::vector<NeutrinoInput> makeNeutrinoInputs(bool real)
+{
+    SyntheticEvents generator;
+    std::vector<NeutrinoInput> inputs;
+    while (inputs.size()<256)
+    {
+        NeutrinoInput input;
+        input.lepton = generator.lepton();
+        const std::pair<double,double> met = generator.met(generator.phi());
+        input.metpx = met.first;
+        input.metpy = met.second;
+        const double metpt = std::sqrt(met.first*met.first+met.second*met.second);
+        const double mt2 = 2*(input.lepton.getPt()*metpt-input.lepton.getPx()*met.first-input.lepton.getPy()*met.second);
+        const double mW2 = 80.38*80.38;
+        //stay away from the boundary where rounding decides the branch
+        if ((real and mt2<0.9*mW2) or (!real and mt2>1.1*mW2))
+        {
+            inputs.push_back(input);
+        }
+    }
+    return inputs;
+}
+
+static void benchmarkNeutrinoPz(microbench::State& state, bool real)
+{
+    const std::vector<NeutrinoInput> inputs = makeNeutrinoInputs(real);
+    pxl::Particle neutrino;
+    unsigned int iinput = 0;
+    while (state.keepRunning())
+    {
+        const NeutrinoInput& input = inputs[iinput];
+        solveNu4Momentum(&neutrino,input.lepton,input.metpx,input.metpy);
+        microbench::doNotOptimize(neutrino.getPz());
+        iinput = (iinput+1)%inputs.size();
+    }
+}
+
+static microbench::Registration neutrinoRegistrations[] = {
+    {"solveNu4Momentum/real",[](microbench::State& state){ benchmarkNeutrinoPz(state,true); }},
+    {"solveNu4Momentum/complex",[](microbench::State& state){ benchmarkNeutrinoPz(state,false); }}
+};
+
+//composite of the constituents and the CM variables as in TopReconstruction::makeCMSystem
+static void benchmarkCMSystem(microbench::State& state, unsigned int nConstituents)
+{
+    const std::vector<std::vector<pxl::LorentzVector>>& events = getEvents();
+    std::vector<std::vector<pxl::Particle*>> constituents;
+    for (const std::vector<pxl::LorentzVector>& vectors: events)
+    {
+        constituents.push_back(std::vector<pxl::Particle*>());
+        for (unsigned int iparticle = 0; iparticle < nConstituents; ++iparticle)
+        {
+            //two jets for the dijet system, plus lepton and neutrino for shat
+            const pxl::LorentzVector& vector = vectors[(iparticle+2)%4];
+            constituents.back().push_back(SyntheticEvents::makeParticle("Particle",vector));
+        }
+    }
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        pxl::Particle cm;
+        for (pxl::Particle* particle: constituents[ievent])
+        {
+            cm.addP4(particle);
+        }
+        calculateCMVariables(&cm,constituents[ievent],"");
+        microbench::doNotOptimize(cm.getMass());
+        ievent = (ievent+1)%constituents.size();
+    }
+    for (std::vector<pxl::Particle*>& particles: constituents)
+    {
+        for (pxl::Particle* particle: particles)
+        {
+            delete particle;
+        }
+    }
+}
+
+static microbench::Registration cmSystemRegistrations[] = {
+    {"TopReconstruction::makeCMSystem/dijet",[](microbench::State& state){ benchmarkCMSystem(state,2); }},
+    {"TopReconstruction::makeCMSystem/shat",[](microbench::State& state){ benchmarkCMSystem(state,4); }}
+};
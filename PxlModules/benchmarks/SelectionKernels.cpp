@@ -0,0 +1,85 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "selection/DeltaRCleaning.hpp"
+
+#include "utils/SyntheticEvents.hpp"
+
+#include "microbench.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+/*
+* dR cleaning of the selected jets against the selected leptons as done by
+* JetSelection::applyDRcleaning, without the removal from the event index.
+*/
+
+struct CleaningEvent
+{
+    std::vector<pxl::Particle*> jets;
+    std::vector<pxl::Particle*> objects;
+};
+
+static void benchmarkDRCleaning(microbench::State& state, unsigned int nJets, unsigned int nObjects)
+{
+    SyntheticEvents generator;
+    std::vector<CleaningEvent> events(256);
+    for (CleaningEvent& event: events)
+    {
+        for (unsigned int iobject = 0; iobject < nObjects; ++iobject)
+        {
+            event.objects.push_back(SyntheticEvents::makeParticle("TightMuon",generator.lepton()));
+        }
+        for (unsigned int ijet = 0; ijet < nJets; ++ijet)
+        {
+            event.jets.push_back(SyntheticEvents::makeParticle("Jet",generator.jet()));
+        }
+    }
+
+    const double dR = 0.4;
+    DeltaRCleaning cleaning;
+    std::vector<pxl::Particle*> selectedJets;
+    unsigned int ievent = 0;
+    while (state.keepRunning())
+    {
+        const CleaningEvent& event = events[ievent];
+        selectedJets = event.jets;
+        cleaning.setObjects(event.objects);
+        unsigned int nkept = 0;
+        for (unsigned int ijet = 0; ijet < selectedJets.size(); ++ijet)
+        {
+            pxl::Particle* selectedJet = selectedJets[ijet];
+            const double dRmin = std::min(std::sqrt(cleaning.minDeltaR2(selectedJet)),100.0);
+            if (not (dRmin<dR))
+            {
+                selectedJet->setUserRecord("dRmin",float(dRmin));
+                selectedJets[nkept] = selectedJet;
+                ++nkept;
+            }
+        }
+        selectedJets.resize(nkept);
+        microbench::doNotOptimize(selectedJets.size());
+        ievent = (ievent+1)%events.size();
+    }
+    state.setItemsPerIteration(nJets);
+
+    for (CleaningEvent& event: events)
+    {
+        for (pxl::Particle* particle: event.jets)
+        {
+            delete particle;
+        }
+        for (pxl::Particle* particle: event.objects)
+        {
+            delete particle;
+        }
+    }
+}
+
+static microbench::Registration cleaningRegistrations[] = {
+    {"JetSelection::applyDRcleaning/jets:6/objects:1",[](microbench::State& state){ benchmarkDRCleaning(state,6,1); }},
+    {"JetSelection::applyDRcleaning/jets:6/objects:2",[](microbench::State& state){ benchmarkDRCleaning(state,6,2); }},
+    {"JetSelection::applyDRcleaning/jets:12/objects:8",[](microbench::State& state){ benchmarkDRCleaning(state,12,8); }}
+};
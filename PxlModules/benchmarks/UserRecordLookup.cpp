@@ -0,0 +1,209 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "utils/UserRecordKey.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*
+* Per particle cost of the user record lookups done by the jet id in
+* JetSelection: string literals with hasUserRecord/getUserRecord versus
+* UserRecordKey handles resolved once before the loop.
+*
+* usage: UserRecordLookup [number of jets] [number of repetitions]
+*/
+
+//user records of a jet as written by the ntuple producer
+static const std::vector<std::string> jetUserRecords = {
+    "neutralHadronEnergyFraction","neutralEmEnergyFraction","chargedHadronEnergyFraction",
+    "chargedEmEnergyFraction","muonEnergyFraction","electronEnergyFraction","photonEnergyFraction",
+    "HFHadronEnergyFraction","HFEMEnergyFraction","nConstituents","chargedMultiplicity",
+    "neutralMultiplicity","muonMultiplicity","electronMultiplicity","photonMultiplicity",
+    "combinedInclusiveSecondaryVertexV2BJetTags","combinedSecondaryVertexBJetTags",
+    "jetProbabilityBJetTags","jetBProbabilityBJetTags","trackCountingHighEffBJetTags",
+    "trackCountingHighPurBJetTags","simpleSecondaryVertexHighEffBJetTags",
+    "simpleSecondaryVertexHighPurBJetTags","pileupJetIdfullDiscriminant","pileupJetIdfullId",
+    "partonFlavour","hadronFlavour","jecFactor","jecUncertainty","jerFactor","area",
+    "qgLikelihood","secondaryVertexMass","secondaryVertexPt","secondaryVertexNTracks",
+    "charge","vertexNdof","vertexX","vertexY","vertexZ"
+};
+
+struct Result
+{
+    double nsPerParticle;
+    unsigned int passed;
+};
+
+static bool passesWithLiterals(const pxl::Particle* particle)
+{
+    if (particle->hasUserRecord("neutralHadronEnergyFraction"))
+    {
+        if (not (particle->getUserRecord("neutralHadronEnergyFraction").toFloat()<0.99))
+        {
+            return false;
+        }
+    }
+    if (particle->hasUserRecord("neutralEmEnergyFraction"))
+    {
+        if (not (particle->getUserRecord("neutralEmEnergyFraction").toFloat()<0.99))
+        {
+            return false;
+        }
+    }
+    if (not (particle->getUserRecord("nConstituents").toInt32()>1))
+    {
+        return false;
+    }
+    if (particle->hasUserRecord("muonEnergyFraction"))
+    {
+        if (not (particle->getUserRecord("muonEnergyFraction").toFloat()<0.8))
+        {
+            return false;
+        }
+    }
+    if (particle->hasUserRecord("chargedHadronEnergyFraction"))
+    {
+        if (not (particle->getUserRecord("chargedHadronEnergyFraction").toFloat()>0))
+        {
+            return false;
+        }
+    }
+    if (not (particle->getUserRecord("chargedMultiplicity").toFloat()>0))
+    {
+        return false;
+    }
+    if (particle->hasUserRecord("electronEnergyFraction"))
+    {
+        if (not (particle->getUserRecord("electronEnergyFraction").toFloat()<0.99))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct JetIdKeys
+{
+    UserRecordKey neutralHadronEnergyFraction;
+    UserRecordKey neutralEmEnergyFraction;
+    UserRecordKey nConstituents;
+    UserRecordKey muonEnergyFraction;
+    UserRecordKey chargedHadronEnergyFraction;
+    UserRecordKey chargedMultiplicity;
+    UserRecordKey electronEnergyFraction;
+
+    JetIdKeys():
+        neutralHadronEnergyFraction("neutralHadronEnergyFraction"),
+        neutralEmEnergyFraction("neutralEmEnergyFraction"),
+        nConstituents("nConstituents"),
+        muonEnergyFraction("muonEnergyFraction"),
+        chargedHadronEnergyFraction("chargedHadronEnergyFraction"),
+        chargedMultiplicity("chargedMultiplicity"),
+        electronEnergyFraction("electronEnergyFraction")
+    {
+    }
+};
+
+static bool passesWithKeys(const JetIdKeys& keys, const pxl::Particle* particle)
+{
+    const pxl::Variant* value = keys.neutralHadronEnergyFraction.find(particle);
+    if (value and not (value->toFloat()<0.99))
+    {
+        return false;
+    }
+    value = keys.neutralEmEnergyFraction.find(particle);
+    if (value and not (value->toFloat()<0.99))
+    {
+        return false;
+    }
+    if (not (keys.nConstituents.get(particle).toInt32()>1))
+    {
+        return false;
+    }
+    value = keys.muonEnergyFraction.find(particle);
+    if (value and not (value->toFloat()<0.8))
+    {
+        return false;
+    }
+    value = keys.chargedHadronEnergyFraction.find(particle);
+    if (value and not (value->toFloat()>0))
+    {
+        return false;
+    }
+    if (not (keys.chargedMultiplicity.get(particle).toFloat()>0))
+    {
+        return false;
+    }
+    value = keys.electronEnergyFraction.find(particle);
+    if (value and not (value->toFloat()<0.99))
+    {
+        return false;
+    }
+    return true;
+}
+
+template<class FCT>
+static Result measure(const std::vector<pxl::Particle*>& jets, unsigned int repetitions, FCT fct)
+{
+    Result result = {0,0};
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for (unsigned int irep = 0; irep < repetitions; ++irep)
+    {
+        for (const pxl::Particle* jet: jets)
+        {
+            result.passed += fct(jet) ? 1 : 0;
+        }
+    }
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    result.nsPerParticle = std::chrono::duration<double,std::nano>(end-start).count()/(double(jets.size())*repetitions);
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int nJets = argc>1 ? std::atoi(argv[1]) : 10000;
+    const unsigned int repetitions = argc>2 ? std::atoi(argv[2]) : 100;
+
+    std::srand(12345);
+    std::vector<pxl::Particle*> jets;
+    for (unsigned int ijet = 0; ijet < nJets; ++ijet)
+    {
+        pxl::Particle* jet = new pxl::Particle();
+        jet->setName("Jet");
+        for (const std::string& name: jetUserRecords)
+        {
+            //drop some of the optional records as in the ntuples
+            if (name.find("EnergyFraction")!=std::string::npos and std::rand()%10==0)
+            {
+                continue;
+            }
+            jet->setUserRecord(name,float(std::rand())/RAND_MAX);
+        }
+        jet->setUserRecord("nConstituents",2+std::rand()%20);
+        jet->setUserRecord("chargedMultiplicity",std::rand()%10);
+        jets.push_back(jet);
+    }
+
+    const JetIdKeys keys;
+    const Result literals = measure(jets,repetitions,passesWithLiterals);
+    const Result handles = measure(jets,repetitions,[&keys](const pxl::Particle* jet){ return passesWithKeys(keys,jet);});
+
+    printf("%u jets with %zu user records, %u repetitions\n",nJets,jetUserRecords.size(),repetitions);
+    printf("string literals:  %8.2f ns/jet (passed: %u)\n",literals.nsPerParticle,literals.passed);
+    printf("UserRecordKey:    %8.2f ns/jet (passed: %u)\n",handles.nsPerParticle,handles.passed);
+    if (literals.passed!=handles.passed)
+    {
+        printf("error: selections differ\n");
+        return 1;
+    }
+
+    for (pxl::Particle* jet: jets)
+    {
+        delete jet;
+    }
+    return 0;
+}
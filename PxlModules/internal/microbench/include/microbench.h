@@ -0,0 +1,397 @@
+#ifndef __MICROBENCH_H__
+#define __MICROBENCH_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+* Minimal header-only micro-benchmark library. A benchmark is a function
+* taking a State and looping while state.keepRunning() returns true:
+*
+*   MICROBENCH(BM_Sum)
+*   {
+*       std::vector<double> values(100,1.);
+*       while (state.keepRunning())
+*       {
+*           microbench::doNotOptimize(std::accumulate(values.begin(),values.end(),0.));
+*       }
+*       state.setItemsPerIteration(values.size());
+*   }
+*
+* Further benchmarks (e.g. one per parameter) are registered with static
+* microbench::Registration objects. The number of iterations is increased
+* until one run takes at least the minimum time; the run is then repeated
+* and the median, minimum and maximum time per iteration are reported.
+* MICROBENCH_MAIN() defines main with the options
+*
+*   --filter text      run only benchmarks whose name contains text
+*   --min-time s       minimum time per repetition in seconds (default 0.1)
+*   --repetitions n    number of repetitions (default 5)
+*   --json file        write the results as JSON
+*   --baseline file    compare to the JSON results of an earlier run
+*   --label text       stored in the JSON, e.g. the commit hash
+*/
+
+namespace microbench
+{
+
+typedef std::chrono::steady_clock Clock;
+
+//keeps the compiler from optimising away the computation of a value
+template<class TYPE>
+inline void doNotOptimize(const TYPE& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void clobberMemory()
+{
+    asm volatile("" : : : "memory");
+}
+
+class State
+{
+    private:
+        uint64_t _iterations;
+        uint64_t _remaining;
+        double _itemsPerIteration;
+        bool _started;
+        Clock::time_point _start;
+        Clock::duration _elapsed;
+
+    public:
+        State(uint64_t iterations):
+            _iterations(iterations),
+            _remaining(iterations),
+            _itemsPerIteration(0),
+            _started(false),
+            _elapsed(Clock::duration::zero())
+        {
+        }
+
+        //the time is measured from the first until the last call
+        inline bool keepRunning()
+        {
+            if (!_started)
+            {
+                _started = true;
+                _start = Clock::now();
+            }
+            if (_remaining>0)
+            {
+                --_remaining;
+                return true;
+            }
+            _elapsed += Clock::now()-_start;
+            return false;
+        }
+
+        //excludes setup inside the loop from the measurement
+        inline void pauseTiming()
+        {
+            _elapsed += Clock::now()-_start;
+        }
+
+        inline void resumeTiming()
+        {
+            _start = Clock::now();
+        }
+
+        inline uint64_t getIterations() const
+        {
+            return _iterations;
+        }
+
+        //number of processed items (e.g. particles) for the throughput
+        inline void setItemsPerIteration(double items)
+        {
+            _itemsPerIteration = items;
+        }
+
+        inline double getItemsPerIteration() const
+        {
+            return _itemsPerIteration;
+        }
+
+        inline double getSeconds() const
+        {
+            return std::chrono::duration<double>(_elapsed).count();
+        }
+};
+
+typedef std::function<void(State&)> Function;
+
+struct Benchmark
+{
+    std::string name;
+    Function function;
+};
+
+inline std::vector<Benchmark>& getBenchmarks()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registration
+{
+    Registration(const std::string& name, const Function& function)
+    {
+        Benchmark benchmark = {name,function};
+        getBenchmarks().push_back(benchmark);
+    }
+};
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    unsigned int repetitions;
+    double nsMedian;
+    double nsMin;
+    double nsMax;
+    double itemsPerSecond;
+};
+
+struct Options
+{
+    std::string filter;
+    double minTime;
+    unsigned int repetitions;
+    std::string jsonFile;
+    std::string baselineFile;
+    std::string label;
+
+    Options():
+        minTime(0.1),
+        repetitions(5)
+    {
+    }
+};
+
+inline Result runBenchmark(const Benchmark& benchmark, const Options& options)
+{
+    //grow the number of iterations until a run takes the minimum time
+    uint64_t iterations = 1;
+    while (true)
+    {
+        State state(iterations);
+        benchmark.function(state);
+        const double seconds = state.getSeconds();
+        if (seconds>=options.minTime or iterations>=(uint64_t(1)<<40))
+        {
+            break;
+        }
+        const double scale = seconds>0 ? 1.4*options.minTime/seconds : 100.;
+        iterations = std::max<uint64_t>(iterations+1,iterations*std::min(100.,std::max(2.,scale)));
+    }
+
+    std::vector<double> ns;
+    double items = 0;
+    for (unsigned int irepetition = 0; irepetition < std::max(1u,options.repetitions); ++irepetition)
+    {
+        State state(iterations);
+        benchmark.function(state);
+        ns.push_back(1e9*state.getSeconds()/iterations);
+        items = state.getItemsPerIteration();
+    }
+    std::sort(ns.begin(),ns.end());
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.repetitions = ns.size();
+    result.nsMedian = ns.size()%2==1 ? ns[ns.size()/2] : 0.5*(ns[ns.size()/2-1]+ns[ns.size()/2]);
+    result.nsMin = ns.front();
+    result.nsMax = ns.back();
+    result.itemsPerSecond = items>0 and result.nsMedian>0 ? 1e9*items/result.nsMedian : 0;
+    return result;
+}
+
+inline std::string escape(const std::string& s)
+{
+    std::string escaped;
+    for (char c: s)
+    {
+        if (c=='"' or c=='\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+//one benchmark per line so that readBaseline does not need a JSON parser
+inline bool writeJSON(const std::string& fileName, const Options& options, const std::vector<Result>& results)
+{
+    std::ofstream file(fileName.c_str());
+    if (!file)
+    {
+        return false;
+    }
+    char date[64];
+    const time_t now = time(nullptr);
+    strftime(date,sizeof(date),"%Y-%m-%dT%H:%M:%S",localtime(&now));
+#ifdef __OPTIMIZE__
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+    file<<"{\n";
+    file<<"  \"context\": {\"date\": \""<<date<<"\", \"label\": \""<<escape(options.label)<<"\", ";
+    file<<"\"compiler\": \""<<escape(__VERSION__)<<"\", \"optimized\": "<<(optimized ? "true" : "false")<<"},\n";
+    file<<"  \"benchmarks\": [\n";
+    char line[512];
+    for (unsigned int iresult = 0; iresult < results.size(); ++iresult)
+    {
+        const Result& result = results[iresult];
+        snprintf(line,sizeof(line),
+            "\"iterations\": %llu, \"repetitions\": %u, \"ns_per_iteration\": %.3f, \"ns_min\": %.3f, \"ns_max\": %.3f, \"items_per_second\": %.1f}",
+            (unsigned long long)result.iterations,result.repetitions,result.nsMedian,result.nsMin,result.nsMax,result.itemsPerSecond
+        );
+        file<<"    {\"name\": \""<<escape(result.name)<<"\", "<<line<<(iresult+1<results.size() ? ",\n" : "\n");
+    }
+    file<<"  ]\n}\n";
+    return bool(file);
+}
+
+//name -> ns per iteration of a file written by writeJSON
+inline std::map<std::string,double> readBaseline(const std::string& fileName)
+{
+    std::map<std::string,double> baseline;
+    std::ifstream file(fileName.c_str());
+    std::string line;
+    const std::string nameTag = "\"name\": \"";
+    const std::string timeTag = "\"ns_per_iteration\": ";
+    while (std::getline(file,line))
+    {
+        const std::string::size_type namePos = line.find(nameTag);
+        const std::string::size_type timePos = line.find(timeTag);
+        if (namePos==std::string::npos or timePos==std::string::npos)
+        {
+            continue;
+        }
+        const std::string::size_type nameEnd = line.find("\", ",namePos+nameTag.size());
+        if (nameEnd==std::string::npos)
+        {
+            continue;
+        }
+        std::string name;
+        for (std::string::size_type pos = namePos+nameTag.size(); pos < nameEnd; ++pos)
+        {
+            if (line[pos]=='\\' and pos+1<nameEnd)
+            {
+                ++pos;
+            }
+            name += line[pos];
+        }
+        baseline[name] = atof(line.c_str()+timePos+timeTag.size());
+    }
+    return baseline;
+}
+
+inline int run(int argc, char** argv)
+{
+    Options options;
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        const std::string arg = argv[iarg];
+        if (iarg+1>=argc)
+        {
+            fprintf(stderr,"usage: %s [--filter text] [--min-time s] [--repetitions n] [--json file] [--baseline file] [--label text]\n",argv[0]);
+            return 1;
+        }
+        const std::string value = argv[++iarg];
+        if (arg=="--filter")
+        {
+            options.filter = value;
+        }
+        else if (arg=="--min-time")
+        {
+            options.minTime = atof(value.c_str());
+        }
+        else if (arg=="--repetitions")
+        {
+            options.repetitions = atoi(value.c_str());
+        }
+        else if (arg=="--json")
+        {
+            options.jsonFile = value;
+        }
+        else if (arg=="--baseline")
+        {
+            options.baselineFile = value;
+        }
+        else if (arg=="--label")
+        {
+            options.label = value;
+        }
+        else
+        {
+            fprintf(stderr,"unknown option '%s'\n",arg.c_str());
+            return 1;
+        }
+    }
+
+    std::map<std::string,double> baseline;
+    if (!options.baselineFile.empty())
+    {
+        baseline = readBaseline(options.baselineFile);
+        if (baseline.empty())
+        {
+            fprintf(stderr,"no results in baseline '%s'\n",options.baselineFile.c_str());
+            return 1;
+        }
+    }
+
+    printf("%-44s %14s %14s %14s %12s %14s%s\n","benchmark","ns/iteration","min","max","iterations","items/s",baseline.empty() ? "" : "   vs baseline");
+    std::vector<Result> results;
+    for (const Benchmark& benchmark: getBenchmarks())
+    {
+        if (!options.filter.empty() and benchmark.name.find(options.filter)==std::string::npos)
+        {
+            continue;
+        }
+        const Result result = runBenchmark(benchmark,options);
+        results.push_back(result);
+        printf("%-44s %14.2f %14.2f %14.2f %12llu %14.4g",result.name.c_str(),result.nsMedian,result.nsMin,result.nsMax,(unsigned long long)result.iterations,result.itemsPerSecond);
+        auto it = baseline.find(result.name);
+        if (it!=baseline.end() and it->second>0)
+        {
+            printf("   %+7.1f%%",100.*(result.nsMedian/it->second-1.));
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (!options.jsonFile.empty() and !writeJSON(options.jsonFile,options,results))
+    {
+        fprintf(stderr,"cannot write '%s'\n",options.jsonFile.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+}
+
+#define MICROBENCH(NAME) \
+    static void NAME(microbench::State& state); \
+    static microbench::Registration microbenchRegistration_##NAME(#NAME,NAME); \
+    static void NAME(microbench::State& state)
+
+#define MICROBENCH_MAIN() \
+    int main(int argc, char** argv) \
+    { \
+        return microbench::run(argc,argv); \
+    }
+
+#endif
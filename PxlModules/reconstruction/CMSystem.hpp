@@ -0,0 +1,95 @@
+#ifndef __CMSYSTEM_H__
+#define __CMSYSTEM_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+//cosine of the angle between two vectors
+inline float angle(const pxl::Basic3Vector& v1, const pxl::Basic3Vector& v2)
+{
+    return (v1.getX()*v2.getX()+v1.getY()*v2.getY()+v1.getZ()*v2.getZ())/(v1.getMag()*v2.getMag());
+}
+
+/*
+* Stores the minimum and maximum angle, rapidity, eta, dR and phi differences
+* between the constituents of a composite (e.g. the dijet or shat system) as
+* user records of the composite. Two constituents get the plain differences.
+*/
+inline void calculateCMVariables(pxl::Particle* cm, const std::vector<pxl::Particle*>& particles, const std::string& suffix)
+{
+    if (particles.size()>=2)
+    {
+        float minCosTheta = 100;
+        float maxCosTheta = -100;
+        float minDY = 100;
+        float maxDY = -100;
+        float minDEta = 100;
+        float maxDEta = -100;
+        float minDR = 100;
+        float maxDR = -100;
+        float minDPhi = 100;
+        float maxDPhi = -100;
+        for (unsigned int i = 0; i < particles.size(); ++i)
+        {
+            for (unsigned int j = i+1; j < particles.size(); ++j)
+            {
+                const pxl::Particle* p1 = particles[i];
+                const pxl::Particle* p2 = particles[j];
+
+                const float cosTheta = angle(p1->getVector(),p2->getVector());
+                minCosTheta=std::min(minCosTheta,cosTheta);
+                maxCosTheta=std::max(maxCosTheta,cosTheta);
+
+                const float y1 = 0.5*std::log((p1->getE()+p1->getPz())/(p1->getE()-p1->getPz()));
+                const float y2 = 0.5*std::log((p2->getE()+p2->getPz())/(p2->getE()-p2->getPz()));
+                const float deltaY = fabs(y1-y2);
+                minDY=std::min(minDY,deltaY);
+                maxDY=std::max(maxDY,deltaY);
+
+                const float deltaEta = fabs(p1->getEta()-p2->getEta());
+                minDEta=std::min(minDEta,deltaEta);
+                maxDEta=std::max(maxDEta,deltaEta);
+
+                const float deltaR = p1->getVector().deltaR(&(p2->getVector()));
+                minDR=std::min(minDR,deltaR);
+                maxDR=std::max(maxDR,deltaR);
+
+                const float deltaPhi = p1->getVector().deltaPhi(&(p2->getVector()));
+                minDPhi=std::min(minDPhi,deltaPhi);
+                maxDPhi=std::max(maxDPhi,deltaPhi);
+            }
+        }
+        if (particles.size()>2)
+        {
+            cm->setUserRecord("minCosTheta"+suffix,minCosTheta);
+            cm->setUserRecord("maxCosTheta"+suffix,maxCosTheta);
+
+            cm->setUserRecord("minDY"+suffix,minDY);
+            cm->setUserRecord("maxDY"+suffix,maxDY);
+
+            cm->setUserRecord("minDEta"+suffix,minDEta);
+            cm->setUserRecord("maxDEta"+suffix,maxDEta);
+
+            cm->setUserRecord("minDR"+suffix,minDR);
+            cm->setUserRecord("maxDR"+suffix,maxDR);
+
+            cm->setUserRecord("minDPhi"+suffix,minDPhi);
+            cm->setUserRecord("maxDPhi"+suffix,maxDPhi);
+        }
+        else if (particles.size()==2)
+        {
+            cm->setUserRecord("CosTheta"+suffix,minCosTheta);
+            cm->setUserRecord("DY"+suffix,minDY);
+            cm->setUserRecord("DEta"+suffix,minDEta);
+            cm->setUserRecord("DR"+suffix,minDR);
+            cm->setUserRecord("DPhi"+suffix,minDPhi);
+        }
+    }
+}
+
+#endif
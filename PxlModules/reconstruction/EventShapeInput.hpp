@@ -0,0 +1,54 @@
+#ifndef __EVENTSHAPEINPUT_H__
+#define __EVENTSHAPEINPUT_H__
+
+#include "pxl/core.hh"
+
+#include <vector>
+
+/*
+* Momenta entering EventShapeVariables and FoxWolfram as columns. They are
+* filled either from four vectors or directly from the columns of an
+* EventSnapshot, so that the variables are calculated without creating
+* pxl::LorentzVectors. The buffers keep their capacity between events.
+*/
+struct EventShapeInput
+{
+    std::vector<double> px;
+    std::vector<double> py;
+    std::vector<double> pz;
+    std::vector<double> p;
+    std::vector<double> pt;
+    std::vector<double> eta;
+
+    inline unsigned int size() const
+    {
+        return px.size();
+    }
+
+    void clear()
+    {
+        px.clear();
+        py.clear();
+        pz.clear();
+        p.clear();
+        pt.clear();
+        eta.clear();
+    }
+
+    void add(double px, double py, double pz, double p, double pt, double eta)
+    {
+        this->px.push_back(px);
+        this->py.push_back(py);
+        this->pz.push_back(pz);
+        this->p.push_back(p);
+        this->pt.push_back(pt);
+        this->eta.push_back(eta);
+    }
+
+    void add(const pxl::LorentzVector& vector)
+    {
+        add(vector.getX(),vector.getY(),vector.getZ(),vector.getP(),vector.getPt(),vector.getEta());
+    }
+};
+
+#endif
@@ -3,9 +3,9 @@
 #include "TMath.h"
 
 
-/// constructor from XYZ coordinates
-EventShapeVariables::EventShapeVariables(const std::vector<pxl::LorentzVector>& inputVectors) 
-  : inputVectors_(inputVectors)
+/// constructor from the momentum columns
+EventShapeVariables::EventShapeVariables(const EventShapeInput& input) 
+  : input_(input)
 {}
   
 /// the return value is 1 for spherical events and 0 for events linear in r-phi. This function 
@@ -19,9 +19,9 @@ EventShapeVariables::isotropy(const unsigned int& numberOfSteps) const
   for(unsigned int i=0; i<numberOfSteps; ++i){
     phi+=deltaPhi;
     double sum=0;
-    for(unsigned int j=0; j<inputVectors_.size(); ++j){
+    for(unsigned int j=0; j<input_.size(); ++j){
       // sum over inner product of unit vectors and momenta
-      sum+=TMath::Abs(TMath::Cos(phi)*inputVectors_[j].getX()+TMath::Sin(phi)*inputVectors_[j].getY());
+      sum+=TMath::Abs(TMath::Cos(phi)*input_.px[j]+TMath::Sin(phi)*input_.py[j]);
     }
     if( eOut<0. || sum<eOut ) eOut=sum;
     if( eIn <0. || sum>eIn  ) eIn =sum;
@@ -36,14 +36,14 @@ EventShapeVariables::circularity(const unsigned int& numberOfSteps) const
 {
   const double deltaPhi=2*TMath::Pi()/numberOfSteps;
   double circularity=-1, phi=0, area = 0;
-  for(unsigned int i=0;i<inputVectors_.size();i++) {
-    area+=TMath::Sqrt(inputVectors_[i].getX()*inputVectors_[i].getX()+inputVectors_[i].getY()*inputVectors_[i].getY());
+  for(unsigned int i=0;i<input_.size();i++) {
+    area+=input_.pt[i];
   }
   for(unsigned int i=0; i<numberOfSteps; ++i){
     phi+=deltaPhi;
     double sum=0, tmp=0.;
-    for(unsigned int j=0; j<inputVectors_.size(); ++j){
-      sum+=TMath::Abs(TMath::Cos(phi)*inputVectors_[j].getX()+TMath::Sin(phi)*inputVectors_[j].getY());
+    for(unsigned int j=0; j<input_.size(); ++j){
+      sum+=TMath::Abs(TMath::Cos(phi)*input_.px[j]+TMath::Sin(phi)*input_.py[j]);
     }
     tmp=TMath::Pi()/2*sum/area;
     if( circularity<0 || tmp<circularity ){
@@ -60,26 +60,29 @@ EventShapeVariables::compMomentumTensor(double r) const
   TMatrixDSym momentumTensor(3);
   momentumTensor.Zero();
 
-  if ( inputVectors_.size() < 2 ){
+  if ( input_.size() < 2 ){
     return momentumTensor;
   }
 
   // fill momentumTensor from inputVectors
   double norm = 0.;
-  for ( int i = 0; i < (int)inputVectors_.size(); ++i ){
-    double p2 = inputVectors_[i]*inputVectors_[i];
+  for ( int i = 0; i < (int)input_.size(); ++i ){
+    const double px = input_.px[i];
+    const double py = input_.py[i];
+    const double pz = input_.pz[i];
+    double p2 = input_.p[i]*input_.p[i];
     double pR = ( r == 2. ) ? p2 : TMath::Power(p2, 0.5*r);
     norm += pR;
     double pRminus2 = ( r == 2. ) ? 1. : TMath::Power(p2, 0.5*r - 1.);
-    momentumTensor(0,0) += pRminus2*inputVectors_[i].getX()*inputVectors_[i].getX();
-    momentumTensor(0,1) += pRminus2*inputVectors_[i].getX()*inputVectors_[i].getY();
-    momentumTensor(0,2) += pRminus2*inputVectors_[i].getX()*inputVectors_[i].getZ();
-    momentumTensor(1,0) += pRminus2*inputVectors_[i].getY()*inputVectors_[i].getX();
-    momentumTensor(1,1) += pRminus2*inputVectors_[i].getY()*inputVectors_[i].getY();
-    momentumTensor(1,2) += pRminus2*inputVectors_[i].getY()*inputVectors_[i].getZ();
-    momentumTensor(2,0) += pRminus2*inputVectors_[i].getZ()*inputVectors_[i].getX();
-    momentumTensor(2,1) += pRminus2*inputVectors_[i].getZ()*inputVectors_[i].getY();
-    momentumTensor(2,2) += pRminus2*inputVectors_[i].getZ()*inputVectors_[i].getZ();
+    momentumTensor(0,0) += pRminus2*px*px;
+    momentumTensor(0,1) += pRminus2*px*py;
+    momentumTensor(0,2) += pRminus2*px*pz;
+    momentumTensor(1,0) += pRminus2*py*px;
+    momentumTensor(1,1) += pRminus2*py*py;
+    momentumTensor(1,2) += pRminus2*py*pz;
+    momentumTensor(2,0) += pRminus2*pz*px;
+    momentumTensor(2,1) += pRminus2*pz*py;
+    momentumTensor(2,2) += pRminus2*pz*pz;
   }
 
   //std::cout << "momentumTensor:" << std::endl;
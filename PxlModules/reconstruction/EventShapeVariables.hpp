@@ -20,7 +20,7 @@
 	   Christian Veelken, UC Davis
 */
 
-#include "pxl/core.hh"
+#include "EventShapeInput.hpp"
 
 #include "TMatrixDSym.h"
 #include "TVectorD.h"
@@ -31,7 +31,8 @@ class EventShapeVariables
 {
 
  public:
-  explicit EventShapeVariables(const std::vector<pxl::LorentzVector>& inputVectors);
+  /// the input is referenced and has to outlive the object
+  explicit EventShapeVariables(const EventShapeInput& input);
   ~EventShapeVariables(){};
 
   /// the return value is 1 for spherical events and 0 for events linear in r-phi. This function 
@@ -66,8 +67,8 @@ class EventShapeVariables
   TMatrixDSym compMomentumTensor(double = 2.) const;
   TVectorD compEigenValues(double = 2.) const;
 
-  /// cashing of input vectors
-  std::vector<pxl::LorentzVector> inputVectors_;
+  /// momentum columns of the input particles
+  const EventShapeInput& input_;
 };
 
 #endif
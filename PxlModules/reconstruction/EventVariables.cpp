@@ -5,9 +5,18 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "EventShapeInput.hpp"
 #include "EventShapeVariables.hpp"
 #include "FoxWolfram.hpp"
 
+#include "utils/EventIndex.hpp"
+#include "utils/EventSnapshot.hpp"
+#include "utils/SystematicVariations.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include <algorithm>
+#include <tuple>
+
 static pxl::Logger logger("EventVariables");
 
 class EventVariables:
@@ -17,10 +26,22 @@ class EventVariables:
         pxl::Source* _outputSource;
         
         std::string _inputEventViewName;
-        std::set<std::string> _particlesForEventShape;
+        std::vector<EventIndex::Key> _particlesForEventShape;
+        //names of the particles selected only in some variations
+        std::vector<EventIndex::Key> _variationParticlesForEventShape;
+        EventIndex::Key _inputEventViewKey;
         std::string _prefix;
         int64_t _foxWolframOrder;
         
+        std::vector<std::string> _suffixes;
+        
+        //buffers reused between events
+        EventShapeInput _input;
+        std::vector<std::tuple<unsigned int,const EventSnapshot::Collection*,unsigned int>> _ordered;
+        std::vector<pxl::Particle*> _particles;
+        
+        ModuleTimer _timer;
+
     public:
         EventVariables():
             Module(),
@@ -82,67 +103,131 @@ class EventVariables:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("event view",_inputEventViewName);
             std::vector<std::string> particleNameVector;
             getOption("particles",particleNameVector);
             for (const std::string& s: particleNameVector)
             {
-                _particlesForEventShape.insert(s);
+                const EventIndex::Key key = EventIndex::intern(s);
+                if (std::find(_particlesForEventShape.begin(),_particlesForEventShape.end(),key)==_particlesForEventShape.end())
+                {
+                    _particlesForEventShape.push_back(key);
+                    _variationParticlesForEventShape.push_back(EventIndex::intern(SystematicVariations::getVariationsName(s)));
+                }
             }
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
             getOption("prefix",_prefix);
             getOption("fox wolfram order",_foxWolframOrder);
         }
         
+        //takes the momenta from the snapshot columns in the order of the event view; returns false if particles are not in the snapshot
+        bool getInputFromSnapshot(const EventIndex& index, const EventSnapshot& snapshot, const pxl::EventView* eventView, EventShapeInput& input)
+        {
+            _ordered.clear();
+            for (EventIndex::Key name: _particlesForEventShape)
+            {
+                const EventSnapshot::Collection* collection = snapshot.findCollection(eventView,name);
+                if (!collection)
+                {
+                    if (!index.getParticles(eventView,name).empty())
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                for (unsigned int iparticle = 0; iparticle < collection->size(); ++iparticle)
+                {
+                    _ordered.push_back(std::make_tuple(collection->ordinals[iparticle],collection,iparticle));
+                }
+            }
+            std::sort(_ordered.begin(),_ordered.end());
+            for (const std::tuple<unsigned int,const EventSnapshot::Collection*,unsigned int>& entry: _ordered)
+            {
+                const EventSnapshot::Collection& collection = *std::get<1>(entry);
+                const unsigned int iparticle = std::get<2>(entry);
+                input.add(collection.px[iparticle],collection.py[iparticle],collection.pz[iparticle],collection.p[iparticle],collection.pt[iparticle],collection.eta[iparticle]);
+            }
+            return true;
+        }
+        
+        void storeVariables(pxl::EventView* eventView, const EventShapeInput& input, const std::string& suffix)
+        {
+            EventShapeVariables esv(input);
+            eventView->setUserRecord(_prefix+"isotropy"+suffix,esv.isotropy());
+            eventView->setUserRecord(_prefix+"circularity"+suffix,esv.circularity());
+            eventView->setUserRecord(_prefix+"sphericity"+suffix,esv.sphericity());
+            eventView->setUserRecord(_prefix+"aplanarity"+suffix,esv.aplanarity());
+            eventView->setUserRecord(_prefix+"C"+suffix,esv.C());
+            eventView->setUserRecord(_prefix+"D"+suffix,esv.D());
+            
+            if (_foxWolframOrder>0)
+            {
+                FoxWolfram fw(input);
+                for (unsigned int iorder = 1; iorder<_foxWolframOrder;++iorder)
+                {
+                    //implementation need to be checked
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_shat"+suffix,fw.getMoment(FoxWolfram::SHAT,iorder));
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_pt"+suffix,fw.getMoment(FoxWolfram::PT,iorder));
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_eta"+suffix,fw.getMoment(FoxWolfram::ETA,iorder));
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_psum"+suffix,fw.getMoment(FoxWolfram::PSUM,iorder));
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_pz"+suffix,fw.getMoment(FoxWolfram::PZ,iorder));
+                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_one"+suffix,fw.getMoment(FoxWolfram::ONE,iorder));
+                }
+            }
+        }
+        
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    EventIndex& index = EventIndex::get(event);
+                    const EventSnapshot* snapshot = EventSnapshot::get(event);
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
-                            
-                            std::vector<pxl::LorentzVector> eventShapeVectors;
-
-                            for (unsigned int iparticle = 0; iparticle<particles.size(); ++iparticle)
+                            _input.clear();
+                            if (!snapshot || !getInputFromSnapshot(index,*snapshot,eventView,_input))
                             {
-                                pxl::Particle* particle = particles[iparticle];
-                                if (_particlesForEventShape.find(particle->getName())!=_particlesForEventShape.end())
+                                _input.clear();
+                                _particles.clear();
+                                index.getParticles(eventView,_particlesForEventShape,_particles);
+                                for (const pxl::Particle* particle: _particles)
                                 {
-                                    eventShapeVectors.push_back(particle->getVector());
+                                    _input.add(particle->getVector());
                                 }
                             }
-                            EventShapeVariables esv(eventShapeVectors);
-                            eventView->setUserRecord(_prefix+"isotropy",esv.isotropy());
-                            eventView->setUserRecord(_prefix+"circularity",esv.circularity());
-                            eventView->setUserRecord(_prefix+"sphericity",esv.sphericity());
-                            eventView->setUserRecord(_prefix+"aplanarity",esv.aplanarity());
-                            eventView->setUserRecord(_prefix+"C",esv.C());
-                            eventView->setUserRecord(_prefix+"D",esv.D());
+                            storeVariables(eventView,_input,"");
                             
-                            if (_foxWolframOrder>0)
+                            const unsigned int nVariations = SystematicVariations::getNVariations();
+                            if (nVariations>0)
                             {
-                                FoxWolfram fw(eventShapeVectors);
-                                for (unsigned int iorder = 1; iorder<_foxWolframOrder;++iorder)
+                                while (_suffixes.size()<nVariations)
+                                {
+                                    _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+                                }
+                                const SystematicVariations& variations = SystematicVariations::get(event);
+                                for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
                                 {
-                                    //implementation need to be checked
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_shat",fw.getMoment(FoxWolfram::SHAT,iorder));
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_pt",fw.getMoment(FoxWolfram::PT,iorder));
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_eta",fw.getMoment(FoxWolfram::ETA,iorder));
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_psum",fw.getMoment(FoxWolfram::PSUM,iorder));
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_pz",fw.getMoment(FoxWolfram::PZ,iorder));
-                                    eventView->setUserRecord(_prefix+"fox_"+std::to_string(iorder)+"_one",fw.getMoment(FoxWolfram::ONE,iorder));
-                                   
-                                
+                                    //the particles selected in the variation
+                                    _particles.clear();
+                                    for (unsigned int iname = 0; iname < _particlesForEventShape.size(); ++iname)
+                                    {
+                                        SystematicVariations::getParticles(index,eventView,_particlesForEventShape[iname],_variationParticlesForEventShape[iname],ivariation,_particles);
+                                    }
+                                    _input.clear();
+                                    for (const pxl::Particle* particle: _particles)
+                                    {
+                                        _input.add(variations.getVector(particle,ivariation));
+                                    }
+                                    storeVariables(eventView,_input,_suffixes[ivariation]);
                                 }
                             }
                             
@@ -166,6 +251,11 @@ class EventVariables:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -1,7 +1,8 @@
 #ifndef __FOXWOLFRAM_H__
 #define __FOXWOLFRAM_H__
 
-#include "pxl/core.hh"
+#include "EventShapeInput.hpp"
+
 #include "Math/SpecFuncMathMore.h"
 
 #include <cmath>
@@ -11,16 +12,16 @@
 class FoxWolfram
 {
     protected:
-        std::vector<pxl::LorentzVector> _eventVectors;
-        double totalEnergy;
+        //referenced; has to outlive the object
+        const EventShapeInput& _input;
     public:
         enum WeightType
         {
             SHAT,PT,ETA,PSUM,PZ,ONE
         };
     
-        FoxWolfram(const std::vector<pxl::LorentzVector>& eventVectors):
-            _eventVectors(eventVectors)
+        FoxWolfram(const EventShapeInput& input):
+            _input(input)
         {
         }
         
@@ -58,41 +59,45 @@ class FoxWolfram
             return -1;
         }
         
-        double cosTheta(const pxl::LorentzVector& v1, const pxl::LorentzVector& v2)
+        double cosTheta(unsigned int i, unsigned int j) const
         {
             //return std::cos(v1.getTheta())*std::cos(v2.getTheta())+std::sin(v1.getTheta())*std::sin(v2.getTheta())*std::cos(v1.getPhi()-v2.getPhi());
-            return (v1.getX()*v2.getX()+v1.getY()*v2.getY()+v1.getZ()*v2.getZ())/sqrt(v1.getMag2()*v2.getMag2());
+            return (_input.px[i]*_input.px[j]+_input.py[i]*_input.py[j]+_input.pz[i]*_input.pz[j])/(_input.p[i]*_input.p[j]);
         }
        
         
         double getMomentShat(unsigned int order) 
         {
             double sum = 0.0;
-            pxl::LorentzVector shat(0,0,0,0);
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            double shatPx = 0.0;
+            double shatPy = 0.0;
+            double shatPz = 0.0;
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                shat+=_eventVectors[i];
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                shatPx+=_input.px[i];
+                shatPy+=_input.py[i];
+                shatPz+=_input.pz[i];
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
-                    sum+=_eventVectors[i].getP()*_eventVectors[j].getP()*ROOT::Math::legendre(order,angle);
+                    double angle = cosTheta(i,j);
+                    sum+=_input.p[i]*_input.p[j]*ROOT::Math::legendre(order,angle);
                 }
             }
             
-            return sum/shat.getP()/shat.getP();
+            return sum/(shatPx*shatPx+shatPy*shatPy+shatPz*shatPz);
         }
         
         double getMomentPt(unsigned int order) 
         {
             double sum = 0.0;
             double norm = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                norm+=_eventVectors[i].getPt();
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                norm+=_input.pt[i];
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
-                    sum+=_eventVectors[i].getPt()*_eventVectors[j].getPt()*ROOT::Math::legendre(order,angle);
+                    double angle = cosTheta(i,j);
+                    sum+=_input.pt[i]*_input.pt[j]*ROOT::Math::legendre(order,angle);
                 }
             }
             
@@ -102,21 +107,21 @@ class FoxWolfram
         double getMomentEta(unsigned int order) 
         {
             double avgEta = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                avgEta+=_eventVectors[i].getEta();
+                avgEta+=_input.eta[i];
             }
-            avgEta/= _eventVectors.size();
+            avgEta/= _input.size();
         
             double norm = 0.0;
             double sum = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                norm+=1.0/(fabs(_eventVectors[i].getEta()-avgEta));
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                norm+=1.0/(fabs(_input.eta[i]-avgEta));
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
-                    sum+=1.0/(fabs(_eventVectors[i].getEta()-avgEta)*fabs(_eventVectors[j].getEta()-avgEta))*ROOT::Math::legendre(order,angle);
+                    double angle = cosTheta(i,j);
+                    sum+=1.0/(fabs(_input.eta[i]-avgEta)*fabs(_input.eta[j]-avgEta))*ROOT::Math::legendre(order,angle);
                 }
             }
             return sum/norm/norm;
@@ -126,13 +131,13 @@ class FoxWolfram
         {
             double sum = 0.0;
             double norm = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                norm+=_eventVectors[i].getP();
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                norm+=_input.p[i];
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
-                    sum+=_eventVectors[i].getP()*_eventVectors[j].getP()*ROOT::Math::legendre(order,angle);
+                    double angle = cosTheta(i,j);
+                    sum+=_input.p[i]*_input.p[j]*ROOT::Math::legendre(order,angle);
                 }
             }
             
@@ -143,13 +148,13 @@ class FoxWolfram
         {
             double sum = 0.0;
             double norm = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {  
-                norm+=_eventVectors[i].getPz();
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                norm+=_input.pz[i];
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
-                    sum+=_eventVectors[i].getPz()*_eventVectors[j].getPz()*ROOT::Math::legendre(order,angle);
+                    double angle = cosTheta(i,j);
+                    sum+=_input.pz[i]*_input.pz[j]*ROOT::Math::legendre(order,angle);
                 }
             }
 
@@ -159,11 +164,11 @@ class FoxWolfram
         double getMomentOne(unsigned int order) 
         {
             double sum = 0.0;
-            for (unsigned int i = 0; i < _eventVectors.size(); ++i)
+            for (unsigned int i = 0; i < _input.size(); ++i)
             {
-                for (unsigned int j = 0; j < _eventVectors.size(); ++j)
+                for (unsigned int j = 0; j < _input.size(); ++j)
                 {
-                    double angle = cosTheta(_eventVectors[i],_eventVectors[j]);
+                    double angle = cosTheta(i,j);
                     sum+=ROOT::Math::legendre(order,angle);
                 }
             }
@@ -173,4 +178,3 @@ class FoxWolfram
 };
 
 #endif
-
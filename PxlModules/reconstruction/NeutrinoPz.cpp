@@ -7,6 +7,15 @@
 
 #include "NeutrinoPzSolver.hpp"
 
+#include "utils/EventIndex.hpp"
+#include "utils/ParticlePool.hpp"
+#include "utils/SystematicVariations.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include <cmath>
+#include <sstream>
+
 static pxl::Logger logger("NeutrinoPz");
 
 class NeutrinoPz:
@@ -21,7 +30,28 @@ class NeutrinoPz:
         
         std::string _outputEventViewName;
         std::string _neutrinoName;
-    
+        
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _metKey;
+        EventIndex::Key _leptonKey;
+        EventIndex::Key _outputEventViewKey;
+        EventIndex::Key _neutrinoKey;
+        
+        //MET variations taken from user records of the MET; other variations are propagated from the varied particles
+        struct METVariation
+        {
+            unsigned int index;
+            UserRecordKey px;
+            UserRecordKey py;
+        };
+        std::vector<std::string> _metVariationDefinitions;
+        std::vector<METVariation> _metVariations;
+        //visible objects in the input event view whose variations are propagated to the MET
+        std::vector<std::string> _metObjectNames;
+        std::vector<EventIndex::Key> _metObjectKeys;
+        std::vector<std::string> _suffixes;
+
+        ModuleTimer _timer;
 
     public:
         NeutrinoPz() :
@@ -31,7 +61,8 @@ class NeutrinoPz:
             _leptonName("TightMuon"),
             
             _outputEventViewName("SingleTop"),
-            _neutrinoName("Neutrino")
+            _neutrinoName("Neutrino"),
+            _metObjectNames({"Jet","SelectedJet","SelectedJet__variations","SelectedBJet","SelectedBJet__variations","TightMuon","TightElectron"})
 
         {
             addSink("input", "Input");
@@ -43,6 +74,9 @@ class NeutrinoPz:
             
             addOption("output event view","name of the neutrino",_outputEventViewName);
             addOption("neutrino name","name of the neutrino",_neutrinoName);
+            
+            addOption("MET variations","list of 'name:px user record:py user record' of the MET, e.g. 'unclusteredUp:px_unclusteredUp:py_unclusteredUp'; other systematic variations are propagated to the MET",_metVariationDefinitions);
+            addOption("MET objects","names of the particles in the input event view whose varied px/py are subtracted from the MET",_metObjectNames);
 
         }
 
@@ -75,69 +109,157 @@ class NeutrinoPz:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("input event view",_inputEventViewName);
             getOption("met name",_metName);
             getOption("lepton name",_leptonName);
             
             getOption("output event view",_outputEventViewName);
             getOption("neutrino name",_neutrinoName);
+            getOption("MET variations",_metVariationDefinitions);
+            getOption("MET objects",_metObjectNames);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _metKey = EventIndex::intern(_metName);
+            _leptonKey = EventIndex::intern(_leptonName);
+            _outputEventViewKey = EventIndex::intern(_outputEventViewName);
+            _neutrinoKey = EventIndex::intern(_neutrinoName);
+            _metObjectKeys.clear();
+            for (const std::string& name: _metObjectNames)
+            {
+                _metObjectKeys.push_back(EventIndex::intern(name));
+            }
+            
+            _metVariations.clear();
+            for (const std::string& definition: _metVariationDefinitions)
+            {
+                std::vector<std::string> tokens;
+                std::istringstream ss(definition);
+                std::string token;
+                while (std::getline(ss,token,':'))
+                {
+                    tokens.push_back(token);
+                }
+                if (tokens.size()!=3 or tokens[0].empty() or tokens[1].empty() or tokens[2].empty())
+                {
+                    throw std::runtime_error(getName()+": invalid MET variation '"+definition+"', expected 'name:px user record:py user record'");
+                }
+                METVariation variation;
+                variation.index = SystematicVariations::registerVariation(tokens[0]);
+                variation.px = UserRecordKey(tokens[1]);
+                variation.py = UserRecordKey(tokens[2]);
+                _metVariations.push_back(variation);
+            }
+        }
+        
+        static double transverseMass(const pxl::LorentzVector& lepton, double px, double py)
+        {
+            const double pt = std::sqrt(px*px+py*py);
+            return std::sqrt((lepton.getPt()+pt)*(lepton.getPt()+pt)-(lepton.getPx()+px)*(lepton.getPx()+px)-(lepton.getPy()+py)*(lepton.getPy()+py));
+        }
+        
+        //change of the summed px/py of the varied MET objects per variation which is subtracted from the MET
+        void getMETShifts(const EventIndex& index, const pxl::EventView* eventView, const SystematicVariations& variations, unsigned int nVariations, std::vector<double>& shifts)
+        {
+            shifts.assign(2*nVariations,0.0);
+            for (EventIndex::Key key: _metObjectKeys)
+            {
+                for (const pxl::Particle* particle: index.getParticles(eventView,key))
+                {
+                    if (!variations.has(particle))
+                    {
+                        continue;
+                    }
+                    for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+                    {
+                        const pxl::LorentzVector vector = variations.getVector(particle,ivariation);
+                        shifts[2*ivariation] += vector.getPx()-particle->getPx();
+                        shifts[2*ivariation+1] += vector.getPy()-particle->getPy();
+                    }
+                }
+            }
+        }
+        
+        void storeVariations(SystematicVariations& variations, const std::vector<double>& shifts, pxl::Particle* met, pxl::Particle* lepton, pxl::Particle* neutrino, pxl::EventView* outputEventView)
+        {
+            const unsigned int nVariations = _suffixes.size();
+            std::vector<double> metPx(nVariations);
+            std::vector<double> metPy(nVariations);
+            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+            {
+                metPx[ivariation] = met->getPx()-shifts[2*ivariation];
+                metPy[ivariation] = met->getPy()-shifts[2*ivariation+1];
+            }
+            for (const METVariation& variation: _metVariations)
+            {
+                metPx[variation.index] = variation.px.get(met).toDouble();
+                metPy[variation.index] = variation.py.get(met).toDouble();
+            }
+            
+            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+            {
+                const double px = metPx[ivariation];
+                const double py = metPy[ivariation];
+                const double pt = std::sqrt(px*px+py*py);
+                variations.setVector(met,ivariation,pxl::LorentzVector(px,py,0.0,pt));
+                
+                const pxl::LorentzVector leptonVector = variations.getVector(lepton,ivariation);
+                pxl::Particle variedNeutrino;
+                solveNu4Momentum(&variedNeutrino,leptonVector,px,py);
+                variations.setVector(neutrino,ivariation,variedNeutrino.getVector());
+                
+                outputEventView->setUserRecord("mtw_beforePz"+_suffixes[ivariation],transverseMass(leptonVector,px,py));
+                outputEventView->setUserRecord("mtw_afterPz"+_suffixes[ivariation],transverseMass(leptonVector,variedNeutrino.getPx(),variedNeutrino.getPy()));
+            }
         }
 
         void endJob()
         {
+            _timer.report();
         }
         
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    EventIndex& index = EventIndex::get(event);
+                    const unsigned int nEventViews = index.getNEventViews();
                     
-                    pxl::EventView* outputEventView = nullptr;
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    const unsigned int nVariations = SystematicVariations::getNVariations();
+                    while (_suffixes.size()<nVariations)
                     {
-                        if (eventViews[ieventView]->getName()==_outputEventViewName)
-                        {
-                            outputEventView=eventViews[ieventView];
-                            break;
-                        }
+                        _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+                    }
+                    SystematicVariations* variations = nullptr;
+                    std::vector<double> metShifts;
+                    if (nVariations>0)
+                    {
+                        variations = &SystematicVariations::get(event);
                     }
+                    
+                    pxl::EventView* outputEventView = index.findEventView(_outputEventViewKey);
                     if (!outputEventView)
                     {
-                        outputEventView = event->create<pxl::EventView>();
-                        outputEventView->setName(_outputEventViewName);
+                        outputEventView = index.createEventView(event,_outputEventViewKey);
                     }
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<nEventViews;++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
-                            pxl::Particle* met=0;
-                            pxl::Particle* lepton=0;
+                            const std::vector<pxl::Particle*>& mets = index.getParticles(eventView,_metKey);
+                            const std::vector<pxl::Particle*>& leptons = index.getParticles(eventView,_leptonKey);
+                            pxl::Particle* met = mets.empty() ? 0 : mets.front();
+                            pxl::Particle* lepton = leptons.empty() ? 0 : leptons.front();
                             pxl::Particle* neutrino=0;
-                            for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
-                            {
-                                pxl::Particle* particle = particles[iparticle];
-                                if (met==0 &&(particle->getName()==_metName))
-                                {
-                                    met=particle;
-                                }
-                                if (lepton==0 &&(particle->getName()==_leptonName))
-                                {
-                                    lepton=particle;
-                                }
-                            }
                             if (met!=0 && lepton!=0)
                             {
-                                neutrino=outputEventView->create<pxl::Particle>();
-                                neutrino->setName(_neutrinoName);
+                                neutrino=index.create<PooledParticle>(outputEventView,_neutrinoKey);
                                 solveNu4Momentum(neutrino,lepton->getVector(),met->getPx(),met->getPy());
                                 pxl::Particle p1;
                                 pxl::Particle p2;
@@ -149,6 +271,11 @@ class NeutrinoPz:
                                 const double mtw_afterPz = sqrt((lepton->getPt()+neutrino->getPt())*(lepton->getPt()+neutrino->getPt())-(lepton->getPx()+neutrino->getPx())*(lepton->getPx()+neutrino->getPx())-(lepton->getPy()+neutrino->getPy())*(lepton->getPy()+neutrino->getPy()));
                                 outputEventView->setUserRecord("mtw_beforePz",mtw_beforePz);
                                 outputEventView->setUserRecord("mtw_afterPz",mtw_afterPz);
+                                if (variations)
+                                {
+                                    getMETShifts(index,eventView,*variations,nVariations,metShifts);
+                                    storeVariations(*variations,metShifts,met,lepton,neutrino,outputEventView);
+                                }
                             }
                         }
                     }
@@ -5,7 +5,18 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "CMSystem.hpp"
+
+#include "utils/EventIndex.hpp"
+#include "utils/EventSnapshot.hpp"
+#include "utils/ParticlePool.hpp"
+#include "utils/SystematicVariations.hpp"
+#include "utils/ModuleTimer.hpp"
+
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
 
 static pxl::Logger logger("TopReconstruction");
 
@@ -23,19 +34,27 @@ struct SortByUserRecord
     }
 };
 
-struct SortByPt
+struct SortByValue
 {
-    bool operator()(const pxl::Particle* p1, const pxl::Particle* p2) const
+    bool operator()(const std::pair<double,pxl::Particle*>& p1, const std::pair<double,pxl::Particle*>& p2) const
     {
-        return p1->getPt()>p2->getPt();
+        return p1.first>p2.first;
     }
 };
 
-struct SortByEta
+struct RestFrame
 {
-    bool operator()(const pxl::Particle* p1, const pxl::Particle* p2) const
+    const pxl::Basic3Vector boostVector;
+    RestFrame(const pxl::Particle* particle):
+        boostVector(-particle->getBoostVector())
     {
-        return fabs(p1->getEta())>fabs(p2->getEta());
+    }
+    
+    pxl::LorentzVector boost(const pxl::LorentzVector& vector) const
+    {
+        pxl::LorentzVector boosted = vector;
+        boosted.boost(boostVector);
+        return boosted;
     }
 };
 
@@ -60,9 +79,62 @@ class TopReconstruction:
         std::string _wbosonName;
         std::string _topName;
         
-
-
+        bool _lightweight;
+        
+        enum PolarisationBasis
+        {
+            BEAM,SPECTATOR,HELICITY,NBASES
+        };
+        bool _polarisationBases[NBASES];
+        
+        EventIndex::Key _inputEventViewLeptonKey;
+        EventIndex::Key _leptonKey;
+        EventIndex::Key _inputEventViewNeutrinoKey;
+        EventIndex::Key _neutrinoKey;
+        EventIndex::Key _inputEventViewJetsKey;
+        EventIndex::Key _bJetKey;
+        EventIndex::Key _lightJetKey;
+        EventIndex::Key _outputEventViewKey;
+        EventIndex::Key _wbosonKey;
+        EventIndex::Key _topKey;
+        
+        const EventIndex::Key _outputLightJetKey;
+        const EventIndex::Key _outputBJetKey;
+        const EventIndex::Key _dijetKey;
+        const EventIndex::Key _shatKey;
+        
+        //jets chosen by the numbers of light and b-jets; with a single jet only the jet from the top is set
+        struct Assignment
+        {
+            bool wboson;
+            pxl::Particle* lightjet;
+            pxl::Particle* bjet;
+            pxl::Particle* topJet;
+        };
         
+        //pT of the b-jets and |eta| of the light jets in the input order; taken from the snapshot if it contains the jets
+        std::vector<double> _bjetPt;
+        std::vector<double> _lightjetAbsEta;
+        std::vector<std::pair<double,pxl::Particle*>> _sortBuffer;
+        std::vector<std::string> _suffixes;
+        //store of the current event; null if no variations are registered
+        SystematicVariations* _variations;
+        
+        //names of the jets selected only in some variations and the event views of the input jets
+        EventIndex::Key _bJetVariationsKey;
+        EventIndex::Key _lightJetVariationsKey;
+        std::vector<pxl::EventView*> _jetEventViews;
+        //buffers of reconstructVariations
+        std::vector<pxl::Particle*> _reconstructed;
+        std::vector<pxl::Particle*> _variationBjets;
+        std::vector<pxl::Particle*> _variationLightjets;
+        std::vector<pxl::Particle*> _inputVariationBjets;
+        std::vector<pxl::Particle*> _inputVariationLightjets;
+        std::vector<double> _variationBjetPt;
+        std::vector<double> _variationLightjetAbsEta;
+        
+        ModuleTimer _timer;
+
     public:
         TopReconstruction():
             Module(),
@@ -78,7 +150,16 @@ class TopReconstruction:
             
             _outputEventViewName("SingleTop"),
             _wbosonName("W"),
-            _topName("Top")
+            _topName("Top"),
+            
+            _lightweight(false),
+            _polarisationBases{false,false,false},
+            
+            _outputLightJetKey(EventIndex::intern("LightJet")),
+            _outputBJetKey(EventIndex::intern("BJet")),
+            _dijetKey(EventIndex::intern("Dijet")),
+            _shatKey(EventIndex::intern("Shat")),
+            _variations(nullptr)
         {
             addSink("input", "input");
             _outputSource = addSource("selected","selected");
@@ -96,8 +177,10 @@ class TopReconstruction:
             addOption("output event view","",_outputEventViewName);
             addOption("W boson","",_wbosonName);
             addOption("top","",_topName);
-
-
+            
+            addOption("lightweight","only create W/top/Dijet/Shat from p4 sums; store indices of the used jets instead of cloning them into the output event view; LightJet_index/BJet_index count from 1 in the input collection given by LightJet_collection/BJet_collection (0: light jets, 1: b-jets), e.g. BJet_collection is 0 in the 0 b-tag categories",_lightweight);
+            
+            addOption("polarisation bases","additional polarisation angles to calculate: 'beam', 'spectator', 'helicity'",std::vector<std::string>());
         }
 
         ~TopReconstruction()
@@ -129,6 +212,7 @@ class TopReconstruction:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("input event view lepton",_inputEventViewNameLepton);
             getOption("lepton",_leptonName);
             
@@ -142,213 +226,284 @@ class TopReconstruction:
             getOption("output event view",_outputEventViewName);
             getOption("W boson",_wbosonName);
             getOption("top",_topName);
-
-        }
-        
-        float angle(const pxl::Basic3Vector& v1, const pxl::Basic3Vector& v2)
-        {
-            return (v1.getX()*v2.getX()+v1.getY()*v2.getY()+v1.getZ()*v2.getZ())/(v1.getMag()*v2.getMag());
-        }
-        
-        float angleInRestFrame(const pxl::LorentzVector& p1, const pxl::Basic3Vector& boost1, const pxl::LorentzVector& p2, const pxl::Basic3Vector& boost2)
-        {
-            pxl::LorentzVector boostedP1 = p1;
-            boostedP1.boost(-boost1);
-            pxl::LorentzVector boostedP2 = p2;
-            boostedP2.boost(-boost2);
-
-            return angle(boostedP1,boostedP2);
+            
+            getOption("lightweight",_lightweight);
+            
+            std::vector<std::string> bases;
+            getOption("polarisation bases",bases);
+            for (const std::string& basis: bases)
+            {
+                if (basis=="beam")
+                {
+                    _polarisationBases[BEAM]=true;
+                }
+                else if (basis=="spectator")
+                {
+                    _polarisationBases[SPECTATOR]=true;
+                }
+                else if (basis=="helicity")
+                {
+                    _polarisationBases[HELICITY]=true;
+                }
+                else
+                {
+                    throw std::runtime_error(getName()+": unknown polarisation basis '"+basis+"'");
+                }
+            }
+            
+            _inputEventViewLeptonKey = EventIndex::intern(_inputEventViewNameLepton);
+            _leptonKey = EventIndex::intern(_leptonName);
+            _inputEventViewNeutrinoKey = EventIndex::intern(_inputEventViewNameNeutrino);
+            _neutrinoKey = EventIndex::intern(_neutrinoName);
+            _inputEventViewJetsKey = EventIndex::intern(_inputEventViewNameJets);
+            _bJetKey = EventIndex::intern(_bJetName);
+            _lightJetKey = EventIndex::intern(_lightJetName);
+            _bJetVariationsKey = EventIndex::intern(SystematicVariations::getVariationsName(_bJetName));
+            _lightJetVariationsKey = EventIndex::intern(SystematicVariations::getVariationsName(_lightJetName));
+            _outputEventViewKey = EventIndex::intern(_outputEventViewName);
+            _wbosonKey = EventIndex::intern(_wbosonName);
+            _topKey = EventIndex::intern(_topName);
         }
         
-        void calculateAngles(pxl::EventView* eventView, pxl::Particle* lepton, pxl::Particle* neutrino, pxl::Particle* wboson, pxl::Particle* bjet, pxl::Particle* top, pxl::Particle* lightjet)
+        void calculateAngles(pxl::EventView* eventView, pxl::Particle* lepton, pxl::Particle* neutrino, pxl::Particle* wboson, pxl::Particle* bjet, pxl::Particle* top, pxl::Particle* lightjet, const std::string& suffix)
         {
-            if (eventView && lepton && wboson && top)
+            if (!(eventView && lepton && wboson && top))
             {
-                //w polarization - helicity basis
-                eventView->setUserRecord("cosTheta_wH",angleInRestFrame(lepton->getVector(),wboson->getBoostVector(),top->getVector(),wboson->getBoostVector()));
+                return;
             }
-            if (eventView && lepton && wboson && top && lightjet)
+            //boost vectors and boosted objects are calculated only once per event
+            const RestFrame wFrame(wboson);
+            const RestFrame topFrame(top);
+            
+            const pxl::LorentzVector leptonW = wFrame.boost(lepton->getVector());
+            const pxl::LorentzVector leptonTop = topFrame.boost(lepton->getVector());
+            
+            //w polarization - helicity basis
+            eventView->setUserRecord("cosTheta_wH"+suffix,angle(leptonW,wFrame.boost(top->getVector())));
+            
+            if (_polarisationBases[HELICITY])
+            {
+                //top polarization - helicity basis
+                eventView->setUserRecord("cosTheta_tH"+suffix,angle(leptonTop,top->getVector()));
+            }
+            if (_polarisationBases[BEAM])
+            {
+                //top polarization - beam axis oriented along the spectator jet if present
+                const double direction = (lightjet && lightjet->getPz()<0) ? -1.0 : 1.0;
+                eventView->setUserRecord("cosTheta_tBeam"+suffix,angle(leptonTop,pxl::Basic3Vector(0,0,direction)));
+            }
+            
+            if (lightjet)
             {
                 //w polarization - normal basis
-                pxl::Basic3Vector normalAxis = lightjet->getVector().cross(wboson->getVector());
-                eventView->setUserRecord("cosTheta_wN",angleInRestFrame(lepton->getVector(),wboson->getBoostVector(),normalAxis,wboson->getBoostVector()));
+                const pxl::Basic3Vector normalAxis = lightjet->getVector().cross(wboson->getVector());
+                eventView->setUserRecord("cosTheta_wN"+suffix,angle(leptonW,wFrame.boost(pxl::LorentzVector(normalAxis))));
                 //w polarization - transvers basis
-                pxl::Basic3Vector transverseAxis = wboson->getVector().cross(normalAxis);
-                eventView->setUserRecord("cosTheta_wT",angleInRestFrame(lepton->getVector(),wboson->getBoostVector(),transverseAxis,wboson->getBoostVector()));
+                const pxl::Basic3Vector transverseAxis = wboson->getVector().cross(normalAxis);
+                eventView->setUserRecord("cosTheta_wT"+suffix,angle(leptonW,wFrame.boost(pxl::LorentzVector(transverseAxis))));
+                
+                if (_polarisationBases[SPECTATOR])
+                {
+                    //w polarization - spectator jet basis
+                    eventView->setUserRecord("cosTheta_wS"+suffix,angle(leptonW,wFrame.boost(lightjet->getVector())));
+                }
 
+                const pxl::LorentzVector lightjetTop = topFrame.boost(lightjet->getVector());
                 //top polarization - lepton
-                eventView->setUserRecord("cosTheta_tPL",angleInRestFrame(lepton->getVector(),top->getBoostVector(),lightjet->getVector(),top->getBoostVector()));
+                eventView->setUserRecord("cosTheta_tPL"+suffix,angle(leptonTop,lightjetTop));
+                
+                if (neutrino && bjet)
+                {
+                    //top polarization - bjet
+                    eventView->setUserRecord("cosTheta_tPB"+suffix,angle(topFrame.boost(bjet->getVector()),lightjetTop));
+                    //top polarization - neutrino
+                    eventView->setUserRecord("cosTheta_tPN"+suffix,angle(topFrame.boost(neutrino->getVector()),lightjetTop));
+                }
+            }
+        }
+        
+        pxl::Particle* makeComposite(EventIndex& index, pxl::EventView* eventView, EventIndex::Key name, pxl::Particle* p1, pxl::Particle* p2)
+        {
+            pxl::Particle* composite = index.create<PooledParticle>(eventView,name);
+            if (_lightweight)
+            {
+                //daughters may live in another event view; only sum the p4
+                composite->addP4(p1);
+                composite->addP4(p2);
             }
-            if (eventView && top && neutrino && bjet && neutrino)
+            else
             {
-                //top polarization - bjet
-                eventView->setUserRecord("cosTheta_tPB",angleInRestFrame(bjet->getVector(),top->getBoostVector(),lightjet->getVector(),top->getBoostVector()));
-                //top polarization - neutrino
-                eventView->setUserRecord("cosTheta_tPN",angleInRestFrame(neutrino->getVector(),top->getBoostVector(),lightjet->getVector(),top->getBoostVector()));                    
+                composite->linkDaughter(p1);
+                composite->linkDaughter(p2);
+                composite->setP4FromDaughters();
             }
-            
+            return composite;
         }
         
-        pxl::Particle* makeWboson(pxl::EventView* eventView, pxl::Particle* p1, pxl::Particle* p2)
+        pxl::Particle* makeWboson(EventIndex& index, pxl::EventView* eventView, pxl::Particle* p1, pxl::Particle* p2)
         {
-            pxl::Particle* wboson = eventView->create<pxl::Particle>();
-            wboson->setName(_wbosonName);
-            wboson->linkDaughter(p1);
-            wboson->linkDaughter(p2);
-            wboson->setP4FromDaughters();
-            return wboson;
+            return makeComposite(index,eventView,_wbosonKey,p1,p2);
         }
         
-        pxl::Particle* makeTop(pxl::EventView* eventView, pxl::Particle* p1, pxl::Particle* p2)
+        pxl::Particle* makeTop(EventIndex& index, pxl::EventView* eventView, pxl::Particle* p1, pxl::Particle* p2)
         {
-            pxl::Particle* top = eventView->create<pxl::Particle>();
-            top->setName(_topName);
-            top->linkDaughter(p1);
-            top->linkDaughter(p2);
-            top->setP4FromDaughters();
-            return top;
+            return makeComposite(index,eventView,_topKey,p1,p2);
         }
         
-        pxl::Particle* makeCMSystem(pxl::EventView* eventView, const std::string& name, std::vector<pxl::Particle*> particles)
+        //sorts the jets by decreasing value (pT or |eta|); the values are given in the order of the jets
+        void sortJets(std::vector<pxl::Particle*>& jets, const std::vector<double>& values)
         {
-            pxl::Particle* cm = eventView->create<pxl::Particle>();
-            cm->setName(name);
-            //linking too much will crash the gui :-(
-            for (pxl::Particle* p: particles)
+            _sortBuffer.clear();
+            for (unsigned int ijet = 0; ijet < jets.size(); ++ijet)
             {
-                cm->addP4(p);
+                _sortBuffer.push_back(std::make_pair(values[ijet],jets[ijet]));
             }
-            if (particles.size()>=2)
-            {
-                float minCosTheta = 100;
-                float maxCosTheta = -100;
-                float minDY = 100;
-                float maxDY = -100;
-                float minDEta = 100;
-                float maxDEta = -100;
-                float minDR = 100;
-                float maxDR = -100;
-                float minDPhi = 100;
-                float maxDPhi = -100;
-                for (unsigned int i = 0; i < particles.size(); ++i)
-                {
-                    for (unsigned int j = i+1; j < particles.size(); ++j)
-                    {
-                        const pxl::Particle* p1 = particles[i];
-                        const pxl::Particle* p2 = particles[j];
-                        
-                        const float cosTheta = angle(p1->getVector(),p2->getVector());
-                        minCosTheta=std::min(minCosTheta,cosTheta);
-                        maxCosTheta=std::max(maxCosTheta,cosTheta);
-                        
-                        const float y1 = 0.5*std::log((p1->getE()+p1->getPz())/(p1->getE()-p1->getPz()));
-                        const float y2 = 0.5*std::log((p2->getE()+p2->getPz())/(p2->getE()-p2->getPz()));
-                        const float deltaY = fabs(y1-y2);
-                        minDY=std::min(minDY,deltaY);
-                        maxDY=std::max(maxDY,deltaY);
-                        
-                        const float deltaEta = fabs(p1->getEta()-p2->getEta());
-                        minDEta=std::min(minDEta,deltaEta);
-                        maxDEta=std::max(maxDEta,deltaEta);
-                        
-                        const float deltaR = p1->getVector().deltaR(&(p2->getVector()));
-                        minDR=std::min(minDR,deltaR);
-                        maxDR=std::max(maxDR,deltaR);
-                        
-                        const float deltaPhi = p1->getVector().deltaPhi(&(p2->getVector()));
-                        minDPhi=std::min(minDPhi,deltaPhi);
-                        maxDPhi=std::max(maxDPhi,deltaPhi);
-                    }
+            std::sort(_sortBuffer.begin(),_sortBuffer.end(),SortByValue());
+            for (unsigned int ijet = 0; ijet < jets.size(); ++ijet)
+            {
+                jets[ijet]=_sortBuffer[ijet].second;
+            }
+        }
+        
+        //particles of the snapshot if it contains them, otherwise of the index
+        static const std::vector<pxl::Particle*>& getParticles(const EventIndex& index, const EventSnapshot* snapshot, const pxl::EventView* eventView, EventIndex::Key name)
+        {
+            const EventSnapshot::Collection* collection = snapshot ? snapshot->findCollection(eventView,name) : nullptr;
+            return collection ? collection->particles : index.getParticles(eventView,name);
+        }
+        
+        //appends the jets and their pT or |eta| from the snapshot columns or the particles
+        static void addJets(const EventIndex& index, const EventSnapshot* snapshot, const pxl::EventView* eventView, EventIndex::Key name, bool absEta, std::vector<pxl::Particle*>& jets, std::vector<double>& values)
+        {
+            const EventSnapshot::Collection* collection = snapshot ? snapshot->findCollection(eventView,name) : nullptr;
+            if (collection)
+            {
+                jets.insert(jets.end(),collection->particles.begin(),collection->particles.end());
+                for (unsigned int ijet = 0; ijet < collection->size(); ++ijet)
+                {
+                    values.push_back(absEta ? std::fabs(collection->eta[ijet]) : collection->pt[ijet]);
                 }
-                if (particles.size()>2)
+            }
+            else
+            {
+                const std::vector<pxl::Particle*>& particles = index.getParticles(eventView,name);
+                jets.insert(jets.end(),particles.begin(),particles.end());
+                for (const pxl::Particle* particle: particles)
                 {
-                    cm->setUserRecord("minCosTheta",minCosTheta);
-                    cm->setUserRecord("maxCosTheta",maxCosTheta);
-                    
-                    cm->setUserRecord("minDY",minDY);
-                    cm->setUserRecord("maxDY",maxDY);
-                    
-                    cm->setUserRecord("minDEta",minDEta);
-                    cm->setUserRecord("maxDEta",maxDEta);
-                    
-                    cm->setUserRecord("minDR",minDR);
-                    cm->setUserRecord("maxDR",maxDR);
-                    
-                    cm->setUserRecord("minDPhi",minDPhi);
-                    cm->setUserRecord("maxDPhi",maxDPhi);
+                    values.push_back(absEta ? std::fabs(particle->getEta()) : particle->getPt());
                 }
-                else if (particles.size()==2)
+            }
+        }
+        
+        //clones the chosen jets into the output event view or uses them directly in lightweight mode
+        void assignJets(EventIndex& index, pxl::EventView* eventView, pxl::Particle* lightjetCandidate, pxl::Particle* bjetCandidate, pxl::Particle*& lightjet, pxl::Particle*& bjet)
+        {
+            if (_lightweight)
+            {
+                lightjet=lightjetCandidate;
+                bjet=bjetCandidate;
+            }
+            else
+            {
+                lightjet=new PooledParticle(*lightjetCandidate);
+                bjet=new PooledParticle(*bjetCandidate);
+                index.insertObject(eventView,lightjet);
+                index.insertObject(eventView,bjet);
+                if (_variations)
                 {
-                    cm->setUserRecord("CosTheta",minCosTheta);
-                    cm->setUserRecord("DY",minDY);
-                    cm->setUserRecord("DEta",minDEta);
-                    cm->setUserRecord("DR",minDR);
-                    cm->setUserRecord("DPhi",minDPhi);
+                    _variations->copy(lightjetCandidate,lightjet);
+                    _variations->copy(bjetCandidate,bjet);
                 }
             }
+        }
         
+        //position (starting at 1 as the RootTreeWriter multiplicity) of a jet among the input jets of the same name
+        int jetIndex(const pxl::Particle* jet, const std::vector<pxl::Particle*>& lightjets, const std::vector<pxl::Particle*>& bjets)
+        {
+            std::vector<pxl::Particle*>::const_iterator it = std::find(lightjets.begin(),lightjets.end(),jet);
+            if (it!=lightjets.end())
+            {
+                return it-lightjets.begin()+1;
+            }
+            it = std::find(bjets.begin(),bjets.end(),jet);
+            if (it!=bjets.end())
+            {
+                return it-bjets.begin()+1;
+            }
+            return -1;
+        }
+        
+        //input collection of a jet for the *_collection records: 0 for the light jets, 1 for the b-jets, -1 if not found
+        int jetCollection(const pxl::Particle* jet, const std::vector<pxl::Particle*>& lightjets, const std::vector<pxl::Particle*>& bjets)
+        {
+            if (std::find(lightjets.begin(),lightjets.end(),jet)!=lightjets.end())
+            {
+                return 0;
+            }
+            if (std::find(bjets.begin(),bjets.end(),jet)!=bjets.end())
+            {
+                return 1;
+            }
+            return -1;
+        }
+        
+        pxl::Particle* makeCMSystem(EventIndex& index, pxl::EventView* eventView, EventIndex::Key name, const std::vector<pxl::Particle*>& particles)
+        {
+            pxl::Particle* cm = index.create<PooledParticle>(eventView,name);
+            //linking too much will crash the gui :-(
+            for (pxl::Particle* p: particles)
+            {
+                cm->addP4(p);
+            }
+            calculateCMVariables(cm,particles,"");
             return cm;
         }
         
-        void reconstructEvent(pxl::EventView* eventView, pxl::Particle* lepton, pxl::Particle* neutrino, std::vector<pxl::Particle*>& lightjets, std::vector<pxl::Particle*>& bjets) 
+        //sets the p4 to the sum of the particles
+        static void setP4(pxl::Particle* particle, const std::vector<pxl::Particle*>& particles)
+        {
+            particle->setP4(0,0,0,0);
+            for (pxl::Particle* p: particles)
+            {
+                particle->addP4(p);
+            }
+        }
+        
+        /*
+        * Chooses the jets by the numbers of light and b-jets. The jets are
+        * sorted if needed by the given values which are in the input order.
+        */
+        Assignment chooseJets(std::vector<pxl::Particle*>& lightjets, const std::vector<double>& lightjetAbsEta, std::vector<pxl::Particle*>& bjets, const std::vector<double>& bjetPt)
         {
             const unsigned int nljets = lightjets.size();
             const unsigned int nbjets = bjets.size();
             const unsigned int njets = nljets+nbjets;
+            Assignment assignment = {njets<=3,nullptr,nullptr,nullptr};
             
-            pxl::Particle* wboson = nullptr;
-            pxl::Particle* top = nullptr;
-            pxl::Particle* lightjet = nullptr;
-            pxl::Particle* bjet = nullptr;
-            
-            if (njets==0)
-            {
-                wboson = makeWboson(eventView,lepton,neutrino);
-            }
             if (njets==1)
             {
-                wboson = makeWboson(eventView,lepton,neutrino);
-                if (nljets==1)
-                {
-                    top = makeTop(eventView,wboson,lightjets[0]);
-                }
-                else if (nbjets==1)
-                {
-                    top = makeTop(eventView,wboson,bjets[0]);
-                }
+                assignment.topJet = nljets==1 ? lightjets[0] : bjets[0];
             }
             else if (njets==2)
-            {   
+            {
                 if (nbjets==0)
                 {
                     //take the central jet as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(lightjets.begin(),lightjets.end(),SortByEta());
-                    lightjet=(pxl::Particle*)lightjets[0]->clone();
-                    bjet=(pxl::Particle*)lightjets[1]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(lightjets,lightjetAbsEta);
+                    assignment.lightjet = lightjets[0];
+                    assignment.bjet = lightjets[1];
                 }
                 else if (nbjets==1)
                 {
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    lightjet=(pxl::Particle*)lightjets[0]->clone();
-                    bjet=(pxl::Particle*)bjets[0]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    assignment.lightjet = lightjets[0];
+                    assignment.bjet = bjets[0];
                 }
                 else if (nbjets==2)
                 {
                     //take the jet with the higher pT as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(bjets.begin(),bjets.end(),SortByPt());
-                    lightjet=(pxl::Particle*)bjets[1]->clone();
-                    bjet=(pxl::Particle*)bjets[0]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(bjets,bjetPt);
+                    assignment.lightjet = bjets[1];
+                    assignment.bjet = bjets[0];
                 }
             }
             else if (njets==3)
@@ -356,62 +511,223 @@ class TopReconstruction:
                 if (nbjets==0)
                 {
                     //take the central jet as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(lightjets.begin(),lightjets.end(),SortByEta());
-                    lightjet=(pxl::Particle*)lightjets[0]->clone();
-                    bjet=(pxl::Particle*)lightjets[2]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(lightjets,lightjetAbsEta);
+                    assignment.lightjet = lightjets[0];
+                    assignment.bjet = lightjets[2];
                 }
                 else if (nbjets==1)
                 {
                     //take the central jet as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(lightjets.begin(),lightjets.end(),SortByEta());
-                    lightjet=(pxl::Particle*)lightjets[0]->clone();
-                    bjet=(pxl::Particle*)bjets[0]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(lightjets,lightjetAbsEta);
+                    assignment.lightjet = lightjets[0];
+                    assignment.bjet = bjets[0];
                 }
                 else if (nbjets==2)
                 {
                     //take the jet with the higher pT as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(bjets.begin(),bjets.end(),SortByPt());
-                    lightjet=(pxl::Particle*)lightjets[0]->clone();
-                    bjet=(pxl::Particle*)bjets[0]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(bjets,bjetPt);
+                    assignment.lightjet = lightjets[0];
+                    assignment.bjet = bjets[0];
                 }
                 else if (nbjets==3)
                 {
                     //take the jet with the higher pT as the one from the top
-                    wboson = makeWboson(eventView,lepton,neutrino);
-                    std::sort(bjets.begin(),bjets.end(),SortByPt());
-                    lightjet=(pxl::Particle*)bjets[2]->clone();
-                    bjet=(pxl::Particle*)bjets[0]->clone();
-                    eventView->insertObject(lightjet);
-                    eventView->insertObject(bjet);
-                    top = makeTop(eventView,wboson,bjet);
+                    sortJets(bjets,bjetPt);
+                    assignment.lightjet = bjets[2];
+                    assignment.bjet = bjets[0];
                 }
             }
+            if (assignment.bjet)
+            {
+                assignment.topJet = assignment.bjet;
+            }
+            return assignment;
+        }
+        
+        void storeJetIndices(pxl::EventView* eventView, const pxl::Particle* lightjet, const pxl::Particle* bjet, const std::vector<pxl::Particle*>& inputLightjets, const std::vector<pxl::Particle*>& inputBjets, const std::string& suffix)
+        {
             if (lightjet)
             {
-                lightjet->setName("LightJet");
+                eventView->setUserRecord("LightJet_index"+suffix,jetIndex(lightjet,inputLightjets,inputBjets));
+                eventView->setUserRecord("LightJet_collection"+suffix,jetCollection(lightjet,inputLightjets,inputBjets));
             }
             if (bjet)
             {
-                bjet->setName("BJet");
+                eventView->setUserRecord("BJet_index"+suffix,jetIndex(bjet,inputLightjets,inputBjets));
+                eventView->setUserRecord("BJet_collection"+suffix,jetCollection(bjet,inputLightjets,inputBjets));
+            }
+        }
+        
+        /*
+        * Redoes the jet assignment and the reconstruction with the jets
+        * selected in each variation and their varied four-momenta. The results
+        * are stored as the variations of the reconstructed particles and with
+        * the variation suffix. A variation in another category than the
+        * nominal one (e.g. a third jet) has no reconstructed particles to hold
+        * its result, so the event is flagged as not selected in it and the
+        * 'variationMask' of the reconstructed particles excludes it.
+        */
+        void reconstructVariations(const EventIndex& index, pxl::Event* event, pxl::EventView* eventView, pxl::Particle* lepton, pxl::Particle* neutrino, pxl::Particle* wboson, pxl::Particle* top, pxl::Particle* lightjet, pxl::Particle* bjet, pxl::Particle* dijet, pxl::Particle* shat)
+        {
+            const unsigned int nVariations = SystematicVariations::getNVariations();
+            while (_suffixes.size()<nVariations)
+            {
+                _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+            }
+            SystematicVariations& variations = *_variations;
+            //the jets are only set per variation if they are clones
+            _reconstructed.clear();
+            for (pxl::Particle* particle: {wboson,top,dijet,shat,_lightweight ? nullptr : lightjet,_lightweight ? nullptr : bjet})
+            {
+                if (particle)
+                {
+                    variations.add(particle);
+                    _reconstructed.push_back(particle);
+                }
+            }
+            uint64_t mask = 0;
+            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+            {
+                SystematicVariations::Scope scope(variations,ivariation);
+                _variationBjets.clear();
+                _variationLightjets.clear();
+                for (pxl::EventView* jetEventView: _jetEventViews)
+                {
+                    SystematicVariations::getParticles(index,jetEventView,_bJetKey,_bJetVariationsKey,ivariation,_variationBjets);
+                    if (_lightJetKey!=_bJetKey)
+                    {
+                        SystematicVariations::getParticles(index,jetEventView,_lightJetKey,_lightJetVariationsKey,ivariation,_variationLightjets);
+                    }
+                }
+                _variationBjetPt.clear();
+                for (const pxl::Particle* jet: _variationBjets)
+                {
+                    _variationBjetPt.push_back(jet->getPt());
+                }
+                _variationLightjetAbsEta.clear();
+                for (const pxl::Particle* jet: _variationLightjets)
+                {
+                    _variationLightjetAbsEta.push_back(std::fabs(jet->getEta()));
+                }
+                if (_lightweight)
+                {
+                    _inputVariationBjets = _variationBjets;
+                    _inputVariationLightjets = _variationLightjets;
+                }
+                
+                const Assignment assignment = chooseJets(_variationLightjets,_variationLightjetAbsEta,_variationBjets,_variationBjetPt);
+                if (assignment.wboson!=(wboson!=nullptr) or (assignment.lightjet!=nullptr)!=(lightjet!=nullptr) or (assignment.topJet!=nullptr)!=(top!=nullptr))
+                {
+                    SystematicVariations::selectEvent(event,SystematicVariations::getSelectedKey(ivariation),false);
+                    continue;
+                }
+                if (ivariation<64)
+                {
+                    mask |= uint64_t(1)<<ivariation;
+                }
+                
+                pxl::Particle* variationLightjet = assignment.lightjet;
+                pxl::Particle* variationBjet = assignment.bjet;
+                if (lightjet and !_lightweight)
+                {
+                    setP4(lightjet,{assignment.lightjet});
+                    setP4(bjet,{assignment.bjet});
+                    variationLightjet = lightjet;
+                    variationBjet = bjet;
+                }
+                if (wboson)
+                {
+                    setP4(wboson,{lepton,neutrino});
+                }
+                if (top)
+                {
+                    setP4(top,{wboson,variationBjet ? variationBjet : assignment.topJet});
+                }
+                if (_lightweight)
+                {
+                    storeJetIndices(eventView,variationLightjet,variationBjet,_inputVariationLightjets,_inputVariationBjets,_suffixes[ivariation]);
+                }
+                calculateAngles(eventView,lepton,neutrino,wboson,variationBjet,top,variationLightjet,_suffixes[ivariation]);
+                if (dijet)
+                {
+                    const std::vector<pxl::Particle*> constituents = {variationBjet,variationLightjet};
+                    setP4(dijet,constituents);
+                    calculateCMVariables(dijet,constituents,_suffixes[ivariation]);
+                }
+                if (shat)
+                {
+                    const std::vector<pxl::Particle*> constituents = {variationBjet,variationLightjet,lepton,neutrino};
+                    setP4(shat,constituents);
+                    calculateCMVariables(shat,constituents,_suffixes[ivariation]);
+                }
+                for (pxl::Particle* particle: _reconstructed)
+                {
+                    variations.setVector(particle,ivariation,particle->getVector());
+                }
+            }
+            for (pxl::Particle* particle: _reconstructed)
+            {
+                SystematicVariations::getMaskKey().set(particle,mask);
+            }
+        }
+        
+        void reconstructEvent(EventIndex& index, pxl::Event* event, pxl::EventView* eventView, pxl::Particle* lepton, pxl::Particle* neutrino, std::vector<pxl::Particle*>& lightjets, std::vector<pxl::Particle*>& bjets) 
+        {
+            pxl::Particle* wboson = nullptr;
+            pxl::Particle* top = nullptr;
+            pxl::Particle* lightjet = nullptr;
+            pxl::Particle* bjet = nullptr;
+            pxl::Particle* dijet = nullptr;
+            pxl::Particle* shat = nullptr;
+            
+            //keep the input order for storing the jet indices before sorting
+            std::vector<pxl::Particle*> inputLightjets;
+            std::vector<pxl::Particle*> inputBjets;
+            if (_lightweight)
+            {
+                inputLightjets = lightjets;
+                inputBjets = bjets;
             }
-            calculateAngles(eventView, lepton, neutrino, wboson, bjet, top, lightjet);
+            
+            const Assignment assignment = chooseJets(lightjets,_lightjetAbsEta,bjets,_bjetPt);
+            if (assignment.wboson)
+            {
+                wboson = makeWboson(index,eventView,lepton,neutrino);
+            }
+            if (assignment.lightjet)
+            {
+                assignJets(index,eventView,assignment.lightjet,assignment.bjet,lightjet,bjet);
+                top = makeTop(index,eventView,wboson,bjet);
+            }
+            else if (assignment.topJet)
+            {
+                top = makeTop(index,eventView,wboson,assignment.topJet);
+            }
+            if (_lightweight)
+            {
+                storeJetIndices(eventView,lightjet,bjet,inputLightjets,inputBjets,"");
+            }
+            else
+            {
+                if (lightjet)
+                {
+                    index.setName(eventView,lightjet,_outputLightJetKey);
+                }
+                if (bjet)
+                {
+                    index.setName(eventView,bjet,_outputBJetKey);
+                }
+            }
+            calculateAngles(eventView, lepton, neutrino, wboson, bjet, top, lightjet, "");
             
             if (bjet && lightjet)
             {
-                makeCMSystem(eventView,"Dijet",{{bjet,lightjet}});
-                makeCMSystem(eventView,"Shat",{{bjet,lightjet,lepton,neutrino}});
+                dijet = makeCMSystem(index,eventView,_dijetKey,{{bjet,lightjet}});
+                shat = makeCMSystem(index,eventView,_shatKey,{{bjet,lightjet,lepton,neutrino}});
+            }
+            if (_variations)
+            {
+                reconstructVariations(index,event,eventView,lepton,neutrino,wboson,top,lightjet,bjet,dijet,shat);
             }
             /*
             if (njets>0)
@@ -426,88 +742,88 @@ class TopReconstruction:
         
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    EventIndex& index = EventIndex::get(event);
+                    const EventSnapshot* snapshot = EventSnapshot::get(event);
+                    const unsigned int nEventViews = index.getNEventViews();
+                    
+                    _variations = SystematicVariations::getNVariations()>0 ? &SystematicVariations::get(event) : nullptr;
                     
                     pxl::Particle* lepton = nullptr;
                     pxl::Particle* neutrino = nullptr;
                     std::vector<pxl::Particle*> bjets;
                     std::vector<pxl::Particle*> lightjets;
+                    _bjetPt.clear();
+                    _lightjetAbsEta.clear();
+                    _jetEventViews.clear();
             
-                    pxl::EventView* outputEventView = nullptr;
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
-                    {
-                        if (eventViews[ieventView]->getName()==_outputEventViewName)
-                        {
-                            outputEventView=eventViews[ieventView];
-                            break;
-                        }
-                    }
+                    pxl::EventView* outputEventView = index.findEventView(_outputEventViewKey);
                     if (!outputEventView)
                     {
-                        outputEventView = event->create<pxl::EventView>();
-                        outputEventView->setName(_outputEventViewName);
+                        outputEventView = index.createEventView(event,_outputEventViewKey);
                     }
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<nEventViews;++ieventView)
                     {
-                        pxl::EventView* inputEventView = eventViews[ieventView];
+                        pxl::EventView* inputEventView = index.getEventView(ieventView);
+                        const EventIndex::Key inputEventViewKey = index.getEventViewName(ieventView);
                         
-                        
-                            
-                        std::vector<pxl::Particle*> particles;
-                        inputEventView->getObjectsOfType(particles);
-
-                        for (unsigned int iparticle = 0; iparticle<particles.size(); ++iparticle)
+                        if (!lepton and inputEventViewKey==_inputEventViewLeptonKey)
                         {
-                            pxl::Particle* particle = particles[iparticle];
-                            if (!lepton and inputEventView->getName()==_inputEventViewNameLepton and particle->getName()==_leptonName)
+                            const std::vector<pxl::Particle*>& leptons = getParticles(index,snapshot,inputEventView,_leptonKey);
+                            if (!leptons.empty())
                             {
-                                if (_inputEventViewNameLepton!=_outputEventViewName)
+                                lepton=leptons.front();
+                                if (!_lightweight and _inputEventViewNameLepton!=_outputEventViewName)
                                 {
-                                    lepton=(pxl::Particle*)particle->clone();
-                                    outputEventView->insertObject(lepton);
-                                }
-                                else
-                                {
-                                    lepton=particle;
+                                    pxl::Particle* original = lepton;
+                                    lepton=new PooledParticle(*original);
+                                    index.insertObject(outputEventView,lepton);
+                                    if (_variations)
+                                    {
+                                        _variations->copy(original,lepton);
+                                    }
                                 }
                             }
-                            if (!neutrino and inputEventView->getName()==_inputEventViewNameNeutrino and particle->getName()==_neutrinoName)
+                        }
+                        if (!neutrino and inputEventViewKey==_inputEventViewNeutrinoKey)
+                        {
+                            const std::vector<pxl::Particle*>& neutrinos = getParticles(index,snapshot,inputEventView,_neutrinoKey);
+                            if (!neutrinos.empty())
                             {
-                                if (_inputEventViewNameNeutrino!=_outputEventViewName)
+                                neutrino=neutrinos.front();
+                                if (!_lightweight and _inputEventViewNameNeutrino!=_outputEventViewName)
                                 {
-                                    neutrino=(pxl::Particle*)particle->clone();
-                                    outputEventView->insertObject(neutrino);
-                                }
-                                else
-                                {
-                                    neutrino=particle;
+                                    pxl::Particle* original = neutrino;
+                                    neutrino=new PooledParticle(*original);
+                                    index.insertObject(outputEventView,neutrino);
+                                    if (_variations)
+                                    {
+                                        _variations->copy(original,neutrino);
+                                    }
                                 }
                             }
-                            if (inputEventView->getName()==_inputEventViewNameJets)
+                        }
+                        if (inputEventViewKey==_inputEventViewJetsKey)
+                        {
+                            _jetEventViews.push_back(inputEventView);
+                            addJets(index,snapshot,inputEventView,_bJetKey,false,bjets,_bjetPt);
+                            if (_lightJetKey!=_bJetKey)
                             {
-                                if ( particle->getName()==_bJetName)
-                                {
-                                    bjets.push_back(particle);
-                                }
-                                else if (particle->getName()==_lightJetName)
-                                {
-                                    lightjets.push_back(particle);
-                                }
+                                addJets(index,snapshot,inputEventView,_lightJetKey,true,lightjets,_lightjetAbsEta);
                             }
                         }
                     }
                     
                     if (lepton && neutrino)
                     {
-                        reconstructEvent(outputEventView,lepton,neutrino,lightjets,bjets);
+                        reconstructEvent(index,event,outputEventView,lepton,neutrino,lightjets,bjets);
                     }
                     
                     _outputSource->setTargets(event);
@@ -527,6 +843,11 @@ class TopReconstruction:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -5,8 +5,43 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/SystematicVariations.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include "VariationRouting.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
 static pxl::Logger logger("BTagSelection");
 
+/*
+* Selects b-tagged jets with one algorithm and working point. If the option
+* 'working points' is given, a list of working points is evaluated instead in a
+* single pass: every discriminator is read once per jet and each jet gets a bit
+* mask 'bTagCategory' with one bit per passed working point. The jet is renamed
+* to the first working point it passes, hence the list should be ordered from
+* tight to loose. The events are sent to the first of the 'categories' whose
+* conditions on the numbers of jets passing each working point are fulfilled.
+*
+* The category sources have to exist before the modules are connected, so they
+* are created in initialize() from the 'working points' and 'categories'
+* options. This assumes that the options are set before initialize() is called
+* (as when loading an analysis file); beginJob throws if the options differ from
+* the ones initialize() has seen. A repeated initialize() reuses the sources
+* already added; sources of categories removed in between stay unconnected.
+*
+* With systematic variations the jets selected only in variations (named
+* '<input jets>__variations' by JetSelection) are b-tagged as well and renamed
+* to '<b-jets>__variations'. The numbers of b-jets and the output are
+* determined per variation; VariationRouting chooses the output of the event.
+*/
 class BTagSelection:
     public pxl::Module
 {
@@ -29,6 +64,80 @@ class BTagSelection:
         //"Combined Secondary Vertex", i.e. extracting the discriminator value from a given set of input variables
         double _maxEtaBJet; //Maximum pseudorapidity for b-tagging according to b-tagging algorithm
         double _bTaggingWorkingPoint; // working point of b-tagging algorithm above jets are tagged
+        
+        EventIndex::Key _inputJetKey;
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _bTaggedJetKey;
+        //jets selected only in some variations
+        EventIndex::Key _inputVariationJetKey;
+        EventIndex::Key _bTaggedVariationJetKey;
+        
+        UserRecordKey _bTaggingAlgorithmKey;
+        
+        struct WorkingPoint
+        {
+            unsigned int algorithm; //index in _algorithmKeys
+            double value;
+            std::string name;
+            EventIndex::Key key;
+            EventIndex::Key variationKey;
+            //number of passing jets stored on the event view
+            UserRecordKey countKey;
+            CutFlow::Counter counter;
+        };
+        
+        struct Condition
+        {
+            enum Operator
+            {
+                EQUAL,LESS,LESSEQUAL,GREATER,GREATEREQUAL
+            };
+            unsigned int workingPoint;
+            Operator op;
+            unsigned int count;
+        };
+        
+        struct Category
+        {
+            std::string name;
+            std::vector<Condition> conditions;
+            pxl::Source* source;
+        };
+        
+        std::vector<std::string> _workingPointDefinitions;
+        std::vector<std::string> _categoryDefinitions;
+        
+        std::vector<UserRecordKey> _algorithmKeys;
+        std::vector<WorkingPoint> _workingPoints;
+        std::vector<Category> _categories;
+        pxl::Source* _outputOtherCategorySource;
+        
+        //options used by initialize() and the sources it has added so far
+        std::vector<std::string> _initializedWorkingPoints;
+        std::vector<std::string> _initializedCategories;
+        std::map<std::string,pxl::Source*> _categorySources;
+        
+        //buffers of analyseWorkingPoints, sized in beginJob
+        UserRecordKey _bTagCategoryKey;
+        std::vector<double> _discriminators;
+        //numbers of jets per working point for the nominal and then per variation
+        std::vector<unsigned int> _counts;
+        std::vector<pxl::Particle*> _jets;
+        std::vector<pxl::Particle*> _variationJets;
+        
+        std::vector<std::string> _acceptedOutputs;
+        VariationRouting _routing;
+        std::vector<std::string> _suffixes;
+        //buffers of the routing, one entry for the nominal and per variation
+        std::vector<unsigned int> _nBJets;
+        std::vector<pxl::Source*> _outputs;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+        CutFlow::Counter _etaCounter;
+        CutFlow::Counter _discriminatorCounter;
+
+        ModuleTimer _timer;
 
     public:
         BTagSelection():
@@ -38,7 +147,9 @@ class BTagSelection:
             _bTaggedJetName("SelectedBJet"),
             _bTaggingAlgorithmName("combinedInclusiveSecondaryVertexV2BJetTags"),
             _maxEtaBJet(2.4),
-            _bTaggingWorkingPoint(0.941)
+            _bTaggingWorkingPoint(0.941),
+            _outputOtherCategorySource(nullptr),
+            _bTagCategoryKey("bTagCategory")
 
         {
             addSink("input", "input");
@@ -47,6 +158,12 @@ class BTagSelection:
             _output2BTagsSource = addSource("2 b-Tags", "2 b-Tags");
             _output1BTagsSource = addSource("1 b-Tags", "1 b-Tags");
             _output0BTagsSource = addSource("0 b-Tags", "0 b-Tags");
+            _cutFlow.addSource(_outputOtherBTagsSource);
+            _cutFlow.addSource(_output2BTagsSource);
+            _cutFlow.addSource(_output1BTagsSource);
+            _cutFlow.addSource(_output0BTagsSource);
+            _etaCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"abs(eta)");
+            _discriminatorCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"discriminator");
 
 
             addOption("event view","name of the event view where jets are selected",_inputEventViewName);
@@ -57,7 +174,12 @@ class BTagSelection:
 
             addOption("maximum b-jet eta","",_maxEtaBJet);
             addOption("working point","",_bTaggingWorkingPoint);
-
+            
+            addOption("working points","list of 'algorithm:working point:name of b-jets' ordered from tight to loose; replaces the single algorithm and working point if not empty",_workingPointDefinitions);
+            addOption("categories","list of 'source name: name>=n, name==n, ...' with the numbers of jets passing each working point; the event is sent to the first matching category or to 'other category'",_categoryDefinitions);
+            addOption("accepted outputs","outputs which are connected, e.g. '1 b-Tags'; an event whose nominal b-jets go to another output is sent to the output of the first variation going to one of these; 'selected__<variation>' is false for the variations going to another output than the event; empty: route by the nominal b-jets",_acceptedOutputs);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~BTagSelection()
@@ -83,12 +205,176 @@ class BTagSelection:
             return false;
         }
 
+        static std::string trim(const std::string& s)
+        {
+            const size_t begin = s.find_first_not_of(" \t");
+            if (begin==std::string::npos)
+            {
+                return "";
+            }
+            return s.substr(begin,s.find_last_not_of(" \t")-begin+1);
+        }
+        
+        static std::vector<std::string> split(const std::string& s, char delimiter)
+        {
+            std::vector<std::string> tokens;
+            std::istringstream ss(s);
+            std::string token;
+            while (std::getline(ss,token,delimiter))
+            {
+                tokens.push_back(trim(token));
+            }
+            return tokens;
+        }
+        
+        void parseWorkingPoints()
+        {
+            _algorithmKeys.clear();
+            _workingPoints.clear();
+            if (_workingPointDefinitions.size()>32)
+            {
+                throw std::runtime_error("at most 32 working points are supported");
+            }
+            std::vector<std::string> algorithmNames;
+            for (const std::string& definition: _workingPointDefinitions)
+            {
+                const std::vector<std::string> tokens = split(definition,':');
+                if (tokens.size()!=3 or tokens[0].empty() or tokens[2].empty())
+                {
+                    throw std::runtime_error("invalid working point '"+definition+"', expected 'algorithm:working point:name'");
+                }
+                WorkingPoint workingPoint;
+                workingPoint.algorithm = std::find(algorithmNames.begin(),algorithmNames.end(),tokens[0])-algorithmNames.begin();
+                if (workingPoint.algorithm==algorithmNames.size())
+                {
+                    algorithmNames.push_back(tokens[0]);
+                    _algorithmKeys.push_back(UserRecordKey(tokens[0]));
+                }
+                char* end = nullptr;
+                workingPoint.value = strtod(tokens[1].c_str(),&end);
+                if (tokens[1].empty() or *end!=0)
+                {
+                    throw std::runtime_error("invalid working point value '"+tokens[1]+"' in '"+definition+"'");
+                }
+                workingPoint.name = tokens[2];
+                workingPoint.key = EventIndex::intern(workingPoint.name);
+                workingPoint.variationKey = EventIndex::intern(SystematicVariations::getVariationsName(workingPoint.name));
+                workingPoint.countKey = UserRecordKey("n"+workingPoint.name);
+                _workingPoints.push_back(workingPoint);
+            }
+        }
+        
+        Condition parseCondition(const std::string& expression) const
+        {
+            static const struct
+            {
+                const char* symbol;
+                Condition::Operator op;
+            } operators[] = {
+                {">=",Condition::GREATEREQUAL},{"<=",Condition::LESSEQUAL},{"==",Condition::EQUAL},
+                {">",Condition::GREATER},{"<",Condition::LESS}
+            };
+            for (const auto& entry: operators)
+            {
+                const size_t pos = expression.find(entry.symbol);
+                if (pos==std::string::npos)
+                {
+                    continue;
+                }
+                const std::string name = trim(expression.substr(0,pos));
+                const std::string count = trim(expression.substr(pos+strlen(entry.symbol)));
+                Condition condition;
+                condition.op = entry.op;
+                condition.workingPoint = _workingPoints.size();
+                for (unsigned int iworkingPoint = 0; iworkingPoint < _workingPoints.size(); ++iworkingPoint)
+                {
+                    if (_workingPoints[iworkingPoint].name==name)
+                    {
+                        condition.workingPoint = iworkingPoint;
+                    }
+                }
+                if (condition.workingPoint==_workingPoints.size())
+                {
+                    throw std::runtime_error("unknown working point '"+name+"' in category condition '"+expression+"'");
+                }
+                if (count.empty() or count.find_first_not_of("0123456789")!=std::string::npos)
+                {
+                    throw std::runtime_error("invalid number of jets in category condition '"+expression+"'");
+                }
+                condition.count = atoi(count.c_str());
+                return condition;
+            }
+            throw std::runtime_error("invalid category condition '"+expression+"'");
+        }
+        
+        pxl::Source* getCategorySource(const std::string& name)
+        {
+            std::map<std::string,pxl::Source*>::const_iterator it = _categorySources.find(name);
+            if (it!=_categorySources.end())
+            {
+                return it->second;
+            }
+            pxl::Source* source = addSource(name,name);
+            _categorySources[name] = source;
+            return source;
+        }
+        
+        //sources can only be added before the job starts
         void initialize() throw (std::runtime_error)
         {
+            getOption("working points",_workingPointDefinitions);
+            getOption("categories",_categoryDefinitions);
+            _initializedWorkingPoints = _workingPointDefinitions;
+            _initializedCategories = _categoryDefinitions;
+            
+            _categories.clear();
+            _outputOtherCategorySource = nullptr;
+            if (_workingPointDefinitions.empty())
+            {
+                return;
+            }
+            try
+            {
+                parseWorkingPoints();
+                for (const std::string& definition: _categoryDefinitions)
+                {
+                    const size_t colon = definition.find(':');
+                    Category category;
+                    category.name = trim(definition.substr(0,colon));
+                    if (category.name.empty())
+                    {
+                        throw std::runtime_error("category '"+definition+"' has no source name");
+                    }
+                    if (colon!=std::string::npos)
+                    {
+                        for (const std::string& expression: split(definition.substr(colon+1),','))
+                        {
+                            if (!expression.empty())
+                            {
+                                category.conditions.push_back(parseCondition(expression));
+                            }
+                        }
+                    }
+                    category.source = getCategorySource(category.name);
+                    _cutFlow.addSource(category.source);
+                    _categories.push_back(category);
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            _outputOtherCategorySource = getCategorySource("other category");
+            _cutFlow.addSource(_outputOtherCategorySource);
+            for (WorkingPoint& workingPoint: _workingPoints)
+            {
+                workingPoint.counter = _cutFlow.getCounter(CutFlow::OBJECTS,"not "+workingPoint.name);
+            }
         }
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("event view",_inputEventViewName);
             getOption("input jet name",_inputJetName);
             getOption("name of selected b-jets",_bTaggedJetName);
@@ -96,86 +382,321 @@ class BTagSelection:
 
             getOption("maximum b-jet eta",_maxEtaBJet);
             getOption("working point",_bTaggingWorkingPoint);
+            
+            getOption("working points",_workingPointDefinitions);
+            getOption("categories",_categoryDefinitions);
+            if (_workingPointDefinitions!=_initializedWorkingPoints or _categoryDefinitions!=_initializedCategories)
+            {
+                throw std::runtime_error(getName()+": 'working points' or 'categories' were changed after initialize, which creates the category sources; set them before the module is initialized");
+            }
+            
+            _inputJetKey = EventIndex::intern(_inputJetName);
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _bTaggedJetKey = EventIndex::intern(_bTaggedJetName);
+            _inputVariationJetKey = EventIndex::intern(SystematicVariations::getVariationsName(_inputJetName));
+            _bTaggedVariationJetKey = EventIndex::intern(SystematicVariations::getVariationsName(_bTaggedJetName));
+            _bTaggingAlgorithmKey = UserRecordKey(_bTaggingAlgorithmName);
+            
+            _discriminators.assign(_algorithmKeys.size(),0.0);
+            _counts.assign(_workingPoints.size(),0);
+            
+            getOption("accepted outputs",_acceptedOutputs);
+            std::vector<std::pair<std::string,pxl::Source*>> outputs;
+            if (_workingPoints.empty())
+            {
+                outputs = {{"0 b-Tags",_output0BTagsSource},{"1 b-Tags",_output1BTagsSource},{"2 b-Tags",_output2BTagsSource},{">2 b-Tags",_outputOtherBTagsSource}};
+            }
+            else
+            {
+                for (const Category& category: _categories)
+                {
+                    outputs.push_back(std::make_pair(category.name,category.source));
+                }
+                outputs.push_back(std::make_pair(std::string("other category"),_outputOtherCategorySource));
+            }
+            try
+            {
+                _routing.setAccepted(_acceptedOutputs,outputs);
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
-        bool isBtagged(pxl::Particle* particle)
+        //jets selected only in variations are not counted in the cut flow
+        bool isBtagged(pxl::Particle* particle, bool count=true)
         {
             if (not (fabs(particle->getEta())<_maxEtaBJet))
             {
-                return false;
+                return count and _cutFlow.reject(_etaCounter);
             }
-            if (not (particle->getUserRecord(_bTaggingAlgorithmName).toFloat()>_bTaggingWorkingPoint))
+            if (not (_bTaggingAlgorithmKey.get(particle).toFloat()>_bTaggingWorkingPoint))
             {
-                return false;
+                return count and _cutFlow.reject(_discriminatorCounter);
             }
 
             return true;
         }
 
+        //returns one bit per passed working point
+        uint32_t getWorkingPointMask(pxl::Particle* particle, bool count=true)
+        {
+            if (not (fabs(particle->getEta())<_maxEtaBJet))
+            {
+                if (count)
+                {
+                    _cutFlow.count(_etaCounter);
+                }
+                return 0;
+            }
+            for (unsigned int ialgorithm = 0; ialgorithm < _algorithmKeys.size(); ++ialgorithm)
+            {
+                _discriminators[ialgorithm] = _algorithmKeys[ialgorithm].get(particle).toDouble();
+            }
+            uint32_t mask = 0;
+            for (unsigned int iworkingPoint = 0; iworkingPoint < _workingPoints.size(); ++iworkingPoint)
+            {
+                const WorkingPoint& workingPoint = _workingPoints[iworkingPoint];
+                if (_discriminators[workingPoint.algorithm]>workingPoint.value)
+                {
+                    mask |= uint32_t(1)<<iworkingPoint;
+                }
+                else if (count)
+                {
+                    _cutFlow.count(workingPoint.counter);
+                }
+            }
+            return mask;
+        }
+        
+        static bool passes(const Condition& condition, const unsigned int* counts)
+        {
+            const unsigned int count = counts[condition.workingPoint];
+            switch (condition.op)
+            {
+                case Condition::EQUAL:
+                    return count==condition.count;
+                case Condition::LESS:
+                    return count<condition.count;
+                case Condition::LESSEQUAL:
+                    return count<=condition.count;
+                case Condition::GREATER:
+                    return count>condition.count;
+                default:
+                    return count>=condition.count;
+            }
+        }
+        
+        //first category matching the numbers of jets per working point
+        pxl::Source* getCategory(const unsigned int* counts) const
+        {
+            for (const Category& category: _categories)
+            {
+                bool matches = true;
+                for (const Condition& condition: category.conditions)
+                {
+                    if (not passes(condition,counts))
+                    {
+                        matches = false;
+                        break;
+                    }
+                }
+                if (matches)
+                {
+                    return category.source;
+                }
+            }
+            return _outputOtherCategorySource;
+        }
+        
+        //adds the passed working points of the jet to the counts of the variations in which it is selected
+        void countWorkingPoints(const pxl::Particle* jet, uint32_t mask, bool nominal, unsigned int nVariations)
+        {
+            const unsigned int nWorkingPoints = _workingPoints.size();
+            for (unsigned int iworkingPoint = 0; iworkingPoint < nWorkingPoints; ++iworkingPoint)
+            {
+                if (not (mask & (uint32_t(1)<<iworkingPoint)))
+                {
+                    continue;
+                }
+                if (nominal)
+                {
+                    ++_counts[iworkingPoint];
+                }
+                for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+                {
+                    if (SystematicVariations::isSelected(jet,ivariation))
+                    {
+                        ++_counts[(ivariation+1)*nWorkingPoints+iworkingPoint];
+                    }
+                }
+            }
+        }
+        
+        bool analyseWorkingPoints(pxl::Event* event, unsigned int nVariations)
+        {
+            EventIndex& index = EventIndex::get(event);
+            const unsigned int nWorkingPoints = _workingPoints.size();
+            
+            _counts.assign(nWorkingPoints*(nVariations+1),0);
+            pxl::EventView* inputEventView = nullptr;
+            
+            for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
+            {
+                pxl::EventView* eventView = index.getEventView(ieventView);
+                if (index.getEventViewName(ieventView)==_inputEventViewKey)
+                {
+                    inputEventView=eventView;
+                    //copy since renaming changes the indexed particles
+                    const std::vector<pxl::Particle*>& jets = index.getParticles(eventView,_inputJetKey);
+                    _jets.assign(jets.begin(),jets.end());
+                    const std::vector<pxl::Particle*>& variationJets = index.getParticles(eventView,_inputVariationJetKey);
+                    _variationJets.assign(variationJets.begin(),variationJets.end());
+                    for (const std::vector<pxl::Particle*>* selectedJets: {&_jets,&_variationJets})
+                    {
+                        const bool nominal = selectedJets==&_jets;
+                        for (pxl::Particle* particle: *selectedJets)
+                        {
+                            const uint32_t mask = getWorkingPointMask(particle,nominal);
+                            _bTagCategoryKey.set(particle,mask);
+                            countWorkingPoints(particle,mask,nominal,nVariations);
+                            if (mask)
+                            {
+                                //lowest bit is the first (tightest) passed working point
+                                const WorkingPoint& workingPoint = _workingPoints[__builtin_ctz(mask)];
+                                index.setName(eventView,particle,nominal ? workingPoint.key : workingPoint.variationKey);
+                            }
+                        }
+                    }
+                }
+            }
+            if (not inputEventView)
+            {
+                return _cutFlow.send(_outputOtherCategorySource,event);
+            }
+            _outputs.clear();
+            for (unsigned int icounts = 0; icounts < nVariations+1; ++icounts)
+            {
+                const unsigned int* counts = &_counts[icounts*nWorkingPoints];
+                const std::string& suffix = icounts==0 ? "" : _suffixes[icounts-1];
+                for (unsigned int iworkingPoint = 0; iworkingPoint < nWorkingPoints; ++iworkingPoint)
+                {
+                    inputEventView->setUserRecord(_workingPoints[iworkingPoint].countKey.getName()+suffix,counts[iworkingPoint]);
+                }
+                _outputs.push_back(getCategory(counts));
+            }
+            return _cutFlow.send(_routing.route(event,_outputs),event);
+        }
+        
+        pxl::Source* getOutput(unsigned int nBJets) const
+        {
+            switch (nBJets)
+            {
+                case 0:
+                    return _output0BTagsSource;
+                case 1:
+                    return _output1BTagsSource;
+                case 2:
+                    return _output2BTagsSource;
+                default:
+                    return _outputOtherBTagsSource;
+            }
+        }
+
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    const unsigned int nVariations = SystematicVariations::getNVariations();
+                    while (_suffixes.size()<nVariations)
+                    {
+                        _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+                    }
+                    if (not _workingPoints.empty())
+                    {
+                        return analyseWorkingPoints(event,nVariations);
+                    }
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> selectedBJets;
+                    std::vector<pxl::Particle*> variationBJets;
                     
                     pxl::EventView* inputEventView = nullptr;
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
 
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
                             inputEventView=eventView;
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            //copy since renaming changes the indexed particles
+                            const std::vector<pxl::Particle*> jets = index.getParticles(eventView,_inputJetKey);
 
-                            for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
+                            for (unsigned iparticle=0; iparticle<jets.size();++iparticle)
                             {
-                                pxl::Particle* particle = particles[iparticle];
+                                pxl::Particle* particle = jets[iparticle];
 
-                                if (particle->getName()==_inputJetName)
+                                if (isBtagged(particle))
                                 {
-                                    if (isBtagged(particle))
-                                    {
-                                        particle->setName(_bTaggedJetName);
-                                        selectedBJets.push_back(particle);
-                                    }
+                                    index.setName(eventView,particle,_bTaggedJetKey);
+                                    selectedBJets.push_back(particle);
+                                }
+                            }
+                            
+                            const std::vector<pxl::Particle*> variationJets = index.getParticles(eventView,_inputVariationJetKey);
+                            for (pxl::Particle* particle: variationJets)
+                            {
+                                if (isBtagged(particle,false))
+                                {
+                                    index.setName(eventView,particle,_bTaggedVariationJetKey);
+                                    variationBJets.push_back(particle);
                                 }
                             }
                         }
                     }
-                    if (inputEventView)
+                    if (not inputEventView)
                     {
-                        inputEventView->setUserRecord("n"+_bTaggedJetName,selectedBJets.size());
+                        return _cutFlow.send(_outputOtherBTagsSource,event);
                     }
-                    else
+                    inputEventView->setUserRecord("n"+_bTaggedJetName,selectedBJets.size());
+                    
+                    //the b-tag does not depend on the variation but the selection of the jets does
+                    _nBJets.assign(nVariations+1,0);
+                    _nBJets[0] = selectedBJets.size();
+                    for (const std::vector<pxl::Particle*>* bjets: {&selectedBJets,&variationBJets})
                     {
-                        _outputOtherBTagsSource->setTargets(event);
-                        return _outputOtherBTagsSource->processTargets();
+                        for (const pxl::Particle* bjet: *bjets)
+                        {
+                            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+                            {
+                                if (SystematicVariations::isSelected(bjet,ivariation))
+                                {
+                                    ++_nBJets[ivariation+1];
+                                }
+                            }
+                        }
                     }
-                    
-                    switch (selectedBJets.size())
+                    _outputs.clear();
+                    for (unsigned int icount = 0; icount < _nBJets.size(); ++icount)
                     {
-                        case 0:
-                            _output0BTagsSource->setTargets(event);
-                            return _output0BTagsSource->processTargets();
-                        case 1:
-                            _output1BTagsSource->setTargets(event);
-                            return _output1BTagsSource->processTargets();
-                        case 2:
-                            _output2BTagsSource->setTargets(event);
-                            return _output2BTagsSource->processTargets();
-                        default:
-                            _outputOtherBTagsSource->setTargets(event);
-                            return _outputOtherBTagsSource->processTargets();
+                        if (icount>0)
+                        {
+                            inputEventView->setUserRecord("n"+_bTaggedJetName+_suffixes[icount-1],_nBJets[icount]);
+                        }
+                        _outputs.push_back(getOutput(_nBJets[icount]));
                     }
+                    return _cutFlow.send(_routing.route(event,_outputs),event);
                 }
             }
             catch(std::exception &e)
@@ -191,6 +712,12 @@ class BTagSelection:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -0,0 +1,580 @@
+#ifndef __CUTPROGRAM_H__
+#define __CUTPROGRAM_H__
+
+#include "pxl/core.hh"
+#include "pxl/hep.hh"
+
+#include "utils/CutFlow.hpp"
+#include "utils/UserRecordKey.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* List of cuts on a particle compiled from expressions like
+*
+*   pt>30
+*   abs(eta)<2.4
+*   UR:isTightMuon
+*   UR:muonEnergyFraction<0.8 if present
+*   UR:chargedMultiplicity>0 required if abs(eta)<2.4
+*   UR:chargedHadronEnergyFraction>0 if present and abs(eta)<2.4
+*
+* Variables are pt, eta, phi, e, p, mass, px, py, pz or a user record
+* 'UR:<name>' which is read with toFloat(). A user record without operator is
+* a boolean cut. A cut with 'if present' passes if the user record does not
+* exist, otherwise a missing user record fails the cut. A cut marked
+* 'required' throws std::runtime_error if the user record is missing (like
+* getUserRecord) instead of failing. A cut with
+* 'if <condition>' is only applied if the condition holds; several conditions
+* are combined with 'and'.
+*
+* All cuts have to pass; the evaluation stops at the first failing cut. With
+* setAdaptive(n) all cuts are evaluated and timed for the first n particles,
+* afterwards they are sorted by cost/rejection rate which minimizes the
+* expected time per particle. The result does not depend on the order: a
+* 'required' cut throws only if all cuts given before it pass, as in the given
+* order. If it finds the user record missing, the cuts before it are evaluated
+* in the given order and the particle is rejected by the first failing one.
+*/
+class CutProgram
+{
+    public:
+        enum Variable
+        {
+            PT,ETA,PHI,E,P,MASS,PX,PY,PZ,USERRECORD
+        };
+
+        enum Operator
+        {
+            LT,LE,GT,GE,EQ,NE,ISTRUE
+        };
+
+        struct Term
+        {
+            Variable variable;
+            bool absolute;
+            Operator op;
+            double value;
+            UserRecordKey userRecord;
+            //a missing user record is an error instead of failing (see Cut::passes)
+            bool required;
+
+            //present is false if the user record does not exist
+            inline bool evaluate(const pxl::Particle* particle, bool& present) const
+            {
+                double x = 0;
+                present = true;
+                switch (variable)
+                {
+                    case PT:
+                        x = particle->getPt();
+                        break;
+                    case ETA:
+                        x = particle->getEta();
+                        break;
+                    case PHI:
+                        x = particle->getPhi();
+                        break;
+                    case E:
+                        x = particle->getE();
+                        break;
+                    case P:
+                        x = particle->getP();
+                        break;
+                    case MASS:
+                        x = particle->getMass();
+                        break;
+                    case PX:
+                        x = particle->getPx();
+                        break;
+                    case PY:
+                        x = particle->getPy();
+                        break;
+                    case PZ:
+                        x = particle->getPz();
+                        break;
+                    case USERRECORD:
+                    {
+                        const pxl::Variant* record = userRecord.find(particle);
+                        if (!record)
+                        {
+                            present = false;
+                            return false;
+                        }
+                        if (op==ISTRUE)
+                        {
+                            return static_cast<bool>(*record);
+                        }
+                        x = record->toFloat();
+                        break;
+                    }
+                }
+                if (absolute)
+                {
+                    x = std::fabs(x);
+                }
+                switch (op)
+                {
+                    case LT:
+                        return x<value;
+                    case LE:
+                        return x<=value;
+                    case GT:
+                        return x>value;
+                    case GE:
+                        return x>=value;
+                    case EQ:
+                        return x==value;
+                    case NE:
+                        return x!=value;
+                    case ISTRUE:
+                        return x!=0;
+                }
+                return false;
+            }
+        };
+
+        struct Cut
+        {
+            std::string expression;
+            //position in the list of expressions
+            unsigned int position;
+            Term term;
+            bool ifPresent;
+            std::vector<Term> conditions;
+
+            unsigned long evaluated;
+            unsigned long rejected;
+            //measured during the warm-up of the adaptive mode
+            unsigned long timed;
+            double time;
+            
+            CutFlow::Counter counter;
+
+            //missing is set if the user record of a 'required' cut does not exist; the cut fails then
+            inline bool passes(const pxl::Particle* particle, bool& missing) const
+            {
+                missing = false;
+                bool present = true;
+                for (const Term& condition: conditions)
+                {
+                    if (not (condition.evaluate(particle,present) and present))
+                    {
+                        return true;
+                    }
+                }
+                const bool result = term.evaluate(particle,present);
+                if (!present)
+                {
+                    missing = term.required;
+                    return ifPresent;
+                }
+                return result;
+            }
+
+            inline double getRejectionRate() const
+            {
+                return evaluated>0 ? double(rejected)/evaluated : 0.0;
+            }
+
+            //average time in ns per evaluation
+            inline double getCost() const
+            {
+                return timed>0 ? time/timed : 0.0;
+            }
+        };
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        std::vector<Cut> _cuts;
+        //indices of the cuts in the given order
+        std::vector<unsigned int> _positions;
+        unsigned long _nParticles;
+        unsigned long _nPassed;
+        unsigned long _warmUp;
+        double _clockOverhead;
+        CutFlow* _cutFlow;
+
+        static std::string trim(const std::string& s)
+        {
+            const std::string::size_type begin = s.find_first_not_of(" \t");
+            if (begin==std::string::npos)
+            {
+                return "";
+            }
+            const std::string::size_type end = s.find_last_not_of(" \t");
+            return s.substr(begin,end-begin+1);
+        }
+
+        static Term parseTerm(const std::string& expression)
+        {
+            Term term;
+            term.absolute = false;
+            term.op = ISTRUE;
+            term.value = 0;
+            term.required = false;
+
+            //split into variable, operator and value
+            const std::string::size_type opPos = expression.find_first_of("<>=!");
+            std::string variable = trim(expression.substr(0,opPos));
+            if (variable.size()>5 and variable.substr(0,4)=="abs(" and variable[variable.size()-1]==')')
+            {
+                term.absolute = true;
+                variable = trim(variable.substr(4,variable.size()-5));
+            }
+
+            if (variable.size()>3 and variable.substr(0,3)=="UR:")
+            {
+                term.variable = USERRECORD;
+                term.userRecord = UserRecordKey(trim(variable.substr(3)));
+            }
+            else
+            {
+                static const std::vector<std::pair<std::string,Variable>> variables = {
+                    {"pt",PT},{"eta",ETA},{"phi",PHI},{"e",E},{"p",P},{"mass",MASS},{"px",PX},{"py",PY},{"pz",PZ}
+                };
+                bool found = false;
+                for (const std::pair<std::string,Variable>& v: variables)
+                {
+                    if (v.first==variable)
+                    {
+                        term.variable = v.second;
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    throw std::runtime_error("unknown variable '"+variable+"' in cut '"+expression+"'");
+                }
+            }
+
+            if (opPos==std::string::npos)
+            {
+                if (term.variable!=USERRECORD or term.absolute)
+                {
+                    throw std::runtime_error("missing comparison in cut '"+expression+"'");
+                }
+                return term;
+            }
+
+            static const std::vector<std::pair<std::string,Operator>> operators = {
+                {"<=",LE},{">=",GE},{"==",EQ},{"!=",NE},{"<",LT},{">",GT}
+            };
+            std::string::size_type valuePos = std::string::npos;
+            for (const std::pair<std::string,Operator>& o: operators)
+            {
+                if (expression.compare(opPos,o.first.size(),o.first)==0)
+                {
+                    term.op = o.second;
+                    valuePos = opPos+o.first.size();
+                    break;
+                }
+            }
+            if (valuePos==std::string::npos)
+            {
+                throw std::runtime_error("unknown operator in cut '"+expression+"'");
+            }
+
+            const std::string value = trim(expression.substr(valuePos));
+            char* end = nullptr;
+            term.value = std::strtod(value.c_str(),&end);
+            if (value.empty() or *end!='\0')
+            {
+                throw std::runtime_error("invalid value '"+value+"' in cut '"+expression+"'");
+            }
+            return term;
+        }
+
+        static Cut parseCut(const std::string& expression)
+        {
+            Cut cut;
+            cut.expression = trim(expression);
+            cut.position = 0;
+            cut.ifPresent = false;
+            cut.evaluated = 0;
+            cut.rejected = 0;
+            cut.timed = 0;
+            cut.time = 0;
+            cut.counter = 0;
+
+            std::string body = cut.expression;
+            const std::string::size_type ifPos = body.find(" if ");
+            if (ifPos!=std::string::npos)
+            {
+                std::string conditions = body.substr(ifPos+4);
+                body = body.substr(0,ifPos);
+                while (!conditions.empty())
+                {
+                    const std::string::size_type andPos = conditions.find(" and ");
+                    const std::string condition = trim(conditions.substr(0,andPos));
+                    conditions = andPos==std::string::npos ? "" : conditions.substr(andPos+5);
+                    if (condition=="present")
+                    {
+                        cut.ifPresent = true;
+                    }
+                    else
+                    {
+                        cut.conditions.push_back(parseTerm(condition));
+                    }
+                }
+            }
+            body = trim(body);
+            bool required = false;
+            if (body.size()>9 and body.substr(body.size()-9)==" required")
+            {
+                required = true;
+                body = body.substr(0,body.size()-9);
+            }
+            cut.term = parseTerm(body);
+            cut.term.required = required;
+            if (required and (cut.term.variable!=USERRECORD or cut.ifPresent))
+            {
+                throw std::runtime_error("'required' needs a user record without 'if present' in cut '"+expression+"'");
+            }
+            if (cut.ifPresent and cut.term.variable!=USERRECORD)
+            {
+                throw std::runtime_error("'if present' requires a user record in cut '"+expression+"'");
+            }
+            return cut;
+        }
+
+        //expected time per particle is minimal if cuts are sorted by cost/rejection rate
+        static inline double getOrderingKey(const Cut& cut)
+        {
+            const double rejectionRate = cut.getRejectionRate();
+            if (rejectionRate<=0)
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            return std::max(cut.getCost(),1e-3)/rejectionRate;
+        }
+
+        void reorder()
+        {
+            std::stable_sort(_cuts.begin(),_cuts.end(),[](const Cut& c1, const Cut& c2)
+            {
+                return getOrderingKey(c1)<getOrderingKey(c2);
+            });
+            for (unsigned int icut = 0; icut < _cuts.size(); ++icut)
+            {
+                _positions[_cuts[icut].position] = icut;
+            }
+        }
+
+        /*
+        * The user record of a 'required' cut is missing: throws if all cuts
+        * given before it pass, otherwise returns the first failing one which
+        * rejects the particle.
+        */
+        const Cut& resolveMissing(const Cut& required, const pxl::Particle* particle) const
+        {
+            for (unsigned int position = 0; position < required.position; ++position)
+            {
+                const Cut& cut = _cuts[_positions[position]];
+                bool missing = false;
+                if (!cut.passes(particle,missing))
+                {
+                    if (missing)
+                    {
+                        break;
+                    }
+                    return cut;
+                }
+            }
+            throw std::runtime_error("user record '"+required.term.userRecord.getName()+"' not found");
+        }
+
+        static double measureClockOverhead()
+        {
+            const unsigned int n = 1000;
+            const Clock::time_point start = Clock::now();
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                Clock::now();
+            }
+            return std::chrono::duration<double,std::nano>(Clock::now()-start).count()/n;
+        }
+
+        //evaluates and times all cuts to get unbiased rejection rates
+        bool passesWarmUp(const pxl::Particle* particle)
+        {
+            bool result = true;
+            const Cut* firstRejecting = nullptr;
+            for (Cut& cut: _cuts)
+            {
+                bool missing = false;
+                const Clock::time_point start = Clock::now();
+                const bool passed = cut.passes(particle,missing);
+                const double time = std::chrono::duration<double,std::nano>(Clock::now()-start).count();
+                cut.time += std::max(time-_clockOverhead,0.0);
+                ++cut.timed;
+                ++cut.evaluated;
+                if (!passed)
+                {
+                    ++cut.rejected;
+                    result = false;
+                    if (!firstRejecting)
+                    {
+                        firstRejecting = missing ? &resolveMissing(cut,particle) : &cut;
+                    }
+                }
+            }
+            if (firstRejecting and _cutFlow)
+            {
+                _cutFlow->count(firstRejecting->counter);
+            }
+            return result;
+        }
+
+    public:
+        CutProgram():
+            _nParticles(0),
+            _nPassed(0),
+            _warmUp(0),
+            _clockOverhead(0),
+            _cutFlow(nullptr)
+        {
+        }
+
+        //throws std::runtime_error on invalid expressions
+        void compile(const std::vector<std::string>& expressions)
+        {
+            _cuts.clear();
+            _positions.clear();
+            _nParticles = 0;
+            _nPassed = 0;
+            for (const std::string& expression: expressions)
+            {
+                if (!trim(expression).empty())
+                {
+                    add(expression);
+                }
+            }
+        }
+
+        //formats a cut value such that it is parsed back without loss of precision
+        static std::string number(double value)
+        {
+            std::ostringstream ss;
+            ss.precision(17);
+            ss<<value;
+            return ss.str();
+        }
+
+        //throws std::runtime_error on invalid expressions
+        void add(const std::string& expression)
+        {
+            _cuts.push_back(parseCut(expression));
+            _cuts.back().position = _cuts.size()-1;
+            _positions.push_back(_cuts.size()-1);
+            if (_cutFlow)
+            {
+                _cuts.back().counter = _cutFlow->addCounter(CutFlow::OBJECTS,_cuts.back().expression);
+            }
+        }
+
+        //counts the objects rejected by each cut (the first failing one in the order of evaluation); has to be set before compiling
+        inline void setCutFlow(CutFlow* cutFlow)
+        {
+            _cutFlow = cutFlow;
+        }
+
+        //0 keeps the given order
+        void setAdaptive(unsigned long warmUp)
+        {
+            _warmUp = warmUp;
+            if (_warmUp>0)
+            {
+                _clockOverhead = measureClockOverhead();
+            }
+        }
+
+        bool passes(const pxl::Particle* particle)
+        {
+            ++_nParticles;
+            bool result = true;
+            if (_nParticles<=_warmUp)
+            {
+                result = passesWarmUp(particle);
+                if (_nParticles==_warmUp)
+                {
+                    reorder();
+                }
+            }
+            else
+            {
+                for (Cut& cut: _cuts)
+                {
+                    ++cut.evaluated;
+                    bool missing = false;
+                    if (!cut.passes(particle,missing))
+                    {
+                        ++cut.rejected;
+                        const Cut& rejecting = missing ? resolveMissing(cut,particle) : cut;
+                        if (_cutFlow)
+                        {
+                            _cutFlow->count(rejecting.counter);
+                        }
+                        result = false;
+                        break;
+                    }
+                }
+            }
+            if (result)
+            {
+                ++_nPassed;
+            }
+            return result;
+        }
+
+        inline unsigned long getNParticles() const
+        {
+            return _nParticles;
+        }
+
+        inline unsigned long getNPassed() const
+        {
+            return _nPassed;
+        }
+
+        //one line per cut in the order of evaluation
+        std::string getCutFlowTable() const
+        {
+            std::string table;
+            char line[512];
+            snprintf(line,sizeof(line),"%3s %3s %-50s %12s %12s %8s %10s\n","#","def","cut","evaluated","rejected","rate","cost [ns]");
+            table += line;
+            for (unsigned int icut = 0; icut < _cuts.size(); ++icut)
+            {
+                const Cut& cut = _cuts[icut];
+                snprintf(line,sizeof(line),"%3u %3u %-50s %12lu %12lu %8.4f %10.1f\n",icut,cut.position,cut.expression.c_str(),cut.evaluated,cut.rejected,cut.getRejectionRate(),cut.getCost());
+                table += line;
+            }
+            snprintf(line,sizeof(line),"particles: %lu, passed: %lu\n",_nParticles,_nPassed);
+            table += line;
+            return table;
+        }
+
+        inline unsigned int size() const
+        {
+            return _cuts.size();
+        }
+
+        inline const Cut& getCut(unsigned int icut) const
+        {
+            return _cuts[icut];
+        }
+};
+
+#endif
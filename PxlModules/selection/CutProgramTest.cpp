@@ -0,0 +1,99 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "CutProgram.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+/*
+* Checks of CutProgram without an analysis: a 'required' user record has to
+* throw only if the cuts given before it pass, also when the adaptive order
+* has moved the cut to the front. The jets mimic JetSelection; a negative
+* number of constituents leaves out the user record.
+*
+* usage: CutProgramTest; returns non-zero if a check fails
+*/
+
+static unsigned int nFailed = 0;
+
+static void check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        fprintf(stderr,"FAILED: %s\n",description.c_str());
+        ++nFailed;
+    }
+}
+
+static void makeJet(pxl::Particle& jet, double pt, double eta, int nConstituents)
+{
+    const double pz = pt*std::sinh(eta);
+    jet.setP4(pt,0,pz,std::sqrt(pt*pt+pz*pz));
+    if (nConstituents>=0)
+    {
+        jet.setUserRecord("nConstituents",nConstituents);
+    }
+}
+
+//0: rejected, 1: passed, -1: threw
+static int evaluate(CutProgram& cuts, double pt, double eta, int nConstituents)
+{
+    pxl::Particle jet;
+    makeJet(jet,pt,eta,nConstituents);
+    try
+    {
+        return cuts.passes(&jet) ? 1 : 0;
+    }
+    catch(std::runtime_error&)
+    {
+        return -1;
+    }
+}
+
+static void compileJetCuts(CutProgram& cuts)
+{
+    cuts.compile({
+        "pt>40",
+        "abs(eta)<4.7",
+        "UR:nConstituents>1 required"
+    });
+}
+
+int main()
+{
+    {
+        CutProgram cuts;
+        compileJetCuts(cuts);
+        check(evaluate(cuts,10,0.5,-1)==0,"given order: low pT jet without constituents is rejected");
+        check(evaluate(cuts,60,5.0,-1)==0,"given order: forward jet without constituents is rejected");
+        check(evaluate(cuts,60,0.5,-1)==-1,"given order: selected jet without constituents throws");
+        check(evaluate(cuts,60,0.5,5)==1,"given order: jet with constituents passes");
+    }
+    {
+        CutProgram cuts;
+        compileJetCuts(cuts);
+        const unsigned int warmUp = 20;
+        cuts.setAdaptive(warmUp);
+        check(evaluate(cuts,10,0.5,-1)==0,"warm-up: low pT jet without constituents is rejected");
+        //only the constituent cut rejects, so it is evaluated first afterwards
+        for (unsigned int ijet = 1; ijet < warmUp; ++ijet)
+        {
+            evaluate(cuts,60,0.5,1);
+        }
+        check(cuts.getCut(0).position==2,"adaptive: the constituent cut is moved to the front");
+        check(evaluate(cuts,10,0.5,-1)==0,"adaptive: low pT jet without constituents is rejected");
+        check(evaluate(cuts,60,5.0,-1)==0,"adaptive: forward jet without constituents is rejected");
+        check(evaluate(cuts,60,0.5,-1)==-1,"adaptive: selected jet without constituents throws");
+        check(evaluate(cuts,60,0.5,5)==1,"adaptive: jet with constituents passes");
+    }
+    if (nFailed>0)
+    {
+        fprintf(stderr,"%u checks failed\n",nFailed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef __DELTARCLEANING_H__
+#define __DELTARCLEANING_H__
+
+#include "pxl/core.hh"
+#include "pxl/hep.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+/*
+* Finds the minimum dR between a particle and a set of objects. The objects are
+* sorted by eta so that the search can start at the closest eta and stop once
+* the eta difference alone is larger than the best dR found so far. The
+* distance is calculated squared in the same way as pxl::Basic3Vector::deltaR,
+* so sqrt(minDeltaR2(...)) is identical to the minimum of deltaR over all
+* objects.
+*/
+class DeltaRCleaning
+{
+    private:
+        struct Object
+        {
+            double eta;
+            double phi;
+
+            bool operator<(const Object& object) const
+            {
+                return eta<object.eta;
+            }
+        };
+
+        std::vector<Object> _objects;
+
+    public:
+        //phi difference in [-pi,pi] as in pxl::Basic3Vector::deltaPhi
+        static inline double deltaPhi(double phi1, double phi2)
+        {
+            double dphi = phi1-phi2;
+            while (dphi>M_PI)
+            {
+                dphi-=2.*M_PI;
+            }
+            while (dphi<-M_PI)
+            {
+                dphi+=2.*M_PI;
+            }
+            return dphi;
+        }
+
+        void clear()
+        {
+            _objects.clear();
+        }
+
+        //objects have to be sorted by calling sort before searching
+        inline void addObject(double eta, double phi)
+        {
+            Object object = {eta,phi};
+            _objects.push_back(object);
+        }
+
+        void sort()
+        {
+            std::sort(_objects.begin(),_objects.end());
+        }
+
+        void setObjects(const std::vector<pxl::Particle*>& particles)
+        {
+            _objects.clear();
+            for (const pxl::Particle* particle: particles)
+            {
+                addObject(particle->getVector().getEta(),particle->getVector().getPhi());
+            }
+            sort();
+        }
+
+        inline unsigned int size() const
+        {
+            return _objects.size();
+        }
+
+        //returns infinity if there are no objects
+        double minDeltaR2(double eta, double phi) const
+        {
+            double best = std::numeric_limits<double>::infinity();
+            Object probe = {eta,0};
+            const unsigned int start = std::lower_bound(_objects.begin(),_objects.end(),probe)-_objects.begin();
+
+            //upwards in eta
+            for (unsigned int iobject = start; iobject < _objects.size(); ++iobject)
+            {
+                const double deta = eta-_objects[iobject].eta;
+                const double deta2 = deta*deta;
+                if (deta2>=best)
+                {
+                    break;
+                }
+                const double dphi = deltaPhi(phi,_objects[iobject].phi);
+                best = std::min(best,deta2+dphi*dphi);
+            }
+            //downwards in eta
+            for (unsigned int iobject = start; iobject > 0; --iobject)
+            {
+                const double deta = eta-_objects[iobject-1].eta;
+                const double deta2 = deta*deta;
+                if (deta2>=best)
+                {
+                    break;
+                }
+                const double dphi = deltaPhi(phi,_objects[iobject-1].phi);
+                best = std::min(best,deta2+dphi*dphi);
+            }
+            return best;
+        }
+
+        double minDeltaR2(const pxl::Particle* particle) const
+        {
+            return minDeltaR2(particle->getVector().getEta(),particle->getVector().getPhi());
+        }
+};
+
+#endif
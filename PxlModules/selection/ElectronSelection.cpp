@@ -5,6 +5,11 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
 static pxl::Logger logger("ElectronSelection");
 
 class ElectronSelection:
@@ -23,6 +28,23 @@ class ElectronSelection:
         double _pTMinTightElectron;  //Minimum transverse momentum
         double _etaMaxTightElectron; //Maximum pseudorapidity
 
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _inputTightElectronKey;
+        EventIndex::Key _tightElectronKey;
+        
+        UserRecordKey _phys14eleIDTightKey;
+        UserRecordKey _passConversionVetoKey;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+        CutFlow::Counter _ptCounter;
+        CutFlow::Counter _etaCounter;
+        CutFlow::Counter _idCounter;
+        CutFlow::Counter _gapCounter;
+        CutFlow::Counter _conversionCounter;
+
+        ModuleTimer _timer;
+
     public:
         ElectronSelection():
             Module(),
@@ -37,6 +59,13 @@ class ElectronSelection:
             _outputIsoSource = addSource("1 iso electron", "iso");
             //_outputAntiIsoSource = addSource("1 anti-iso electron", "anti-iso");
             _outputOtherSource = addSource("other", "other");
+            _cutFlow.addSource(_outputIsoSource);
+            _cutFlow.addSource(_outputOtherSource);
+            _ptCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"pt");
+            _etaCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"abs(eta)");
+            _idCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"phys14eleIDTight");
+            _gapCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"barrel-endcap gap");
+            _conversionCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"passConversionVeto");
 
             addOption("Event view","name of the event view where electrons are selected",_inputEventViewName);
             addOption("Input electron name","name of particles to consider for selection",_inputTightElectronName);
@@ -44,6 +73,8 @@ class ElectronSelection:
 
             addOption("TightElectron Minimum pT","",_pTMinTightElectron);
             addOption("TightElectron Maximum eta","",_etaMaxTightElectron);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~ElectronSelection()
@@ -75,84 +106,91 @@ class ElectronSelection:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("Event view",_inputEventViewName);
             getOption("Input electron name",_inputTightElectronName);
             getOption("Name of selected tight electrons",_tightElectronName);
 
             getOption("TightElectron Minimum pT",_pTMinTightElectron);
             getOption("TightElectron Maximum eta",_etaMaxTightElectron);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _inputTightElectronKey = EventIndex::intern(_inputTightElectronName);
+            _tightElectronKey = EventIndex::intern(_tightElectronName);
+            
+            _phys14eleIDTightKey = UserRecordKey("phys14eleIDTight");
+            _passConversionVetoKey = UserRecordKey("passConversionVeto");
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
         bool passTightCriteria(pxl::Particle* particle)
         {
             if (not (particle->getPt()>_pTMinTightElectron))
             {
-                return false;
+                return _cutFlow.reject(_ptCounter);
             }
             if (not (fabs(particle->getEta())<_etaMaxTightElectron))
             {
-                return false;
+                return _cutFlow.reject(_etaCounter);
             }
-            if (not particle->getUserRecord("phys14eleIDTight"))
+            if (not _phys14eleIDTightKey.get(particle))
             {
-                return false;
+                return _cutFlow.reject(_idCounter);
             }
             if (fabs(particle->getEta())>1.4442 && fabs(particle->getEta())<1.5660)
             {
-                return false;
+                return _cutFlow.reject(_gapCounter);
             }
-            if (not particle->getUserRecord("passConversionVeto"))
+            if (not _passConversionVetoKey.get(particle))
             {
-                return false;
+                return _cutFlow.reject(_conversionCounter);
             }
             return true;
         }
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> tightElectrons;
 
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            const std::vector<pxl::Particle*>& particles = index.getParticles(eventView,_inputTightElectronKey);
 
                             for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
                             {
                                 pxl::Particle* particle = particles[iparticle];
 
-                                if (particle->getName()==_inputTightElectronName)
+                                if (passTightCriteria(particle))
                                 {
-                                    if (passTightCriteria(particle))
-                                    {
-                                        tightElectrons.push_back(particle);
-                                    }
+                                    tightElectrons.push_back(particle);
                                 }
                             }
                         }
                     
                         if (tightElectrons.size()==1)
                         {
-                            tightElectrons.front()->setName(_tightElectronName);
+                            index.setName(eventView,tightElectrons.front(),_tightElectronKey);
 
-                            _outputIsoSource->setTargets(event);
-                            return _outputIsoSource->processTargets();
+                            return _cutFlow.send(_outputIsoSource,event);
                         }
                         else
                         {
-                            _outputOtherSource->setTargets(event);
-                            return _outputOtherSource->processTargets();
+                            return _cutFlow.send(_outputOtherSource,event);
                         }
                     }
                 }
@@ -170,6 +208,12 @@ class ElectronSelection:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -5,6 +5,11 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
 static pxl::Logger logger("ElectronVeto");
 
 class ElectronVeto:
@@ -24,7 +29,23 @@ class ElectronVeto:
         double _pTMinLooseElectron;  //Minimum transverse momentum
         double _etaMaxLooseElectron; //Maximum pseudorapidity
 
-      
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _inputElectronKey;
+        EventIndex::Key _looseElectronKey;
+        
+        UserRecordKey _phys14eleIDVetoKey;
+        UserRecordKey _passConversionVetoKey;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+        CutFlow::Counter _ptCounter;
+        CutFlow::Counter _etaCounter;
+        CutFlow::Counter _idCounter;
+        CutFlow::Counter _gapCounter;
+        CutFlow::Counter _conversionCounter;
+
+        ModuleTimer _timer;
+
     public:
         ElectronVeto():
             Module(),
@@ -41,6 +62,13 @@ class ElectronVeto:
             addSink("input", "input");
             _outputVetoSource = addSource("veto loose electrons", "veto");
             _outputOtherSource = addSource("other", "other");
+            _cutFlow.addSource(_outputVetoSource);
+            _cutFlow.addSource(_outputOtherSource);
+            _ptCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"pt");
+            _etaCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"abs(eta)");
+            _idCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"phys14eleIDVeto");
+            _gapCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"barrel-endcap gap");
+            _conversionCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"passConversionVeto");
 
             addOption("Event view","name of the event view where electrons are selected",_inputEventViewName);
             addOption("Input electron name","name of particles to consider for selection",_inputElectronName);
@@ -49,6 +77,8 @@ class ElectronVeto:
 
             addOption("LooseElectron Minimum pT","",_pTMinLooseElectron);
             addOption("LooseElectron Maximum eta","",_etaMaxLooseElectron);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~ElectronVeto()
@@ -80,6 +110,7 @@ class ElectronVeto:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("Event view",_inputEventViewName);
             getOption("Input electron name",_inputElectronName);
             getOption("Name of selected loose electrons",_looseElectronName);
@@ -88,30 +119,41 @@ class ElectronVeto:
             
             getOption("LooseElectron Minimum pT",_pTMinLooseElectron);
             getOption("LooseElectron Maximum eta",_etaMaxLooseElectron);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _inputElectronKey = EventIndex::intern(_inputElectronName);
+            _looseElectronKey = EventIndex::intern(_looseElectronName);
+            
+            _phys14eleIDVetoKey = UserRecordKey("phys14eleIDVeto");
+            _passConversionVetoKey = UserRecordKey("passConversionVeto");
 
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
         bool passesLooseCriteria(pxl::Particle* particle)
         {
             if (not (particle->getPt()>_pTMinLooseElectron))
             {
-                return false;
+                return _cutFlow.reject(_ptCounter);
             }
             if (not (fabs(particle->getEta())<_etaMaxLooseElectron))
             {
-                return false;
+                return _cutFlow.reject(_etaCounter);
             }
-            if (not particle->getUserRecord("phys14eleIDVeto"))
+            if (not _phys14eleIDVetoKey.get(particle))
             {
-                return false;
+                return _cutFlow.reject(_idCounter);
             }
             if (fabs(particle->getEta())>1.4442 && fabs(particle->getEta())<1.5660)
             {
-                return false;
+                return _cutFlow.reject(_gapCounter);
             }
-            if (not particle->getUserRecord("passConversionVeto"))
+            if (not _passConversionVetoKey.get(particle))
             {
-                return false;
+                return _cutFlow.reject(_conversionCounter);
             }
 
             return true;
@@ -119,39 +161,36 @@ class ElectronVeto:
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> looseElectrons;
                     std::vector<pxl::Particle*> otherElectrons;
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            const std::vector<pxl::Particle*>& particles = index.getParticles(eventView,_inputElectronKey);
 
                             for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
                             {
                                 pxl::Particle* particle = particles[iparticle];
 
-                                if (particle->getName()==_inputElectronName)
+                                if (passesLooseCriteria(particle))
+                                {
+                                    looseElectrons.push_back(particle);
+                                }
+                                else
                                 {
-                                    if (passesLooseCriteria(particle))
-                                    {
-                                        looseElectrons.push_back(particle);
-                                    }
-                                    else
-                                    {
-                                        otherElectrons.push_back(particle);
-                                    }
+                                    otherElectrons.push_back(particle);
                                 }
                             }
                         }
@@ -159,23 +198,21 @@ class ElectronVeto:
                         {
                             for (unsigned int iparticle = 0; iparticle < otherElectrons.size(); ++iparticle)
                             {
-                                eventView->removeObject(otherElectrons[iparticle]);
+                                index.removeObject(eventView,otherElectrons[iparticle]);
                             }
                         }
 
                         if (looseElectrons.size()==0)
                         {
-                            _outputVetoSource->setTargets(event);
-                            return _outputVetoSource->processTargets();
+                            return _cutFlow.send(_outputVetoSource,event);
                         }
                         else
                         {
                             for (unsigned int i=0; i < looseElectrons.size(); ++i)
                             {
-                                looseElectrons[i]->setName(_looseElectronName);
+                                index.setName(eventView,looseElectrons[i],_looseElectronKey);
                             }
-                            _outputOtherSource->setTargets(event);
-                            return _outputOtherSource->processTargets();
+                            return _cutFlow.send(_outputOtherSource,event);
                         }
                     }
                 }
@@ -193,6 +230,12 @@ class ElectronVeto:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
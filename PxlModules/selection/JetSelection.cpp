@@ -5,6 +5,19 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/SystematicVariations.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include "CutProgram.hpp"
+#include "DeltaRCleaning.hpp"
+#include "VariationRouting.hpp"
+
+#include <cstdint>
+#include <sstream>
+
 static pxl::Logger logger("JetSelection");
 
 class JetSelection:
@@ -30,6 +43,44 @@ class JetSelection:
         bool _dRInvert;
         double _dR;
         std::vector<std::string> _dRObjects;
+        
+        EventIndex::Key _inputJetKey;
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _selectedJetKey;
+        std::vector<EventIndex::Key> _dRObjectKeys;
+        
+        int64_t _adaptiveWarmUp;
+        CutProgram _jetCuts;
+        //same cuts without the pT threshold; decides if a jet failing the nominal selection passes in a variation
+        CutProgram _jetIdCuts;
+        
+        DeltaRCleaning _dRCleaning;
+        
+        //scales the jet p4 by the user record (factor) or by 1+sign*user record (relative uncertainty)
+        struct JetVariation
+        {
+            unsigned int index;
+            UserRecordKey userRecord;
+            bool relative;
+            double sign;
+        };
+        std::vector<std::string> _variationDefinitions;
+        std::vector<JetVariation> _variations;
+        std::vector<std::string> _suffixes;
+        EventIndex::Key _variationJetKey;
+        
+        //outputs which are connected; an event is sent to the output of a variation if the nominal one is not accepted
+        std::vector<std::string> _acceptedOutputs;
+        VariationRouting _routing;
+        //buffers of the routing, one entry for the nominal and per variation
+        std::vector<unsigned int> _nSelected;
+        std::vector<pxl::Source*> _outputs;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+        CutFlow::Counter _dRCleaningCounter;
+
+        ModuleTimer _timer;
 
     public:
         JetSelection():
@@ -43,7 +94,8 @@ class JetSelection:
 
             _dRInvert(false),
             _dR(0.3),
-            _dRObjects({"TightMuon","TightElectron"})
+            _dRObjects({"TightMuon","TightElectron"}),
+            _adaptiveWarmUp(0)
             /*Initial Values taken from TOP JetMET Analysis (Run2) */
             /*https://twiki.cern.ch/twiki/bin/view/CMS/TopJME#General_Information */
         {
@@ -57,6 +109,13 @@ class JetSelection:
             _output2JetsSource = addSource("2 Jets", "2 Jets");
             _output1JetSource = addSource("1 Jet", "1 Jet");
             _output0JetSource = addSource("0 Jets", "0 Jets");
+            _cutFlow.addSource(_outputOtherNJetsSource);
+            _cutFlow.addSource(_output4JetsSource);
+            _cutFlow.addSource(_output3JetsSource);
+            _cutFlow.addSource(_output2JetsSource);
+            _cutFlow.addSource(_output1JetSource);
+            _cutFlow.addSource(_output0JetSource);
+            _dRCleaningCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"dR cleaning");
 
             addOption("event view","name of the event view where jets are selected",_inputEventViewName);
             addOption("input jet name","name of particles to consider for selection",_inputJetName);
@@ -69,6 +128,13 @@ class JetSelection:
             addOption("invert dR","inverts dR cleaning",_dRInvert);
             addOption("dR cut","remove jets close to other objects, e.g. leptons",_dR);
             addOption("dR objects","object names to which the jets should NOT be close to",_dRObjects);
+            
+            addOption("systematic variations","list of 'name:user record' scaling the jet p4 by the user record or 'name:user record:+1/-1' scaling it by 1+/-user record, e.g. 'jesUp:jecUncertainty:+1'; the pT cut is evaluated per variation on all input jets, the selected jets get 'variationMask' (bit i: selected in variation i), jets passing only in variations are named '<selected jets>__variations' and 'n<selected jets>__<variation>' is stored",_variationDefinitions);
+            addOption("accepted outputs","outputs which are connected, e.g. '2 Jets', '3 Jets'; an event whose nominal number of jets goes to another output is sent to the output of the first variation going to one of these; 'selected__<variation>' is false for the variations going to another output than the event; empty: route by the nominal number of jets",_acceptedOutputs);
+            
+            addOption("adaptive cut order","evaluate all jet id cuts for this number of jets and sort them by cost/rejection rate afterwards; 0 keeps the given order",_adaptiveWarmUp);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~JetSelection()
@@ -100,6 +166,7 @@ class JetSelection:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("event view",_inputEventViewName);
             getOption("input jet name",_inputJetName);
             getOption("name of selected jets",_selectedJetName);
@@ -115,192 +182,299 @@ class JetSelection:
             {
                 _dR=-1;
             }
-
-        }
-
-        bool passesJetSelection(pxl::Particle* particle)
-        {
-            if (not (particle->getPt()>_pTMinJet))
-            {
-                return false;
-            }
-            if (not (fabs(particle->getEta())<_etaMaxJet))
+            
+            _inputJetKey = EventIndex::intern(_inputJetName);
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _selectedJetKey = EventIndex::intern(_selectedJetName);
+            _variationJetKey = EventIndex::intern(SystematicVariations::getVariationsName(_selectedJetName));
+            _dRObjectKeys.clear();
+            for (const std::string& name: _dRObjects)
             {
-                return false;
+                _dRObjectKeys.push_back(EventIndex::intern(name));
             }
-           
-            if (particle->hasUserRecord("neutralHadronEnergyFraction"))
+            
+            getOption("systematic variations",_variationDefinitions);
+            _variations.clear();
+            for (const std::string& definition: _variationDefinitions)
             {
-                if (not (particle->getUserRecord("neutralHadronEnergyFraction").toFloat()<0.99))
+                std::vector<std::string> tokens;
+                std::istringstream ss(definition);
+                std::string token;
+                while (std::getline(ss,token,':'))
+                {
+                    tokens.push_back(token);
+                }
+                if (tokens.size()<2 or tokens.size()>3 or tokens[0].empty() or tokens[1].empty() or (tokens.size()==3 and tokens[2]!="+1" and tokens[2]!="-1"))
                 {
-                    return false;
+                    throw std::runtime_error(getName()+": invalid systematic variation '"+definition+"', expected 'name:user record' or 'name:user record:+1/-1'");
                 }
+                JetVariation variation;
+                variation.index = SystematicVariations::registerVariation(tokens[0]);
+                variation.userRecord = UserRecordKey(tokens[1]);
+                variation.relative = tokens.size()==3;
+                variation.sign = (variation.relative and tokens[2]=="-1") ? -1.0 : 1.0;
+                _variations.push_back(variation);
             }
             
-            if (particle->hasUserRecord("neutralEmEnergyFraction"))
+            getOption("accepted outputs",_acceptedOutputs);
+            try
             {
-                if (not (particle->getUserRecord("neutralEmEnergyFraction").toFloat()<0.99))
-                {
-                    return false;
-                }
+                _routing.setAccepted(_acceptedOutputs,{
+                    {"0 Jets",_output0JetSource},{"1 Jet",_output1JetSource},{"2 Jets",_output2JetsSource},
+                    {"3 Jets",_output3JetsSource},{"4 Jets",_output4JetsSource},{">4 Jets",_outputOtherNJetsSource}
+                });
             }
-
-            if (not (particle->getUserRecord("nConstituents").toInt32()>1))
+            catch(std::exception &e)
             {
-                return false;
+                throw std::runtime_error(getName()+": "+e.what());
             }
             
-            if (particle->hasUserRecord("muonEnergyFraction"))
+            getOption("adaptive cut order",_adaptiveWarmUp);
+            
+            const std::vector<std::string> jetIdCuts({
+                "abs(eta)<"+CutProgram::number(_etaMaxJet),
+                "UR:neutralHadronEnergyFraction<0.99 if present",
+                "UR:neutralEmEnergyFraction<0.99 if present",
+                "UR:nConstituents>1 required",
+                "UR:muonEnergyFraction<0.8 if present",
+                //additional selection if jet is central
+                "UR:chargedHadronEnergyFraction>0 if present and abs(eta)<2.4",
+                "UR:chargedMultiplicity>0 required if abs(eta)<2.4",
+                //same as 'chargedEmEnergy'
+                "UR:electronEnergyFraction<0.99 if present and abs(eta)<2.4"
+            });
+            std::vector<std::string> jetCuts({"pt>"+CutProgram::number(_pTMinJet)});
+            jetCuts.insert(jetCuts.end(),jetIdCuts.begin(),jetIdCuts.end());
+            _jetCuts.setCutFlow(&_cutFlow);
+            _jetCuts.compile(jetCuts);
+            _jetIdCuts.compile(jetIdCuts);
+            _jetCuts.setAdaptive(_adaptiveWarmUp>0 ? _adaptiveWarmUp : 0);
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
+        }
+
+        bool passesJetSelection(pxl::Particle* particle)
+        {
+            return _jetCuts.passes(particle);
+        }
+
+        void applyDRcleaning(EventIndex& index, pxl::EventView* eventView, std::vector<pxl::Particle*>& selectedJets, std::vector<pxl::Particle*>& dRCleaningObjects, bool count=true)
+        {
+            _dRCleaning.setObjects(dRCleaningObjects);
+            
+            //keep the order of the remaining jets
+            unsigned int nkept = 0;
+            for (unsigned int ijet = 0; ijet < selectedJets.size(); ++ijet)
             {
-                if (not (particle->getUserRecord("muonEnergyFraction").toFloat()<0.8))
+                pxl::Particle* selectedJet = selectedJets[ijet];
+                //sqrt is monotonic: the sqrt of the minimum equals the minimum dR
+                const double dRmin = std::min(std::sqrt(_dRCleaning.minDeltaR2(selectedJet)),100.0);
+                if (!_dRInvert && dRmin<_dR)
+                {
+                    index.removeObject(eventView,selectedJet);
+                    if (count)
+                    {
+                        _cutFlow.count(_dRCleaningCounter);
+                    }
+                }
+                else
                 {
-                    return false;
+                    selectedJet->setUserRecord("dRmin",float(dRmin));
+                    selectedJets[nkept]=selectedJet;
+                    ++nkept;
                 }
             }
-
-            //additional selection if jet is central
-            if (fabs(particle->getEta())<2.4)
+            selectedJets.resize(nkept);
+        }
+        
+        static inline double getScale(const pxl::Particle* jet, const JetVariation& variation)
+        {
+            const double record = variation.userRecord.get(jet).toDouble();
+            return variation.relative ? 1.0+variation.sign*record : record;
+        }
+        
+        //bit i is set if the jet is selected in variation i; the p4 is only scaled so only the pT cut depends on it
+        uint64_t getVariationMask(pxl::Particle* jet, bool nominal, unsigned int nVariations)
+        {
+            uint64_t mask = 0;
+            if (nominal)
             {
-                if (particle->hasUserRecord("chargedHadronEnergyFraction"))
+                for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
                 {
-                    if (not (particle->getUserRecord("chargedHadronEnergyFraction").toFloat()>0))
-                    {
-                        return false;
-                    }
+                    mask |= uint64_t(1)<<ivariation;
                 }
-                if (not (particle->getUserRecord("chargedMultiplicity").toFloat()>0))
+            }
+            //-1: not evaluated yet
+            int passesId = nominal ? 1 : -1;
+            for (const JetVariation& variation: _variations)
+            {
+                bool passes = getScale(jet,variation)*jet->getPt()>_pTMinJet;
+                if (passes and passesId<0)
                 {
-                    return false;
+                    passesId = _jetIdCuts.passes(jet) ? 1 : 0;
                 }
-                
-                //same as 'chargedEmEnergy'
-                if (particle->hasUserRecord("electronEnergyFraction"))
+                passes = passes and passesId>0;
+                if (passes)
                 {
-                    if (not (particle->getUserRecord("electronEnergyFraction").toFloat()<0.99))
-                    {
-                        return false;
-                    }
+                    mask |= uint64_t(1)<<variation.index;
+                }
+                else
+                {
+                    mask &= ~(uint64_t(1)<<variation.index);
                 }
             }
-
-            return true;
+            return mask;
         }
-
-        void applyDRcleaning(pxl::EventView* eventView, std::vector<pxl::Particle*>& selectedJets, std::vector<pxl::Particle*>& dRCleaningObjects)
+        
+        void storeVariations(SystematicVariations& variations, const std::vector<pxl::Particle*>& jets)
         {
-            for (std::vector<pxl::Particle*>::iterator it = selectedJets.begin(); it != selectedJets.end(); )
+            for (pxl::Particle* jet: jets)
             {
-                pxl::Particle* selectedJet = *it;
-                double dRmin = 100.0;
-                for (unsigned iparticle=0; iparticle<dRCleaningObjects.size();++iparticle)
+                const pxl::LorentzVector& vector = jet->getVector();
+                for (const JetVariation& variation: _variations)
                 {
-                    pxl::Particle* dRCleanObj = dRCleaningObjects[iparticle];
-                    double dR = selectedJet->getVector().deltaR(&dRCleanObj->getVector());
-                    if (!_dRInvert && dR<_dR)
-                    {
-                        eventView->removeObject(selectedJet);
-                        selectedJets.erase(it);
-                        selectedJet=nullptr;
-                        break;
-                    }
-                    else
-                    {
-                        dRmin=std::min(dR,dRmin);
-                    }
+                    const double scale = getScale(jet,variation);
+                    variations.setVector(jet,variation.index,pxl::LorentzVector(scale*vector.getPx(),scale*vector.getPy(),scale*vector.getPz(),scale*vector.getE()));
                 }
-                if (selectedJet)
+            }
+        }
+        
+        //number of selected jets per variation
+        void storeSelectedVariations(pxl::EventView* eventView, const std::vector<pxl::Particle*>& selectedJets, const std::vector<pxl::Particle*>& variationJets, unsigned int nVariations)
+        {
+            for (const std::vector<pxl::Particle*>* jets: {&selectedJets,&variationJets})
+            {
+                for (const pxl::Particle* jet: *jets)
                 {
-                    selectedJet->setUserRecord("dRmin",float(dRmin));
-                    ++it;
+                    for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+                    {
+                        if (SystematicVariations::isSelected(jet,ivariation))
+                        {
+                            ++_nSelected[ivariation+1];
+                        }
+                    }
                 }
             }
+            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+            {
+                eventView->setUserRecord("n"+_selectedJetName+_suffixes[ivariation],_nSelected[ivariation+1]);
+            }
+        }
+        
+        pxl::Source* getOutput(unsigned int nJets) const
+        {
+            switch (nJets)
+            {
+                case 0:
+                    return _output0JetSource;
+                case 1:
+                    return _output1JetSource;
+                case 2:
+                    return _output2JetsSource;
+                case 3:
+                    return _output3JetsSource;
+                case 4:
+                    return _output4JetsSource;
+                default:
+                    return _outputOtherNJetsSource;
+            }
         }
         
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> selectedJets;
+                    //jets failing the nominal selection but passing in at least one variation
+                    std::vector<pxl::Particle*> variationJets;
                     
                     std::vector<pxl::Particle*> dRCleaningObjects;
                     
+                    //jets without variations are selected in all variations
+                    const unsigned int nVariations = SystematicVariations::getNVariations();
+                    if (not _variations.empty() and nVariations>64)
+                    {
+                        throw std::runtime_error("the variation mask supports at most 64 systematic variations");
+                    }
+                    while (_suffixes.size()<nVariations)
+                    {
+                        _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+                    }
+                    
                     pxl::EventView* inputEventView = nullptr;
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
 
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
                             inputEventView=eventView;
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            //copy since renaming/removing changes the indexed particles
+                            const std::vector<pxl::Particle*> jets = index.getParticles(eventView,_inputJetKey);
 
-                            for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
+                            for (unsigned iparticle=0; iparticle<jets.size();++iparticle)
                             {
-                                pxl::Particle* particle = particles[iparticle];
+                                pxl::Particle* particle = jets[iparticle];
+                                const bool nominal = passesJetSelection(particle);
+                                uint64_t mask = 0;
+                                if (not _variations.empty())
+                                {
+                                    mask = getVariationMask(particle,nominal,nVariations);
+                                    SystematicVariations::getMaskKey().set(particle,mask);
+                                }
 
-                                if (particle->getName()==_inputJetName)
+                                if (nominal)
                                 {
-                                    if (passesJetSelection(particle))
-                                    {
-                                        particle->setName(_selectedJetName);
-                                        selectedJets.push_back(particle);
-                                    }
-                                    else if (_cleanEvent)
-                                    {
-                                        eventView->removeObject(particle);
-                                    }
+                                    index.setName(eventView,particle,_selectedJetKey);
+                                    selectedJets.push_back(particle);
                                 }
-                                for (unsigned int iname = 0; iname < _dRObjects.size(); ++iname)
+                                else if (mask!=0)
                                 {
-                                    if (particle->getName()==_dRObjects[iname])
-                                    {
-                                        dRCleaningObjects.push_back(particle);
-                                        break;
-                                    }
+                                    index.setName(eventView,particle,_variationJetKey);
+                                    variationJets.push_back(particle);
+                                }
+                                else if (_cleanEvent)
+                                {
+                                    index.removeObject(eventView,particle);
                                 }
                             }
+                            index.getParticles(eventView,_dRObjectKeys,dRCleaningObjects);
                         }
                         
-                        applyDRcleaning(eventView,selectedJets,dRCleaningObjects);
+                        applyDRcleaning(index,eventView,selectedJets,dRCleaningObjects);
+                        applyDRcleaning(index,eventView,variationJets,dRCleaningObjects,false);
                     }
-                    if (inputEventView)
+                    if (not inputEventView)
                     {
-                        inputEventView->setUserRecord("n"+_selectedJetName,selectedJets.size());
+                        return _cutFlow.send(_outputOtherNJetsSource,event);
                     }
-                    else
+                    inputEventView->setUserRecord("n"+_selectedJetName,selectedJets.size());
+                    if (not _variations.empty())
                     {
-                        _outputOtherNJetsSource->setTargets(event);
-                        return _outputOtherNJetsSource->processTargets();
+                        //all remaining jets are varied so that the MET shift includes the ones failing the selection
+                        SystematicVariations& variations = SystematicVariations::get(event);
+                        storeVariations(variations,selectedJets);
+                        storeVariations(variations,variationJets);
+                        storeVariations(variations,index.getParticles(inputEventView,_inputJetKey));
                     }
-
-                    switch (selectedJets.size())
+                    _nSelected.assign(nVariations+1,0);
+                    _nSelected[0] = selectedJets.size();
+                    storeSelectedVariations(inputEventView,selectedJets,variationJets,nVariations);
+                    _outputs.clear();
+                    for (unsigned int nJets: _nSelected)
                     {
-                        case 0:
-                            _output0JetSource->setTargets(event);
-                            return _output0JetSource->processTargets();
-                        case 1:
-                            _output1JetSource->setTargets(event);
-                            return _output1JetSource->processTargets();
-                        case 2:
-                            _output2JetsSource->setTargets(event);
-                            return _output2JetsSource->processTargets();
-                        case 3:
-                            _output3JetsSource->setTargets(event);
-                            return _output3JetsSource->processTargets();
-                        case 4:
-                            _output4JetsSource->setTargets(event);
-                            return _output4JetsSource->processTargets();
-                        default:
-                            _outputOtherNJetsSource->setTargets(event);
-                            return _outputOtherNJetsSource->processTargets();
+                        _outputs.push_back(getOutput(nJets));
                     }
+                    return _cutFlow.send(_routing.route(event,_outputs),event);
                 }
             }
             catch(std::exception &e)
@@ -316,6 +490,13 @@ class JetSelection:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            logger(pxl::LOG_LEVEL_INFO,"jet id cut flow of ",getName(),":\n",_jetCuts.getCutFlowTable());
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
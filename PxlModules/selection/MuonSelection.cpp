@@ -12,6 +12,13 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include "CutProgram.hpp"
+
 static pxl::Logger logger("MuonSelection");
 
 class MuonSelection:
@@ -32,7 +39,23 @@ class MuonSelection:
         double _pfRelIsoCorDbTightMuon; //Muon Isolation:Relative(Rel) Isolation Correction (Cor) Delta beta (Db)
         double _pfRelIsoCorDbBetaTightMuon; //Muon Isolation:Relative Isolation Correction (Cor) Delta beta (Db)- Beta parameter
 
-      
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _inputMuonKey;
+        EventIndex::Key _tightMuonKey;
+        
+        int64_t _adaptiveWarmUp;
+        CutProgram _tightMuonCuts;
+        
+        UserRecordKey _r04PFsumChargedHadronPtKey;
+        UserRecordKey _r04PFsumNeutralHadronEtKey;
+        UserRecordKey _r04PFsumPhotonEtKey;
+        UserRecordKey _r04PFsumPUPtKey;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+
+        ModuleTimer _timer;
+
     public:
         MuonSelection():
 
@@ -44,7 +67,9 @@ class MuonSelection:
             _pTMinTightMuon(30),
             _etaMaxTightMuon(2.5),
             _pfRelIsoCorDbTightMuon(0.12),
-            _pfRelIsoCorDbBetaTightMuon(0.5)
+            _pfRelIsoCorDbBetaTightMuon(0.5),
+            
+            _adaptiveWarmUp(0)
 
 
 	    /*Initial Values for tight Muons taken TOP Muon Information for Analysis (Run2) 
@@ -58,6 +83,9 @@ class MuonSelection:
             _outputIsoSource = addSource("1 iso muon", "iso");
             _outputAntiIsoSource = addSource("1 anti-iso muon", "anti-iso");
             _outputOtherSource = addSource("other", "other");
+            _cutFlow.addSource(_outputIsoSource);
+            _cutFlow.addSource(_outputAntiIsoSource);
+            _cutFlow.addSource(_outputOtherSource);
 
             addOption("Event view","name of the event view where muons are selected",_inputEventViewName);
             addOption("Input muon name","name of particles to consider for selection",_inputMuonName);
@@ -67,6 +95,10 @@ class MuonSelection:
             addOption("TightMuon Maximum Eta","",_etaMaxTightMuon);
             addOption("TightMuon Minimum Relative Iso DeltaBeta","",_pfRelIsoCorDbTightMuon);
             addOption("TightMuon Relative Iso DeltaBeta; Beta Parameter","",_pfRelIsoCorDbBetaTightMuon);
+            
+            addOption("adaptive cut order","evaluate all tight muon cuts for this number of muons and sort them by cost/rejection rate afterwards; 0 keeps the given order",_adaptiveWarmUp);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~MuonSelection()
@@ -98,6 +130,7 @@ class MuonSelection:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("Event view",_inputEventViewName);
             getOption("Input muon name",_inputMuonName);
             getOption("Name of selected tight muons",_tightMuonName);
@@ -106,17 +139,34 @@ class MuonSelection:
             getOption("TightMuon Maximum Eta",_etaMaxTightMuon);
             getOption("TightMuon Minimum Relative Iso DeltaBeta",_pfRelIsoCorDbTightMuon);
             getOption("TightMuon Relative Iso DeltaBeta; Beta Parameter",_pfRelIsoCorDbBetaTightMuon);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _inputMuonKey = EventIndex::intern(_inputMuonName);
+            _tightMuonKey = EventIndex::intern(_tightMuonName);
+            
+            getOption("adaptive cut order",_adaptiveWarmUp);
+            
+            _tightMuonCuts.setCutFlow(&_cutFlow);
+            _tightMuonCuts.compile({
+                "pt>"+CutProgram::number(_pTMinTightMuon),
+                "abs(eta)<"+CutProgram::number(_etaMaxTightMuon),
+                "UR:isTightMuon"
+            });
+            _tightMuonCuts.setAdaptive(_adaptiveWarmUp>0 ? _adaptiveWarmUp : 0);
+            
+            _r04PFsumChargedHadronPtKey = UserRecordKey("R04PFsumChargedHadronPt");
+            _r04PFsumNeutralHadronEtKey = UserRecordKey("R04PFsumNeutralHadronEt");
+            _r04PFsumPhotonEtKey = UserRecordKey("R04PFsumPhotonEt");
+            _r04PFsumPUPtKey = UserRecordKey("R04PFsumPUPt");
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
         bool passesTightCriteria(pxl::Particle* particle)
         {
-            if (not (particle->getPt()>_pTMinTightMuon)) {
-                return false;
-            }
-            if (not (fabs(particle->getEta())<_etaMaxTightMuon)) {
-                return false;
-            }
-            if (not particle->hasUserRecord("isTightMuon") || not particle->getUserRecord("isTightMuon"))
+            if (not _tightMuonCuts.passes(particle))
             {
                 return false;
             }
@@ -164,34 +214,31 @@ class MuonSelection:
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> tightMuons;
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            const std::vector<pxl::Particle*>& particles = index.getParticles(eventView,_inputMuonKey);
 
                             for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
                             {
                                 pxl::Particle* particle = particles[iparticle];
 
-                                if (particle->getName()==_inputMuonName)
+                                if (passesTightCriteria(particle))
                                 {
-                                    if (passesTightCriteria(particle))
-                                    {
-                                        tightMuons.push_back(particle);
-                                    }
+                                    tightMuons.push_back(particle);
                                 }
                             }
                         }
@@ -199,23 +246,20 @@ class MuonSelection:
                         if (tightMuons.size()==1)
                         {
                             pxl::Particle* tightMuon = tightMuons.front();   
-                            tightMuon->setName(_tightMuonName);
+                            index.setName(eventView,tightMuon,_tightMuonKey);
                             
                             if (pfRelIsoCorDb(tightMuon)<_pfRelIsoCorDbTightMuon)
                             {
-                                _outputIsoSource->setTargets(event);
-                                return _outputIsoSource->processTargets();
+                                return _cutFlow.send(_outputIsoSource,event);
                             }
                             else
                             {
-                                _outputAntiIsoSource->setTargets(event);
-                                return _outputAntiIsoSource->processTargets();
+                                return _cutFlow.send(_outputAntiIsoSource,event);
                             }
                         }
                         else
                         {
-                            _outputOtherSource->setTargets(event);
-                            return _outputOtherSource->processTargets();
+                            return _cutFlow.send(_outputOtherSource,event);
                         }
                     }
                 }
@@ -233,6 +277,13 @@ class MuonSelection:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            logger(pxl::LOG_LEVEL_INFO,"tight muon cut flow of ",getName(),":\n",_tightMuonCuts.getCutFlowTable());
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -244,10 +295,10 @@ class MuonSelection:
         
         double pfRelIsoCorDb (pxl::Particle* particle)
         {
-            float R04PFsumChargedHadronPt = particle->getUserRecord("R04PFsumChargedHadronPt").toFloat();
-            float R04sumNeutralHadronEt = particle->getUserRecord("R04PFsumNeutralHadronEt").toFloat();
-            float R04PFsumPhotonEt = particle->getUserRecord("R04PFsumPhotonEt").toFloat();
-            float R04PFsumPUPt = particle->getUserRecord("R04PFsumPUPt").toFloat();
+            float R04PFsumChargedHadronPt = _r04PFsumChargedHadronPtKey.get(particle).toFloat();
+            float R04sumNeutralHadronEt = _r04PFsumNeutralHadronEtKey.get(particle).toFloat();
+            float R04PFsumPhotonEt = _r04PFsumPhotonEtKey.get(particle).toFloat();
+            float R04PFsumPUPt = _r04PFsumPUPtKey.get(particle).toFloat();
             float pT =  particle->getPt();
             if( pT < std::numeric_limits<float>::epsilon())
             {
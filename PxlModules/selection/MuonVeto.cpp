@@ -12,6 +12,11 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
 static pxl::Logger logger("MuonVeto");
 
 class MuonVeto:
@@ -33,7 +38,25 @@ class MuonVeto:
         double _pfRelIsoCorDbLooseMuon; //Muon Isolation:Relative(Rel) Isolation Correction (Cor) Delta beta (Db) 
         double _pfRelIsoCorDbBetaLooseMuon; //Muon Isolation:Relative Isolation Correction (Cor) Delta beta (Db)- Beta parameter
 
-      
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _inputMuonKey;
+        EventIndex::Key _looseMuonKey;
+        
+        UserRecordKey _isLooseMuonKey;
+        UserRecordKey _r04PFsumChargedHadronPtKey;
+        UserRecordKey _r04PFsumNeutralHadronEtKey;
+        UserRecordKey _r04PFsumPhotonEtKey;
+        UserRecordKey _r04PFsumPUPtKey;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+        CutFlow::Counter _ptCounter;
+        CutFlow::Counter _etaCounter;
+        CutFlow::Counter _idCounter;
+        CutFlow::Counter _isoCounter;
+
+        ModuleTimer _timer;
+
     public:
         MuonVeto():
             Module(),
@@ -58,6 +81,12 @@ class MuonVeto:
             addSink("input", "input");
             _outputVetoSource = addSource("veto loose muons","veto");
             _outputOtherSource = addSource("other", "other");
+            _cutFlow.addSource(_outputVetoSource);
+            _cutFlow.addSource(_outputOtherSource);
+            _ptCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"pt");
+            _etaCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"abs(eta)");
+            _idCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"isLooseMuon");
+            _isoCounter = _cutFlow.addCounter(CutFlow::OBJECTS,"relative isolation");
 
             addOption("Event view","name of the event view where muons are selected",_inputEventViewName);
             addOption("Input muon name","name of particles to consider for selection",_inputMuonName);
@@ -69,6 +98,8 @@ class MuonVeto:
             addOption("LooseMuon Maximum Eta","",_etamaxLooseMuon);
             addOption("LooseMuon Minimum Relative Iso DeltaBeta","",_pfRelIsoCorDbLooseMuon);
             addOption("LooseMuon Relative Iso DeltaBeta; Beta Parameter","",_pfRelIsoCorDbBetaLooseMuon);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
 
         }
 
@@ -101,6 +132,7 @@ class MuonVeto:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("Event view",_inputEventViewName);
             getOption("Input muon name",_inputMuonName);
             getOption("Name of selected loose muons",_looseMuonName);
@@ -111,64 +143,75 @@ class MuonVeto:
             getOption("LooseMuon Maximum Eta",_etamaxLooseMuon);
             getOption("LooseMuon Minimum Relative Iso DeltaBeta",_pfRelIsoCorDbLooseMuon);
             getOption("LooseMuon Relative Iso DeltaBeta; Beta Parameter",_pfRelIsoCorDbBetaLooseMuon);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _inputMuonKey = EventIndex::intern(_inputMuonName);
+            _looseMuonKey = EventIndex::intern(_looseMuonName);
+            
+            _isLooseMuonKey = UserRecordKey("isLooseMuon");
+            _r04PFsumChargedHadronPtKey = UserRecordKey("R04PFsumChargedHadronPt");
+            _r04PFsumNeutralHadronEtKey = UserRecordKey("R04PFsumNeutralHadronEt");
+            _r04PFsumPhotonEtKey = UserRecordKey("R04PFsumPhotonEt");
+            _r04PFsumPUPtKey = UserRecordKey("R04PFsumPUPt");
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
         bool passesLooseCriteria(pxl::Particle* particle)
         {
             if (not (particle->getPt()>_pTminLooseMuon))
             {
-                return false;
+                return _cutFlow.reject(_ptCounter);
             }
             if (not (fabs(particle->getEta())<_etamaxLooseMuon))
             {
-                return false;
+                return _cutFlow.reject(_etaCounter);
             }
-            if (not particle->getUserRecord("isLooseMuon"))
+            if (not _isLooseMuonKey.get(particle))
             {
-                return false;
+                return _cutFlow.reject(_idCounter);
             }
             if (not (pfRelIsoCorDb (particle)<_pfRelIsoCorDbLooseMuon))
             {
-                return false;
+                return _cutFlow.reject(_isoCounter);
             }
             return true;
         }
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
                     std::vector<pxl::Particle*> looseMuons;
                     std::vector<pxl::Particle*> otherMuons;
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            std::vector<pxl::Particle*> particles;
-                            eventView->getObjectsOfType(particles);
+                            const std::vector<pxl::Particle*>& particles = index.getParticles(eventView,_inputMuonKey);
 
                             for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
                             {
                                 pxl::Particle* particle = particles[iparticle];
 
-                                if (particle->getName()==_inputMuonName)
+                                if (passesLooseCriteria(particle))
+                                {
+                                    looseMuons.push_back(particle);
+                                }
+                                else
                                 {
-                                    if (passesLooseCriteria(particle))
-                                    {
-                                        looseMuons.push_back(particle);
-                                    }
-                                    else
-                                    {
-                                        otherMuons.push_back(particle);
-                                    }
+                                    otherMuons.push_back(particle);
                                 }
                             }
                         }
@@ -176,23 +219,21 @@ class MuonVeto:
                         {
                             for (unsigned int iparticle = 0; iparticle < otherMuons.size(); ++iparticle)
                             {
-                                eventView->removeObject(otherMuons[iparticle]);
+                                index.removeObject(eventView,otherMuons[iparticle]);
                             }
                         }
 
                         if (looseMuons.size()==0)
                         {
-                            _outputVetoSource->setTargets(event);
-                            return _outputVetoSource->processTargets();
+                            return _cutFlow.send(_outputVetoSource,event);
                         }
                         else
                         {
                             for (unsigned int i=0; i < looseMuons.size(); ++i)
                             {
-                                looseMuons[i]->setName(_looseMuonName);
+                                index.setName(eventView,looseMuons[i],_looseMuonKey);
                             }
-                            _outputOtherSource->setTargets(event);
-                            return _outputOtherSource->processTargets();
+                            return _cutFlow.send(_outputOtherSource,event);
                         }
                     }
                 }
@@ -210,6 +251,12 @@ class MuonVeto:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
@@ -221,10 +268,10 @@ class MuonVeto:
         
         double pfRelIsoCorDb (const pxl::Particle* particle)
         {
-            float R04PFsumChargedHadronPt = particle->getUserRecord("R04PFsumChargedHadronPt").toFloat();
-            float R04sumNeutralHadronEt = particle->getUserRecord("R04PFsumNeutralHadronEt").toFloat(); //Correct it!
-            float R04PFsumPhotonEt = particle->getUserRecord("R04PFsumPhotonEt").toFloat(); //Correct it!
-            float R04PFsumPUPt = particle->getUserRecord("R04PFsumPUPt").toFloat();
+            float R04PFsumChargedHadronPt = _r04PFsumChargedHadronPtKey.get(particle).toFloat();
+            float R04sumNeutralHadronEt = _r04PFsumNeutralHadronEtKey.get(particle).toFloat(); //Correct it!
+            float R04PFsumPhotonEt = _r04PFsumPhotonEtKey.get(particle).toFloat(); //Correct it!
+            float R04PFsumPUPt = _r04PFsumPUPtKey.get(particle).toFloat();
             float pT =  particle->getPt();
             if( pT < std::numeric_limits<float>::epsilon())
             {
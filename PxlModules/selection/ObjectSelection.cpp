@@ -0,0 +1,212 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include "CutProgram.hpp"
+
+static pxl::Logger logger("ObjectSelection");
+
+/*
+* Generic selection of particles by a list of cut expressions (see
+* CutProgram.hpp). The selected particles are renamed and the event is sent to
+* the source of the number of selected particles.
+*/
+class ObjectSelection:
+    public pxl::Module
+{
+    private:
+        std::vector<pxl::Source*> _outputSources;
+
+        std::string _inputEventViewName;
+        std::string _inputName;
+        std::string _selectedName;
+        bool _cleanEvent;
+
+        std::vector<std::string> _cutExpressions;
+        int64_t _reorderAfter;
+
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _inputKey;
+        EventIndex::Key _selectedKey;
+
+        CutProgram _cuts;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+
+        ModuleTimer _timer;
+
+    public:
+        ObjectSelection():
+            Module(),
+            _inputEventViewName("Reconstructed"),
+            _inputName("Muon"),
+            _selectedName("TightMuon"),
+            _cleanEvent(false),
+            _cutExpressions({"pt>30","abs(eta)<2.1","UR:isTightMuon"}),
+            _reorderAfter(1000)
+        {
+            addSink("input", "input");
+
+            _outputSources.resize(6);
+            _outputSources[5] = addSource(">4", ">4");
+            _outputSources[4] = addSource("4", "4");
+            _outputSources[3] = addSource("3", "3");
+            _outputSources[2] = addSource("2", "2");
+            _outputSources[1] = addSource("1", "1");
+            _outputSources[0] = addSource("0", "0");
+            for (pxl::Source* source: _outputSources)
+            {
+                _cutFlow.addSource(source);
+            }
+
+            addOption("event view","name of the event view where particles are selected",_inputEventViewName);
+            addOption("input name","name of particles to consider for selection",_inputName);
+            addOption("name of selected particles","",_selectedName);
+            addOption("clean event","this option will clean the event of all particles failing the cuts",_cleanEvent);
+
+            addOption("cuts","cut expressions, e.g. 'pt>30', 'abs(eta)<2.4', 'UR:isTightMuon', 'UR:muonEnergyFraction<0.8 if present', 'UR:chargedMultiplicity>0 if abs(eta)<2.4'",_cutExpressions);
+            addOption("reorder cuts after","evaluate all cuts for this number of particles and sort them by cost/rejection rate afterwards; 0 keeps the given order",_reorderAfter);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
+        }
+
+        ~ObjectSelection()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("ObjectSelection");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("event view",_inputEventViewName);
+            getOption("input name",_inputName);
+            getOption("name of selected particles",_selectedName);
+            getOption("clean event",_cleanEvent);
+
+            getOption("cuts",_cutExpressions);
+            getOption("reorder cuts after",_reorderAfter);
+
+            try
+            {
+                _cuts.setCutFlow(&_cutFlow);
+                _cuts.compile(_cutExpressions);
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            _cuts.setAdaptive(_reorderAfter>0 ? _reorderAfter : 0);
+
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _inputKey = EventIndex::intern(_inputName);
+            _selectedKey = EventIndex::intern(_selectedName);
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
+
+                    unsigned int nSelected = 0;
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
+                    {
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
+                        {
+                            unsigned int nSelectedInView = 0;
+                            //copy since renaming/removing changes the indexed particles
+                            const std::vector<pxl::Particle*> particles = index.getParticles(eventView,_inputKey);
+                            for (unsigned iparticle=0; iparticle<particles.size();++iparticle)
+                            {
+                                pxl::Particle* particle = particles[iparticle];
+                                if (_cuts.passes(particle))
+                                {
+                                    index.setName(eventView,particle,_selectedKey);
+                                    ++nSelectedInView;
+                                }
+                                else if (_cleanEvent)
+                                {
+                                    index.removeObject(eventView,particle);
+                                }
+                            }
+                            eventView->setUserRecord("n"+_selectedName,nSelectedInView);
+                            nSelected+=nSelectedInView;
+                        }
+                    }
+
+                    pxl::Source* source = _outputSources[std::min<unsigned int>(nSelected,_outputSources.size()-1)];
+                    return _cutFlow.send(source,event);
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+            logger(pxl::LOG_LEVEL_INFO,"cut flow of ",getName(),":\n",_cuts.getCutFlowTable());
+            _cutFlow.write();
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(ObjectSelection)
+PXL_PLUGIN_INIT
@@ -0,0 +1,260 @@
+#ifndef __TRIGGEREXPRESSION_H__
+#define __TRIGGEREXPRESSION_H__
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* Boolean expression over trigger paths like
+*
+*   HLT_IsoMu24_eta2p1_IterTrk02_v* or (HLT_Mu50_v* and not HLT_Mu45_v*)
+*
+* Paths can contain the wildcards '*' and '?'. Each distinct path pattern is a
+* term with an index; the expression is compiled into a postfix program over
+* these indices. The caller resolves the patterns to the trigger flags of the
+* events (see match) and evaluates the program on a bit mask with one bit per
+* term which is set if a flag matching the pattern has fired. At most 64 terms
+* are supported.
+*/
+class TriggerExpression
+{
+    private:
+        enum OpCode
+        {
+            TERM,NOT,AND,OR
+        };
+
+        struct Instruction
+        {
+            OpCode op;
+            unsigned int term;
+        };
+
+        std::vector<std::string> _patterns;
+        std::vector<Instruction> _program;
+        //reused for evaluation
+        mutable std::vector<char> _stack;
+
+        std::vector<std::string> _tokens;
+        unsigned int _position;
+
+        void tokenize(const std::string& expression)
+        {
+            _tokens.clear();
+            std::string token;
+            for (char c: expression)
+            {
+                if (c==' ' or c=='\t' or c=='(' or c==')')
+                {
+                    if (!token.empty())
+                    {
+                        _tokens.push_back(token);
+                        token.clear();
+                    }
+                    if (c=='(' or c==')')
+                    {
+                        _tokens.push_back(std::string(1,c));
+                    }
+                }
+                else
+                {
+                    token += c;
+                }
+            }
+            if (!token.empty())
+            {
+                _tokens.push_back(token);
+            }
+        }
+
+        inline bool accept(const char* token)
+        {
+            if (_position<_tokens.size() and _tokens[_position]==token)
+            {
+                ++_position;
+                return true;
+            }
+            return false;
+        }
+
+        void emit(OpCode op, unsigned int term=0)
+        {
+            Instruction instruction = {op,term};
+            _program.push_back(instruction);
+        }
+
+        void parseOr()
+        {
+            parseAnd();
+            while (accept("or"))
+            {
+                parseAnd();
+                emit(OR);
+            }
+        }
+
+        void parseAnd()
+        {
+            parseUnary();
+            while (accept("and"))
+            {
+                parseUnary();
+                emit(AND);
+            }
+        }
+
+        void parseUnary()
+        {
+            if (accept("not"))
+            {
+                parseUnary();
+                emit(NOT);
+                return;
+            }
+            if (accept("("))
+            {
+                parseOr();
+                if (!accept(")"))
+                {
+                    throw std::runtime_error("missing ')' in trigger expression");
+                }
+                return;
+            }
+            if (_position>=_tokens.size())
+            {
+                throw std::runtime_error("unexpected end of trigger expression");
+            }
+            const std::string& pattern = _tokens[_position];
+            if (pattern==")" or pattern=="and" or pattern=="or")
+            {
+                throw std::runtime_error("unexpected '"+pattern+"' in trigger expression");
+            }
+            ++_position;
+            emit(TERM,addPattern(pattern));
+        }
+
+    public:
+        TriggerExpression():
+            _position(0)
+        {
+        }
+
+        //glob match with '*' (any sequence) and '?' (any character)
+        static bool match(const std::string& pattern, const std::string& name)
+        {
+            size_t p = 0;
+            size_t n = 0;
+            size_t star = std::string::npos;
+            size_t backtrack = 0;
+            while (n<name.size())
+            {
+                if (p<pattern.size() and (pattern[p]=='?' or pattern[p]==name[n]))
+                {
+                    ++p;
+                    ++n;
+                }
+                else if (p<pattern.size() and pattern[p]=='*')
+                {
+                    star = p++;
+                    backtrack = n;
+                }
+                else if (star!=std::string::npos)
+                {
+                    p = star+1;
+                    n = ++backtrack;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            while (p<pattern.size() and pattern[p]=='*')
+            {
+                ++p;
+            }
+            return p==pattern.size();
+        }
+
+        static inline bool isPattern(const std::string& name)
+        {
+            return name.find_first_of("*?")!=std::string::npos;
+        }
+
+        //returns the index of the term; patterns are not duplicated
+        unsigned int addPattern(const std::string& pattern)
+        {
+            for (unsigned int iterm = 0; iterm < _patterns.size(); ++iterm)
+            {
+                if (_patterns[iterm]==pattern)
+                {
+                    return iterm;
+                }
+            }
+            if (_patterns.size()>=64)
+            {
+                throw std::runtime_error("more than 64 trigger patterns");
+            }
+            _patterns.push_back(pattern);
+            return _patterns.size()-1;
+        }
+
+        //throws std::runtime_error on invalid expressions
+        void compile(const std::string& expression)
+        {
+            _patterns.clear();
+            _program.clear();
+            tokenize(expression);
+            _position = 0;
+            if (_tokens.empty())
+            {
+                throw std::runtime_error("empty trigger expression");
+            }
+            parseOr();
+            if (_position!=_tokens.size())
+            {
+                throw std::runtime_error("unexpected '"+_tokens[_position]+"' in trigger expression");
+            }
+            _stack.resize(_program.size());
+        }
+
+        inline bool empty() const
+        {
+            return _program.empty();
+        }
+
+        inline const std::vector<std::string>& getPatterns() const
+        {
+            return _patterns;
+        }
+
+        //bit i of fired is set if term i has fired
+        bool evaluate(uint64_t fired) const
+        {
+            unsigned int size = 0;
+            for (const Instruction& instruction: _program)
+            {
+                switch (instruction.op)
+                {
+                    case TERM:
+                        _stack[size++] = (fired>>instruction.term) & 1;
+                        break;
+                    case NOT:
+                        _stack[size-1] = !_stack[size-1];
+                        break;
+                    case AND:
+                        --size;
+                        _stack[size-1] = _stack[size-1] && _stack[size];
+                        break;
+                    case OR:
+                        --size;
+                        _stack[size-1] = _stack[size-1] || _stack[size];
+                        break;
+                }
+            }
+            return _stack[0];
+        }
+};
+
+#endif
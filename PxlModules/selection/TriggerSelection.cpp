@@ -5,8 +5,36 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "utils/CutFlow.hpp"
+#include "utils/EventIndex.hpp"
+#include "utils/UserRecordKey.hpp"
+#include "utils/ModuleTimer.hpp"
+
+#include "TriggerExpression.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
 static pxl::Logger logger("TriggerSelection");
 
+/*
+* Selects events by the HLT flags stored as user records of the event view.
+* With 'cache trigger layout' the user records of the first event of each run
+* (event user record 'run record') are matched once against the requested
+* flags: the layout of the run holds a record handle and the bits of the
+* matching flags for each HLT record. The following events of the run are
+* decoded through these handles without comparing record names, and the
+* decision becomes a mask-and-compare on the fired bits. The layouts are kept
+* per run, so the HLT keys are only resolved again for a new run. Events
+* without the run record count as one run. Up to 64 flags are supported in
+* this mode.
+*
+* In this mode the flags can also be patterns with the wildcards '*' and '?'
+* (e.g. 'HLT_IsoMu24_eta2p1_IterTrk02_v*') or be replaced by a 'trigger
+* expression' (see TriggerExpression.hpp). The patterns are matched only when
+* the layout is built; a pattern has fired if any matching flag has fired.
+*/
 class TriggerSelection:
     public pxl::Module
 {
@@ -18,18 +46,56 @@ class TriggerSelection:
         std::vector<std::string> _triggerFlags;
         bool _requireAllFlags;
         bool _cleanNoneRequired;
+        bool _cacheLayout;
+        std::string _triggerExpressionString;
+        std::string _runRecordName;
+        
+        EventIndex::Key _inputEventViewKey;
+        UserRecordKey _runKey;
+        
+        TriggerExpression _triggerExpression;
+        //patterns or names of the bits in the layout
+        std::vector<std::string> _triggerPatterns;
+        
+        struct TriggerLayout
+        {
+            //user records matching at least one pattern
+            std::vector<UserRecordKey> records;
+            //bits of the patterns matching the record
+            std::vector<uint64_t> masks;
+            //HLT flags which are not requested
+            std::vector<std::string> dropped;
+        };
+        
+        std::unordered_map<uint64_t,TriggerLayout> _layouts;
+        const TriggerLayout* _layout;
+        uint64_t _layoutRun;
+        unsigned long _nLayoutBuilds;
+        std::vector<std::string> _dropped;
+        
+        std::string _cutFlowFile;
+        CutFlow _cutFlow;
+
+        ModuleTimer _timer;
 
     public:
         TriggerSelection():
             Module(),
             _inputEventViewName("Reconstructed"),
-            _triggerFlags({"HLT_IsoMu24_eta2p1_IterTrk02_v1","HLT_IsoMu24_IterTrk02_v1"}),
+            _triggerFlags({"HLT_IsoMu24_eta2p1_IterTrk02_v*","HLT_IsoMu24_IterTrk02_v*"}),
             _requireAllFlags(false),
-            _cleanNoneRequired(true)
+            _cleanNoneRequired(true),
+            _cacheLayout(true),
+            _runRecordName("Run"),
+            _layout(nullptr),
+            _layoutRun(0),
+            _nLayoutBuilds(0)
         {
             addSink("input", "input");
             _outputSource = addSource("selected","selected");
             _outputVetoSource = addSource("veto", "veto");
+            _cutFlow.addSource(_outputSource);
+            _cutFlow.addSource(_outputVetoSource);
 
             addOption("Event view","name of the event view",_inputEventViewName);
             addOption("required trigger flags","",_triggerFlags);
@@ -37,6 +103,11 @@ class TriggerSelection:
 
             addOption("require all","this option requires all triggers (if set to true) or at least one (if set to false) to be fired",_requireAllFlags);
             addOption("remove other HLT","this option removes all HLT* trigger flags which are not in the list",_cleanNoneRequired);
+            addOption("cache trigger layout","map the trigger flags to bits once and select by a bit mask",_cacheLayout);
+            addOption("trigger expression","e.g. 'HLT_A_v* or (HLT_B_v* and not HLT_C_v*)'; replaces the required trigger flags and 'require all' if not empty",_triggerExpressionString);
+            addOption("run record","event user record with the run number; the cached trigger layout is resolved once per run",_runRecordName);
+            
+            addOption("cut flow file","JSON file for the cut flows of the selection modules; empty to disable",_cutFlowFile);
         }
 
         ~TriggerSelection()
@@ -68,21 +139,81 @@ class TriggerSelection:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("Event view",_inputEventViewName);
             getOption("required trigger flags",_triggerFlags);
             getOption("require all",_requireAllFlags);
             getOption("remove other HLT",_cleanNoneRequired);
+            getOption("cache trigger layout",_cacheLayout);
+            getOption("trigger expression",_triggerExpressionString);
+            getOption("run record",_runRecordName);
+            
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _runKey = UserRecordKey(_runRecordName);
+            
+            bool hasPatterns = not _triggerExpressionString.empty();
+            for (const std::string& flag: _triggerFlags)
+            {
+                hasPatterns = hasPatterns or TriggerExpression::isPattern(flag);
+            }
+            if (_cacheLayout and _triggerFlags.size()>64 and _triggerExpressionString.empty())
+            {
+                if (hasPatterns)
+                {
+                    throw std::runtime_error(getName()+": trigger patterns are limited to 64 flags");
+                }
+                logger(pxl::LOG_LEVEL_WARNING,getName()+": more than 64 trigger flags; trigger layout is not cached");
+                _cacheLayout = false;
+            }
+            if (not _cacheLayout and hasPatterns)
+            {
+                throw std::runtime_error(getName()+": trigger patterns and expressions require 'cache trigger layout'");
+            }
+            
+            _triggerExpression = TriggerExpression();
+            if (_triggerExpressionString.empty())
+            {
+                _triggerPatterns = _triggerFlags;
+            }
+            else
+            {
+                try
+                {
+                    _triggerExpression.compile(_triggerExpressionString);
+                }
+                catch(std::exception &e)
+                {
+                    throw std::runtime_error(getName()+": "+e.what());
+                }
+                _triggerPatterns = _triggerExpression.getPatterns();
+            }
+            _layouts.clear();
+            _layout = nullptr;
+            _layoutRun = 0;
+            _nLayoutBuilds = 0;
+            
+            getOption("cut flow file",_cutFlowFile);
+            _cutFlow.setName(getName());
+            _cutFlow.setOutputFile(_cutFlowFile);
         }
 
         bool passTriggerSelection(pxl::EventView* eventView)
         {
             bool accepted = _requireAllFlags; //concatenate with AND if true. Otherwise with OR if false.
-            for (pxl::UserRecords::const_iterator it = eventView->getUserRecords().begin(); _cleanNoneRequired && it!=eventView->getUserRecords().end(); ++it)
+            if (_cleanNoneRequired)
             {
-                //std::cout<<"remove "<<it->first<<std::endl;
-                if (it->first.find("HLT")!=std::string::npos && std::find(_triggerFlags.begin(),_triggerFlags.end(),it->first)==_triggerFlags.end())
+                //erasing invalidates the iterators so the records are collected first
+                _dropped.clear();
+                for (pxl::UserRecords::const_iterator it = eventView->getUserRecords().begin(); it!=eventView->getUserRecords().end(); ++it)
+                {
+                    if (it->first.find("HLT")!=std::string::npos && std::find(_triggerFlags.begin(),_triggerFlags.end(),it->first)==_triggerFlags.end())
+                    {
+                        _dropped.push_back(it->first);
+                    }
+                }
+                for (const std::string& name: _dropped)
                 {
-                    eventView->getUserRecords().erase(it->first);
+                    eventView->getUserRecords().erase(name);
                 }
             }
             for (unsigned int itrigger = 0; itrigger<_triggerFlags.size(); ++itrigger)
@@ -110,30 +241,121 @@ class TriggerSelection:
             return accepted;
         }
 
+        void buildLayout(const pxl::UserRecords::ContainerType* records, TriggerLayout& layout)
+        {
+            layout.records.clear();
+            layout.masks.clear();
+            layout.dropped.clear();
+            for (pxl::UserRecords::ContainerType::const_iterator it = records->begin(); it!=records->end(); ++it)
+            {
+                uint64_t mask = 0;
+                for (unsigned int ipattern = 0; ipattern < _triggerPatterns.size(); ++ipattern)
+                {
+                    if (TriggerExpression::match(_triggerPatterns[ipattern],it->first))
+                    {
+                        mask |= uint64_t(1)<<ipattern;
+                    }
+                }
+                if (mask!=0)
+                {
+                    layout.records.push_back(UserRecordKey(it->first));
+                    layout.masks.push_back(mask);
+                }
+                else if (it->first.find("HLT")!=std::string::npos)
+                {
+                    layout.dropped.push_back(it->first);
+                }
+            }
+            ++_nLayoutBuilds;
+        }
+        
+        //returns the layout of the run of the event, building it from the event view for a new run
+        const TriggerLayout& getLayout(const pxl::Event* event, const pxl::EventView* eventView)
+        {
+            const pxl::Variant* runRecord = _runKey.find(event);
+            const uint64_t run = runRecord ? runRecord->toUInt64() : 0;
+            if (_layout and run==_layoutRun)
+            {
+                return *_layout;
+            }
+            std::unordered_map<uint64_t,TriggerLayout>::iterator it = _layouts.find(run);
+            if (it==_layouts.end())
+            {
+                it = _layouts.insert(std::make_pair(run,TriggerLayout())).first;
+                buildLayout(eventView->getUserRecords().getContainer(),it->second);
+            }
+            _layout = &it->second;
+            _layoutRun = run;
+            return *_layout;
+        }
+        
+        //one lookup per requested HLT record of the layout; flags missing in the event are not present
+        static void decodeTriggerBits(const TriggerLayout& layout, const pxl::EventView* eventView, uint64_t& fired, uint64_t& present)
+        {
+            fired = 0;
+            present = 0;
+            for (unsigned int irecord = 0; irecord < layout.records.size(); ++irecord)
+            {
+                const pxl::Variant* value = layout.records[irecord].find(eventView);
+                if (value)
+                {
+                    present |= layout.masks[irecord];
+                    if (static_cast<bool>(*value))
+                    {
+                        fired |= layout.masks[irecord];
+                    }
+                }
+            }
+        }
+        
+        bool passTriggerMask(const pxl::Event* event, pxl::EventView* eventView)
+        {
+            const TriggerLayout& layout = getLayout(event,eventView);
+            uint64_t fired = 0;
+            uint64_t present = 0;
+            decodeTriggerBits(layout,eventView,fired,present);
+            if (_cleanNoneRequired)
+            {
+                for (const std::string& name: layout.dropped)
+                {
+                    eventView->getUserRecords().erase(name);
+                }
+            }
+            if (not _triggerExpression.empty())
+            {
+                return _triggerExpression.evaluate(fired);
+            }
+            //flags which are not present are ignored as in passTriggerSelection
+            if (_requireAllFlags)
+            {
+                return (fired & present)==present;
+            }
+            return fired!=0;
+        }
+
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 if (event)
                 {
-                    std::vector<pxl::EventView*> eventViews;
-                    event->getObjectsOfType(eventViews);
+                    _cutFlow.beginEvent(event);
+                    EventIndex& index = EventIndex::get(event);
                     
-                    for (unsigned ieventView=0; ieventView<eventViews.size();++ieventView)
+                    for (unsigned ieventView=0; ieventView<index.getNEventViews();++ieventView)
                     {
-                        pxl::EventView* eventView = eventViews[ieventView];
-                        if (eventView->getName()==_inputEventViewName)
+                        pxl::EventView* eventView = index.getEventView(ieventView);
+                        if (index.getEventViewName(ieventView)==_inputEventViewKey)
                         {
-                            if (passTriggerSelection(eventView))
+                            if (_cacheLayout ? passTriggerMask(event,eventView) : passTriggerSelection(eventView))
                             {
-                                _outputSource->setTargets(event);
-                                return _outputSource->processTargets();
+                                return _cutFlow.send(_outputSource,event);
                             }
                             else
                             {
-                                _outputVetoSource->setTargets(event);
-                                return _outputVetoSource->processTargets();
+                                return _cutFlow.send(_outputVetoSource,event);
                             }
                         }
                     }
@@ -152,6 +374,16 @@ class TriggerSelection:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+            if (_cacheLayout)
+            {
+                logger(pxl::LOG_LEVEL_DEBUG,getName()+": trigger layout built for "+std::to_string(_nLayoutBuilds)+" runs");
+            }
+            _cutFlow.write();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
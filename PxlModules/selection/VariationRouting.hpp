@@ -0,0 +1,88 @@
+#ifndef __VARIATIONROUTING_H__
+#define __VARIATIONROUTING_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/modules/Module.hh"
+
+#include "utils/SystematicVariations.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+* Chooses the output of a selection module whose result depends on the
+* systematic variations, e.g. the number of selected jets. The module gives
+* the output of the nominal and of every variation; the event is sent to the
+* nominal output if it is accepted, otherwise to the first accepted output of
+* a variation in which the event is still selected. Without accepted outputs
+* all are accepted, i.e. the event is routed as nominal. The event user records
+* 'selected' and 'selected__<variation>' are cleared for the nominal and the
+* variations going to another output than the event (see SystematicVariations).
+*/
+class VariationRouting
+{
+    private:
+        std::vector<const pxl::Source*> _accepted;
+
+        bool isAccepted(const pxl::Source* output) const
+        {
+            return _accepted.empty() or std::find(_accepted.begin(),_accepted.end(),output)!=_accepted.end();
+        }
+
+    public:
+        //'names' are names of 'outputs'; an empty list accepts all outputs
+        void setAccepted(const std::vector<std::string>& names, const std::vector<std::pair<std::string,pxl::Source*>>& outputs)
+        {
+            _accepted.clear();
+            for (const std::string& name: names)
+            {
+                const pxl::Source* source = nullptr;
+                for (const std::pair<std::string,pxl::Source*>& output: outputs)
+                {
+                    if (output.first==name)
+                    {
+                        source = output.second;
+                    }
+                }
+                if (!source)
+                {
+                    throw std::runtime_error("unknown output '"+name+"' in the accepted outputs");
+                }
+                _accepted.push_back(source);
+            }
+        }
+
+        //'outputs' has the nominal output first and then one per variation
+        pxl::Source* route(pxl::Event* event, const std::vector<pxl::Source*>& outputs) const
+        {
+            const unsigned int nVariations = outputs.size()-1;
+            if (nVariations==0)
+            {
+                return outputs.front();
+            }
+            pxl::Source* routed = outputs.front();
+            if (!isAccepted(routed) or !SystematicVariations::isEventSelected(event,SystematicVariations::getSelectedKey()))
+            {
+                for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+                {
+                    if (isAccepted(outputs[ivariation+1]) and SystematicVariations::isEventSelected(event,SystematicVariations::getSelectedKey(ivariation)))
+                    {
+                        routed = outputs[ivariation+1];
+                        break;
+                    }
+                }
+            }
+            SystematicVariations::selectEvent(event,SystematicVariations::getSelectedKey(),outputs.front()==routed);
+            for (unsigned int ivariation = 0; ivariation < nVariations; ++ivariation)
+            {
+                SystematicVariations::selectEvent(event,SystematicVariations::getSelectedKey(ivariation),outputs[ivariation+1]==routed);
+            }
+            return routed;
+        }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+/*
+* Counts the heap allocations of each thread for the ModuleTimer. The library
+* is preloaded (LD_PRELOAD=libAllocationCounter.so) and interposes malloc,
+* calloc, realloc and posix_memalign; operator new of libstdc++ goes through
+* malloc. The allocations are forwarded to the glibc implementation. The
+* counter uses the initial-exec TLS model as the general dynamic model could
+* itself allocate on the first access.
+*/
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t n, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+
+    static __thread uint64_t allocationCount __attribute__((tls_model("initial-exec"))) = 0;
+
+    __attribute__((visibility("default"))) uint64_t pxlmodules_allocation_count()
+    {
+        return allocationCount;
+    }
+
+    __attribute__((visibility("default"))) void* malloc(size_t size)
+    {
+        ++allocationCount;
+        return __libc_malloc(size);
+    }
+
+    __attribute__((visibility("default"))) void* calloc(size_t n, size_t size)
+    {
+        ++allocationCount;
+        return __libc_calloc(n,size);
+    }
+
+    __attribute__((visibility("default"))) void* realloc(void* pointer, size_t size)
+    {
+        ++allocationCount;
+        return __libc_realloc(pointer,size);
+    }
+
+    __attribute__((visibility("default"))) int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        ++allocationCount;
+        *pointer = __libc_memalign(alignment,size);
+        return *pointer ? 0 : ENOMEM;
+    }
+}
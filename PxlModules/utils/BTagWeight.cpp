@@ -0,0 +1,424 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "BinnedTable.hpp"
+#include "EventIndex.hpp"
+#include "UserRecordKey.hpp"
+#include "ModuleTimer.hpp"
+
+#include <TFile.h>
+#include <TH2.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+
+static pxl::Logger logger("BTagWeight");
+
+//upper limit of the MC efficiency of untagged jets, for which the factor (1-SF*eff)/(1-eff) diverges
+static const double MAX_EFFICIENCY = 0.999;
+
+/*
+* Event weight for the b-tagging scale factors of the selected jets. With the
+* scale factor SF and the MC efficiency eff of each jet the weight is
+*   prod_tagged SF * prod_untagged (1-SF*eff)/(1-eff)
+* The scale factors are read from a CSV file with the columns
+*   flavour,etaMin,etaMax,ptMin,ptMax,SF,SFdown,SFup
+* and the efficiencies from a CSV file with the columns
+*   flavour,etaMin,etaMax,ptMin,ptMax,efficiency
+* or from a ROOT file with one TH2 (x: pt, y: |eta|) per flavour named 'b',
+* 'c' and 'udsg'. The flavour is 'b', 'c', 'udsg' or the hadron flavour (5, 4,
+* everything else is light); each flavour has its own binning. Jets outside
+* of the tables get the values of the closest bin. Efficiencies of untagged
+* jets are clamped to 0.999 with a warning per bin. The weights with the
+* up/down variations of the scale factors of heavy (b, c) and light jets are
+* stored as separate user records.
+*/
+class BTagWeight:
+    public pxl::Module
+{
+    private:
+        enum Flavour
+        {
+            B=0,C=1,LIGHT=2,NFLAVOURS
+        };
+
+        enum Variation
+        {
+            NOMINAL=0,HEAVY_UP,HEAVY_DOWN,LIGHT_UP,LIGHT_DOWN,NVARIATIONS
+        };
+
+        pxl::Source* _outputSource;
+
+        std::string _inputEventViewName;
+        std::string _taggedJetName;
+        std::string _untaggedJetName;
+        std::string _flavourName;
+        std::string _scaleFactorFile;
+        std::string _efficiencyFile;
+        std::string _weightName;
+
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _taggedJetKey;
+        EventIndex::Key _untaggedJetKey;
+        UserRecordKey _flavourKey;
+
+        //per flavour in |eta| and pt; values per bin: SF, SF down, SF up
+        BinnedTable _scaleFactors[NFLAVOURS];
+        //per flavour in |eta| and pt; values per bin: efficiency
+        BinnedTable _efficiencies[NFLAVOURS];
+
+        std::string _weightNames[NVARIATIONS];
+
+        //efficiency bins >= 1 which have been reported; their efficiency is clamped
+        mutable std::set<const double*> _clampedBins;
+
+        ModuleTimer _timer;
+
+    public:
+        BTagWeight():
+            Module(),
+            _inputEventViewName("Reconstructed"),
+            _taggedJetName("SelectedBJet"),
+            _untaggedJetName("SelectedJet"),
+            _flavourName("partonFlavour"),
+            _weightName("btag_weight")
+        {
+            addSink("input", "input");
+            _outputSource = addSource("output","output");
+
+            addOption("event view","name of the event view with the jets",_inputEventViewName);
+            addOption("name of b-tagged jets","",_taggedJetName);
+            addOption("name of untagged jets","",_untaggedJetName);
+            addOption("flavour user record","user record of the jets holding the flavour",_flavourName);
+            addOption("scale factor file","CSV file with flavour,etaMin,etaMax,ptMin,ptMax,SF,SFdown,SFup",_scaleFactorFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("efficiency file","CSV file with flavour,etaMin,etaMax,ptMin,ptMax,efficiency or ROOT file with TH2 'b', 'c', 'udsg'",_efficiencyFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("weight name","name of the event user record; variations get the suffixes _heavy_up, _heavy_down, _light_up, _light_down",_weightName);
+        }
+
+        ~BTagWeight()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("BTagWeight");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        static Flavour parseFlavour(const std::string& flavour)
+        {
+            if (flavour=="b")
+            {
+                return B;
+            }
+            if (flavour=="c")
+            {
+                return C;
+            }
+            if (flavour=="udsg")
+            {
+                return LIGHT;
+            }
+            char* end = nullptr;
+            const long pdgId = strtol(flavour.c_str(),&end,10);
+            if (flavour.empty() or *end!=0)
+            {
+                throw std::runtime_error("invalid flavour '"+flavour+"'");
+            }
+            return getFlavour(pdgId);
+        }
+
+        static const char* getFlavourName(Flavour flavour)
+        {
+            static const char* names[] = {"b","c","udsg"};
+            return names[flavour];
+        }
+
+        static inline Flavour getFlavour(long pdgId)
+        {
+            switch (std::abs(pdgId))
+            {
+                case 5:
+                    return B;
+                case 4:
+                    return C;
+                default:
+                    return LIGHT;
+            }
+        }
+
+        //rows of flavour,etaMin,etaMax,ptMin,ptMax followed by nValues values; '#' starts a comment
+        static void readCSV(const std::string& fileName, unsigned int nValues, BinnedTable* tables)
+        {
+            std::ifstream file(fileName.c_str());
+            if (!file)
+            {
+                throw std::runtime_error("cannot open file '"+fileName+"'");
+            }
+            std::vector<BinnedTable::Row> rows[NFLAVOURS];
+            std::string line;
+            unsigned int nline = 0;
+            while (std::getline(file,line))
+            {
+                ++nline;
+                line = line.substr(0,line.find('#'));
+                if (line.find_first_not_of(" \t\r")==std::string::npos)
+                {
+                    continue;
+                }
+                std::vector<std::string> columns;
+                std::istringstream ss(line);
+                std::string column;
+                while (std::getline(ss,column,','))
+                {
+                    const size_t begin = column.find_first_not_of(" \t\r");
+                    const size_t end = column.find_last_not_of(" \t\r");
+                    columns.push_back(begin==std::string::npos ? "" : column.substr(begin,end-begin+1));
+                }
+                std::ostringstream where;
+                where<<fileName<<":"<<nline;
+                if (columns.size()!=5+nValues)
+                {
+                    throw std::runtime_error(where.str()+": expected "+std::to_string(5+nValues)+" columns");
+                }
+                //header line
+                if (nline==1 and columns[0]=="flavour")
+                {
+                    continue;
+                }
+                std::vector<double> numbers;
+                for (unsigned int icolumn = 1; icolumn < columns.size(); ++icolumn)
+                {
+                    char* end = nullptr;
+                    numbers.push_back(strtod(columns[icolumn].c_str(),&end));
+                    if (columns[icolumn].empty() or *end!=0)
+                    {
+                        throw std::runtime_error(where.str()+": invalid number '"+columns[icolumn]+"'");
+                    }
+                }
+                BinnedTable::Row row;
+                row.min = {numbers[0],numbers[2]};
+                row.max = {numbers[1],numbers[3]};
+                row.values.assign(numbers.begin()+4,numbers.end());
+                rows[parseFlavour(columns[0])].push_back(row);
+            }
+            for (unsigned int iflavour = B; iflavour < NFLAVOURS; ++iflavour)
+            {
+                if (rows[iflavour].empty())
+                {
+                    throw std::runtime_error("no entries for flavour "+std::string(getFlavourName(Flavour(iflavour)))+" in file '"+fileName+"'");
+                }
+                tables[iflavour] = BinnedTable::fromRows(rows[iflavour],2,nValues);
+            }
+        }
+
+        static void readEfficiencyHistograms(const std::string& fileName, BinnedTable* tables)
+        {
+            std::unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+            if (!file or file->IsZombie())
+            {
+                throw std::runtime_error("cannot open file '"+fileName+"'");
+            }
+            for (unsigned int iflavour = B; iflavour < NFLAVOURS; ++iflavour)
+            {
+                const std::string histogramName = getFlavourName(Flavour(iflavour));
+                TH2* histogram = dynamic_cast<TH2*>(file->Get(histogramName.c_str()));
+                if (!histogram)
+                {
+                    throw std::runtime_error("no TH2 '"+histogramName+"' in file '"+fileName+"'");
+                }
+                std::vector<BinnedTable::Row> rows;
+                const TAxis* ptAxis = histogram->GetXaxis();
+                const TAxis* etaAxis = histogram->GetYaxis();
+                for (int ipt = 1; ipt <= ptAxis->GetNbins(); ++ipt)
+                {
+                    for (int ieta = 1; ieta <= etaAxis->GetNbins(); ++ieta)
+                    {
+                        BinnedTable::Row row;
+                        row.min = {etaAxis->GetBinLowEdge(ieta),ptAxis->GetBinLowEdge(ipt)};
+                        row.max = {etaAxis->GetBinUpEdge(ieta),ptAxis->GetBinUpEdge(ipt)};
+                        row.values = {histogram->GetBinContent(ipt,ieta)};
+                        rows.push_back(row);
+                    }
+                }
+                tables[iflavour] = BinnedTable::fromRows(rows,2,1);
+            }
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("event view",_inputEventViewName);
+            getOption("name of b-tagged jets",_taggedJetName);
+            getOption("name of untagged jets",_untaggedJetName);
+            getOption("flavour user record",_flavourName);
+            getOption("scale factor file",_scaleFactorFile);
+            getOption("efficiency file",_efficiencyFile);
+            getOption("weight name",_weightName);
+
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _taggedJetKey = EventIndex::intern(_taggedJetName);
+            _untaggedJetKey = EventIndex::intern(_untaggedJetName);
+            _flavourKey = UserRecordKey(_flavourName);
+
+            _weightNames[NOMINAL] = _weightName;
+            _weightNames[HEAVY_UP] = _weightName+"_heavy_up";
+            _weightNames[HEAVY_DOWN] = _weightName+"_heavy_down";
+            _weightNames[LIGHT_UP] = _weightName+"_light_up";
+            _weightNames[LIGHT_DOWN] = _weightName+"_light_down";
+
+            try
+            {
+                readCSV(_scaleFactorFile,3,_scaleFactors);
+                const std::string extension = ".root";
+                if (_efficiencyFile.size()>=extension.size() and _efficiencyFile.compare(_efficiencyFile.size()-extension.size(),extension.size(),extension)==0)
+                {
+                    readEfficiencyHistograms(_efficiencyFile,_efficiencies);
+                }
+                else
+                {
+                    readCSV(_efficiencyFile,1,_efficiencies);
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+        }
+
+        //multiplies the weights of all variations by the factors of the jets
+        void multiplyWeights(const std::vector<pxl::Particle*>& jets, bool tagged, double* weights) const
+        {
+            for (const pxl::Particle* jet: jets)
+            {
+                const Flavour flavour = getFlavour(_flavourKey.get(jet).toInt32());
+                const double absEta = std::fabs(jet->getEta());
+                const double pt = jet->getPt();
+                //SF, SF down, SF up
+                const double* scaleFactor = _scaleFactors[flavour].lookup(absEta,pt);
+
+                double factors[3];
+                if (tagged)
+                {
+                    factors[0] = scaleFactor[0];
+                    factors[1] = scaleFactor[1];
+                    factors[2] = scaleFactor[2];
+                }
+                else
+                {
+                    const double* bin = _efficiencies[flavour].lookup(absEta,pt);
+                    double efficiency = bin[0];
+                    if (not (efficiency<MAX_EFFICIENCY))
+                    {
+                        //an untagged jet in a bin with efficiency 1 points to a broken efficiency map
+                        if (_clampedBins.insert(bin).second)
+                        {
+                            logger(pxl::LOG_LEVEL_WARNING,"MC efficiency ",efficiency," >= ",MAX_EFFICIENCY," for flavour ",getFlavourName(flavour)," at |eta|=",absEta,", pt=",pt,"; clamped for this bin");
+                        }
+                        efficiency = MAX_EFFICIENCY;
+                    }
+                    for (unsigned int ifactor = 0; ifactor < 3; ++ifactor)
+                    {
+                        factors[ifactor] = (1.0-scaleFactor[ifactor]*efficiency)/(1.0-efficiency);
+                    }
+                }
+
+                weights[NOMINAL] *= factors[0];
+                if (flavour==LIGHT)
+                {
+                    weights[HEAVY_UP] *= factors[0];
+                    weights[HEAVY_DOWN] *= factors[0];
+                    weights[LIGHT_UP] *= factors[2];
+                    weights[LIGHT_DOWN] *= factors[1];
+                }
+                else
+                {
+                    weights[HEAVY_UP] *= factors[2];
+                    weights[HEAVY_DOWN] *= factors[1];
+                    weights[LIGHT_UP] *= factors[0];
+                    weights[LIGHT_DOWN] *= factors[0];
+                }
+            }
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    const EventIndex& index = EventIndex::get(event);
+                    const pxl::EventView* eventView = index.findEventView(_inputEventViewKey);
+
+                    double weights[NVARIATIONS] = {1,1,1,1,1};
+                    if (eventView)
+                    {
+                        multiplyWeights(index.getParticles(eventView,_taggedJetKey),true,weights);
+                        multiplyWeights(index.getParticles(eventView,_untaggedJetKey),false,weights);
+                    }
+                    for (unsigned int ivariation = 0; ivariation < NVARIATIONS; ++ivariation)
+                    {
+                        event->setUserRecord(_weightNames[ivariation],weights[ivariation]);
+                    }
+
+                    _outputSource->setTargets(event);
+                    return _outputSource->processTargets();
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(BTagWeight)
+PXL_PLUGIN_INIT
@@ -0,0 +1,266 @@
+#ifndef __BINNEDTABLE_H__
+#define __BINNEDTABLE_H__
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* Lookup table with a fixed number of values per bin in several dimensions.
+* All values are stored in one flat array; the bin in each dimension is found
+* by index arithmetic if the bins are of equal width and by a binary search
+* over the edges otherwise. Coordinates outside the table are clamped to the
+* first/last bin. Looking up values does not allocate.
+*/
+class BinnedTable
+{
+    public:
+        class Axis
+        {
+            private:
+                std::vector<double> _edges;
+                bool _uniform;
+                double _min;
+                double _inverseWidth;
+
+            public:
+                Axis():
+                    _uniform(false),
+                    _min(0),
+                    _inverseWidth(0)
+                {
+                }
+
+                //edges have to be strictly increasing
+                Axis(const std::vector<double>& edges):
+                    _edges(edges),
+                    _uniform(true),
+                    _min(0),
+                    _inverseWidth(0)
+                {
+                    if (_edges.size()<2)
+                    {
+                        throw std::runtime_error("an axis needs at least two bin edges");
+                    }
+                    for (unsigned int iedge = 1; iedge < _edges.size(); ++iedge)
+                    {
+                        if (not (_edges[iedge]>_edges[iedge-1]))
+                        {
+                            throw std::runtime_error("bin edges are not increasing");
+                        }
+                    }
+                    const double width = (_edges.back()-_edges.front())/getNBins();
+                    for (unsigned int iedge = 1; iedge < _edges.size(); ++iedge)
+                    {
+                        if (std::fabs(_edges[iedge]-_edges[iedge-1]-width)>1e-9*width)
+                        {
+                            _uniform = false;
+                        }
+                    }
+                    _min = _edges.front();
+                    _inverseWidth = 1.0/width;
+                }
+
+                inline unsigned int getNBins() const
+                {
+                    return _edges.size()-1;
+                }
+
+                inline const std::vector<double>& getEdges() const
+                {
+                    return _edges;
+                }
+
+                inline unsigned int findBin(double x) const
+                {
+                    if (not (x>_edges.front()))
+                    {
+                        return 0;
+                    }
+                    if (x>=_edges.back())
+                    {
+                        return getNBins()-1;
+                    }
+                    if (_uniform)
+                    {
+                        //guard against rounding at the upper edge
+                        return std::min<unsigned int>((x-_min)*_inverseWidth,getNBins()-1);
+                    }
+                    return std::upper_bound(_edges.begin(),_edges.end(),x)-_edges.begin()-1;
+                }
+        };
+
+        //a box in all dimensions (lower edge inclusive) with its values
+        struct Row
+        {
+            std::vector<double> min;
+            std::vector<double> max;
+            std::vector<double> values;
+        };
+
+    private:
+        std::vector<Axis> _axes;
+        std::vector<unsigned int> _strides;
+        unsigned int _nValues;
+        std::vector<double> _values;
+
+    public:
+        BinnedTable():
+            _nValues(0)
+        {
+        }
+
+        BinnedTable(const std::vector<Axis>& axes, unsigned int nValues):
+            _axes(axes),
+            _nValues(nValues)
+        {
+            unsigned int nBins = 1;
+            _strides.resize(_axes.size());
+            for (unsigned int iaxis = _axes.size(); iaxis > 0; --iaxis)
+            {
+                _strides[iaxis-1] = nBins;
+                nBins *= _axes[iaxis-1].getNBins();
+            }
+            _values.assign(nBins*_nValues,NAN);
+        }
+
+        //builds the binning from the edges of all rows; throws if a bin is not covered by any row
+        static BinnedTable fromRows(const std::vector<Row>& rows, unsigned int nDimensions, unsigned int nValues)
+        {
+            if (rows.empty())
+            {
+                throw std::runtime_error("no rows to fill the table");
+            }
+            std::vector<Axis> axes;
+            for (unsigned int idimension = 0; idimension < nDimensions; ++idimension)
+            {
+                std::vector<double> edges;
+                for (const Row& row: rows)
+                {
+                    if (row.min.size()!=nDimensions or row.max.size()!=nDimensions or row.values.size()!=nValues)
+                    {
+                        throw std::runtime_error("row has wrong number of columns");
+                    }
+                    edges.push_back(row.min[idimension]);
+                    edges.push_back(row.max[idimension]);
+                }
+                std::sort(edges.begin(),edges.end());
+                edges.erase(std::unique(edges.begin(),edges.end()),edges.end());
+                axes.push_back(Axis(edges));
+            }
+
+            BinnedTable table(axes,nValues);
+            std::vector<unsigned int> first(nDimensions);
+            std::vector<unsigned int> last(nDimensions);
+            std::vector<unsigned int> bin(nDimensions);
+            for (const Row& row: rows)
+            {
+                for (unsigned int idimension = 0; idimension < nDimensions; ++idimension)
+                {
+                    const std::vector<double>& edges = axes[idimension].getEdges();
+                    first[idimension] = std::lower_bound(edges.begin(),edges.end(),row.min[idimension])-edges.begin();
+                    last[idimension] = std::lower_bound(edges.begin(),edges.end(),row.max[idimension])-edges.begin();
+                    if (first[idimension]>=last[idimension])
+                    {
+                        throw std::runtime_error("row with empty range");
+                    }
+                }
+                //loop over all bins of the box
+                bin = first;
+                bool done = false;
+                while (not done)
+                {
+                    unsigned int index = 0;
+                    for (unsigned int idimension = 0; idimension < nDimensions; ++idimension)
+                    {
+                        index += bin[idimension]*table._strides[idimension];
+                    }
+                    std::copy(row.values.begin(),row.values.end(),table._values.begin()+index*nValues);
+
+                    done = true;
+                    for (unsigned int idimension = nDimensions; idimension > 0; --idimension)
+                    {
+                        if (++bin[idimension-1]<last[idimension-1])
+                        {
+                            done = false;
+                            break;
+                        }
+                        bin[idimension-1] = first[idimension-1];
+                    }
+                }
+            }
+            for (unsigned int index = 0; index < table._values.size(); index += nValues)
+            {
+                if (std::isnan(table._values[index]))
+                {
+                    std::ostringstream message;
+                    message<<"bin "<<index/nValues<<" of the table is not covered by any row";
+                    throw std::runtime_error(message.str());
+                }
+            }
+            return table;
+        }
+
+        inline unsigned int getNDimensions() const
+        {
+            return _axes.size();
+        }
+
+        inline unsigned int getNValues() const
+        {
+            return _nValues;
+        }
+
+        inline const Axis& getAxis(unsigned int iaxis) const
+        {
+            return _axes[iaxis];
+        }
+
+        //x has to hold one coordinate per dimension
+        inline unsigned int findBin(const double* x) const
+        {
+            unsigned int index = 0;
+            for (unsigned int iaxis = 0; iaxis < _axes.size(); ++iaxis)
+            {
+                index += _axes[iaxis].findBin(x[iaxis])*_strides[iaxis];
+            }
+            return index;
+        }
+
+        inline const double* getValues(unsigned int bin) const
+        {
+            return &_values[bin*_nValues];
+        }
+
+        inline double* getValues(unsigned int bin)
+        {
+            return &_values[bin*_nValues];
+        }
+
+        inline const double* lookup(const double* x) const
+        {
+            return getValues(findBin(x));
+        }
+
+        inline const double* lookup(double x) const
+        {
+            return getValues(_axes[0].findBin(x));
+        }
+
+        inline const double* lookup(double x, double y) const
+        {
+            const double coordinates[2] = {x,y};
+            return lookup(coordinates);
+        }
+
+        inline const double* lookup(double x, double y, double z) const
+        {
+            const double coordinates[3] = {x,y,z};
+            return lookup(coordinates);
+        }
+};
+
+#endif
@@ -0,0 +1,347 @@
+#ifndef __CUTFLOW_H__
+#define __CUTFLOW_H__
+
+#include "pxl/core.hh"
+#include "pxl/modules/Module.hh"
+
+#include "UserRecordKey.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Counters of a selection module: number of events, events sent to each
+* source and objects rejected by each cut, each also summed with the event
+* weight ('mc_weight' if present, otherwise 1).
+*
+* Counting goes to a buffer of the calling thread without locking; the buffers
+* are merged under a mutex when the totals are requested. The buffer is looked
+* up once per event in beginEvent, hence an instance must not be used by
+* several threads at the same time (clones of a module chain have their own
+* modules). All cut flows are registered in a process wide list so that the
+* cut flows of all modules using the same output file go into one JSON file.
+* Every module calls write() in endJob; the file is written once, by the last
+* cut flow of that file. Cut flows with the same name (clones of a module in
+* parallel chains) are summed.
+*/
+class CutFlow
+{
+    public:
+        typedef unsigned int Counter;
+
+        enum Group
+        {
+            EVENTS,SOURCES,OBJECTS
+        };
+
+    private:
+        struct Shard
+        {
+            std::vector<uint64_t> entries;
+            std::vector<double> weights;
+            //weight of the current event
+            double weight;
+            std::thread::id thread;
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<const CutFlow*> cutFlows;
+        };
+
+        std::string _name;
+        std::string _outputFile;
+        UserRecordKey _weightKey;
+
+        std::vector<std::string> _names;
+        std::vector<Group> _groups;
+        std::vector<std::pair<const pxl::Source*,Counter>> _sources;
+        Counter _eventCounter;
+        //write() has been called; guarded by the registry mutex
+        bool _finished;
+
+        mutable std::mutex _mutex;
+        std::vector<std::unique_ptr<Shard>> _shards;
+        //buffer of the thread processing the current event
+        Shard* _shard;
+
+        static Registry& getRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        Shard& getShard()
+        {
+            const std::thread::id thread = std::this_thread::get_id();
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const std::unique_ptr<Shard>& shard: _shards)
+            {
+                if (shard->thread==thread)
+                {
+                    return *shard;
+                }
+            }
+            _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+            Shard* shard = _shards.back().get();
+            shard->weight = 1;
+            shard->thread = thread;
+            return *shard;
+        }
+
+        static std::string escape(const std::string& s)
+        {
+            std::string escaped;
+            for (char c: s)
+            {
+                if (c=='"' or c=='\\')
+                {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        //clones have the same counters
+        void writeJSON(std::ostream& os, const std::vector<const CutFlow*>& clones) const
+        {
+            std::vector<uint64_t> entries(_names.size(),0);
+            std::vector<double> weights(_names.size(),0);
+            for (const CutFlow* clone: clones)
+            {
+                std::vector<uint64_t> cloneEntries;
+                std::vector<double> cloneWeights;
+                clone->getTotals(cloneEntries,cloneWeights);
+                for (Counter counter = 0; counter < _names.size() and counter < cloneEntries.size(); ++counter)
+                {
+                    entries[counter] += cloneEntries[counter];
+                    weights[counter] += cloneWeights[counter];
+                }
+            }
+
+            static const char* groupNames[] = {"events","sources","objects"};
+            os<<"  \""<<escape(_name)<<"\": {\n";
+            bool firstGroup = true;
+            for (unsigned int igroup = EVENTS; igroup <= OBJECTS; ++igroup)
+            {
+                bool first = true;
+                for (Counter counter = 0; counter < _names.size(); ++counter)
+                {
+                    if (_groups[counter]!=igroup)
+                    {
+                        continue;
+                    }
+                    if (first)
+                    {
+                        os<<(firstGroup ? "" : ",\n")<<"    \""<<groupNames[igroup]<<"\": {\n";
+                        firstGroup = false;
+                    }
+                    char values[128];
+                    snprintf(values,sizeof(values),"{\"entries\": %llu, \"weighted\": %.10g}",(unsigned long long)entries[counter],weights[counter]);
+                    os<<(first ? "" : ",\n")<<"      \""<<escape(_names[counter])<<"\": "<<values;
+                    first = false;
+                }
+                if (!first)
+                {
+                    os<<"\n    }";
+                }
+            }
+            os<<"\n  }";
+        }
+
+        CutFlow(const CutFlow&);
+        CutFlow& operator=(const CutFlow&);
+
+    public:
+        CutFlow(const std::string& weightName="mc_weight"):
+            _weightKey(weightName),
+            _finished(false),
+            _shard(nullptr)
+        {
+            _eventCounter = addCounter(EVENTS,"events");
+            Registry& registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.cutFlows.push_back(this);
+        }
+
+        ~CutFlow()
+        {
+            Registry& registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (std::vector<const CutFlow*>::iterator it = registry.cutFlows.begin(); it != registry.cutFlows.end(); ++it)
+            {
+                if (*it==this)
+                {
+                    registry.cutFlows.erase(it);
+                    break;
+                }
+            }
+        }
+
+        //name used in the output, e.g. the module name
+        inline void setName(const std::string& name)
+        {
+            _name = name;
+        }
+
+        //empty disables writing
+        inline void setOutputFile(const std::string& outputFile)
+        {
+            Registry& registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            _outputFile = outputFile;
+            _finished = false;
+        }
+
+        Counter addCounter(Group group, const std::string& name)
+        {
+            _names.push_back(name);
+            _groups.push_back(group);
+            return _names.size()-1;
+        }
+
+        //returns the counter of this group and name, adding it if it does not exist yet
+        Counter getCounter(Group group, const std::string& name)
+        {
+            for (Counter counter = 0; counter < _names.size(); ++counter)
+            {
+                if (_groups[counter]==group and _names[counter]==name)
+                {
+                    return counter;
+                }
+            }
+            return addCounter(group,name);
+        }
+
+        //counts the events sent to the source by send; adding a source again returns its counter
+        Counter addSource(const pxl::Source* source)
+        {
+            for (const std::pair<const pxl::Source*,Counter>& entry: _sources)
+            {
+                if (entry.first==source)
+                {
+                    return entry.second;
+                }
+            }
+            const Counter counter = addCounter(SOURCES,source->getName());
+            _sources.push_back(std::make_pair(source,counter));
+            return counter;
+        }
+
+        //counts the event and takes its weight for all following counts
+        void beginEvent(const pxl::Event* event)
+        {
+            _shard = &getShard();
+            const pxl::Variant* weight = _weightKey.find(event);
+            _shard->weight = weight ? weight->toDouble() : 1.0;
+            count(_eventCounter);
+        }
+
+        inline void count(Counter counter)
+        {
+            Shard& shard = _shard ? *_shard : getShard();
+            if (counter>=shard.entries.size())
+            {
+                shard.entries.resize(_names.size(),0);
+                shard.weights.resize(_names.size(),0);
+            }
+            ++shard.entries[counter];
+            shard.weights[counter] += shard.weight;
+        }
+
+        //counts a rejected object; returns false to be used as 'return _cutFlow.reject(...)'
+        inline bool reject(Counter counter)
+        {
+            count(counter);
+            return false;
+        }
+
+        //counts and processes the event with the targets of the source
+        bool send(pxl::Source* source, pxl::Event* event)
+        {
+            for (const std::pair<const pxl::Source*,Counter>& entry: _sources)
+            {
+                if (entry.first==source)
+                {
+                    count(entry.second);
+                    break;
+                }
+            }
+            source->setTargets(event);
+            return source->processTargets();
+        }
+
+        //sums the buffers of all threads
+        void getTotals(std::vector<uint64_t>& entries, std::vector<double>& weights) const
+        {
+            entries.assign(_names.size(),0);
+            weights.assign(_names.size(),0);
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const std::unique_ptr<Shard>& shard: _shards)
+            {
+                for (Counter counter = 0; counter < shard->entries.size(); ++counter)
+                {
+                    entries[counter] += shard->entries[counter];
+                    weights[counter] += shard->weights[counter];
+                }
+            }
+        }
+
+        //writes the cut flows of all modules with the same output file once all of them have called write
+        void write()
+        {
+            if (_outputFile.empty())
+            {
+                return;
+            }
+            Registry& registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            _finished = true;
+            for (const CutFlow* cutFlow: registry.cutFlows)
+            {
+                if (cutFlow->_outputFile==_outputFile and not cutFlow->_finished)
+                {
+                    return;
+                }
+            }
+            std::ofstream file(_outputFile.c_str());
+            if (!file)
+            {
+                throw std::runtime_error("cannot open cut flow file '"+_outputFile+"'");
+            }
+            file<<"{\n";
+            bool first = true;
+            std::vector<std::string> written;
+            for (const CutFlow* cutFlow: registry.cutFlows)
+            {
+                if (cutFlow->_outputFile!=_outputFile or std::find(written.begin(),written.end(),cutFlow->_name)!=written.end())
+                {
+                    continue;
+                }
+                std::vector<const CutFlow*> clones;
+                for (const CutFlow* clone: registry.cutFlows)
+                {
+                    if (clone->_outputFile==_outputFile and clone->_name==cutFlow->_name)
+                    {
+                        clones.push_back(clone);
+                    }
+                }
+                written.push_back(cutFlow->_name);
+                file<<(first ? "" : ",\n");
+                cutFlow->writeJSON(file,clones);
+                first = false;
+            }
+            file<<"\n}\n";
+        }
+};
+
+#endif
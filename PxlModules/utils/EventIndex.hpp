@@ -0,0 +1,516 @@
+#ifndef __EVENTINDEX_H__
+#define __EVENTINDEX_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+* Index of the event views of a pxl::Event and of their particles by interned
+* (event view name, particle name) keys. It is built with a single scan by the
+* first module asking for it and then shared by all following modules of the
+* chain: the instance is a thread local static inside an inline function, which
+* is a unique symbol shared by all plugins loaded into the process.
+*
+* All modules which rename, remove or create particles or event views have to
+* do so through the index (setName, removeObject, insertObject, create,
+* createEventView) to keep it valid. get() only checks that the event is the
+* same (address and id) and does not look at the objects, so that the event is
+* scanned once per event instead of once per module. A module changing the
+* event directly through PXL (including Python modules in the chain) has to
+* call EventIndex::markChanged(event) afterwards; otherwise the following
+* modules see stale particles.
+*
+* The generation is increased by every rebuild and every change through the
+* index; caches derived from the index (EventSnapshot) compare it to detect
+* that the particles have changed since they were filled. Each (event view,
+* particle name) collection additionally remembers the generation of its last
+* change, so that a cache of some collections stays valid while other
+* particles are created. getStatistics counts
+* the requests, rebuilds and scanned objects of the calling thread.
+*/
+class EventIndex
+{
+    public:
+        typedef unsigned int Key;
+        //called before a particle is removed through the index
+        typedef void (*RemoveHook)(const pxl::Particle* particle);
+
+    private:
+        struct Bucket
+        {
+            Key name;
+            //generation of the last change of the bucket
+            uint64_t generation;
+            std::vector<pxl::Particle*> particles;
+            //position in the event view; keeps the object order when particles are renamed
+            std::vector<unsigned int> ordinals;
+        };
+
+        struct ViewEntry
+        {
+            pxl::EventView* eventView;
+            Key name;
+            unsigned int nextOrdinal;
+            //buckets are reused between events; only the first nBuckets are in use
+            std::vector<Bucket> buckets;
+            unsigned int nBuckets;
+        };
+
+        struct NameTable
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string,Key> keys;
+            std::deque<std::string> names;
+        };
+
+        const pxl::Event* _event;
+        pxl::Id _eventId;
+        bool _valid;
+        uint64_t _generation;
+
+        uint64_t _nRequests;
+        uint64_t _nBuilds;
+        uint64_t _nScannedObjects;
+
+        //entries are reused between events; only the first _nViews are in use
+        std::vector<ViewEntry> _views;
+        unsigned int _nViews;
+
+        std::vector<pxl::EventView*> _eventViewBuffer;
+        std::vector<pxl::Particle*> _particleBuffer;
+
+        static NameTable& getNameTable()
+        {
+            static NameTable table;
+            return table;
+        }
+
+        static const std::vector<pxl::Particle*>& getEmpty()
+        {
+            static const std::vector<pxl::Particle*> empty;
+            return empty;
+        }
+
+        EventIndex():
+            _event(nullptr),
+            _valid(false),
+            _generation(0),
+            _nRequests(0),
+            _nBuilds(0),
+            _nScannedObjects(0),
+            _nViews(0)
+        {
+        }
+
+        EventIndex(const EventIndex&);
+        EventIndex& operator=(const EventIndex&);
+
+        static EventIndex& getInstance()
+        {
+            static thread_local EventIndex index;
+            return index;
+        }
+
+        static RemoveHook& getRemoveHook()
+        {
+            static RemoveHook hook = nullptr;
+            return hook;
+        }
+
+        ViewEntry* findView(const pxl::EventView* eventView)
+        {
+            for (unsigned int iview = 0; iview < _nViews; ++iview)
+            {
+                if (_views[iview].eventView==eventView)
+                {
+                    return &_views[iview];
+                }
+            }
+            return nullptr;
+        }
+
+        const ViewEntry* findView(const pxl::EventView* eventView) const
+        {
+            return const_cast<EventIndex*>(this)->findView(eventView);
+        }
+
+        static Bucket* findBucket(ViewEntry& entry, Key name)
+        {
+            for (unsigned int ibucket = 0; ibucket < entry.nBuckets; ++ibucket)
+            {
+                if (entry.buckets[ibucket].name==name)
+                {
+                    return &entry.buckets[ibucket];
+                }
+            }
+            return nullptr;
+        }
+
+        //returns the bucket to be changed
+        Bucket& getBucket(ViewEntry& entry, Key name)
+        {
+            Bucket* bucket = findBucket(entry,name);
+            if (bucket)
+            {
+                bucket->generation=_generation;
+                return *bucket;
+            }
+            if (entry.nBuckets==entry.buckets.size())
+            {
+                entry.buckets.push_back(Bucket());
+            }
+            Bucket& newBucket = entry.buckets[entry.nBuckets];
+            ++entry.nBuckets;
+            newBucket.name=name;
+            newBucket.generation=_generation;
+            newBucket.particles.clear();
+            newBucket.ordinals.clear();
+            return newBucket;
+        }
+
+        static void addToBucket(Bucket& bucket, pxl::Particle* particle, unsigned int ordinal)
+        {
+            std::vector<unsigned int>::iterator pos = std::upper_bound(bucket.ordinals.begin(),bucket.ordinals.end(),ordinal);
+            bucket.particles.insert(bucket.particles.begin()+(pos-bucket.ordinals.begin()),particle);
+            bucket.ordinals.insert(pos,ordinal);
+        }
+
+        //removes the particle from its bucket and returns its ordinal
+        bool takeFromBuckets(ViewEntry& entry, const pxl::Particle* particle, unsigned int& ordinal)
+        {
+            for (unsigned int ibucket = 0; ibucket < entry.nBuckets; ++ibucket)
+            {
+                Bucket& bucket = entry.buckets[ibucket];
+                std::vector<pxl::Particle*>::iterator it = std::find(bucket.particles.begin(),bucket.particles.end(),particle);
+                if (it!=bucket.particles.end())
+                {
+                    const unsigned int pos = it-bucket.particles.begin();
+                    ordinal = bucket.ordinals[pos];
+                    bucket.generation=_generation;
+                    bucket.particles.erase(it);
+                    bucket.ordinals.erase(bucket.ordinals.begin()+pos);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline bool isValidFor(const pxl::Event* event) const
+        {
+            return _valid and _event==event and _eventId==event->getId();
+        }
+
+        ViewEntry& addView(pxl::EventView* eventView, Key name)
+        {
+            if (_nViews==_views.size())
+            {
+                _views.push_back(ViewEntry());
+            }
+            ViewEntry& entry = _views[_nViews];
+            ++_nViews;
+            entry.eventView=eventView;
+            entry.name=name;
+            entry.nextOrdinal=0;
+            entry.nBuckets=0;
+            return entry;
+        }
+
+        void build(const pxl::Event* event)
+        {
+            _event=event;
+            _eventId=event->getId();
+            _nViews=0;
+            ++_generation;
+            ++_nBuilds;
+
+            _eventViewBuffer.clear();
+            event->getObjectsOfType(_eventViewBuffer);
+            for (pxl::EventView* eventView: _eventViewBuffer)
+            {
+                ViewEntry& entry = addView(eventView,intern(eventView->getName()));
+
+                _particleBuffer.clear();
+                eventView->getObjectsOfType(_particleBuffer);
+                _nScannedObjects += 1+_particleBuffer.size();
+
+                //particles of the same name are usually stored next to each other
+                const std::string* lastName = nullptr;
+                Bucket* lastBucket = nullptr;
+                for (pxl::Particle* particle: _particleBuffer)
+                {
+                    const std::string& name = particle->getName();
+                    if (!lastName || *lastName!=name)
+                    {
+                        lastBucket = &getBucket(entry,intern(name));
+                        lastName = &name;
+                    }
+                    lastBucket->particles.push_back(particle);
+                    lastBucket->ordinals.push_back(entry.nextOrdinal);
+                    ++entry.nextOrdinal;
+                }
+            }
+            _valid=true;
+        }
+
+    public:
+        //returns the index for the event; it is only rebuilt if the event has changed
+        static EventIndex& get(const pxl::Event* event)
+        {
+            EventIndex& index = getInstance();
+            ++index._nRequests;
+            if (!index.isValidFor(event))
+            {
+                index.build(event);
+            }
+            return index;
+        }
+
+        //changes with every rebuild of the index of the calling thread and every change through it
+        static uint64_t getGeneration()
+        {
+            return getInstance()._generation;
+        }
+
+        //has to be called after the event was changed without the index; the next get() rebuilds it
+        static void markChanged(const pxl::Event* event)
+        {
+            EventIndex& index = getInstance();
+            if (index._event==event)
+            {
+                index.invalidate();
+            }
+        }
+
+        //lets stores of per particle data (SystematicVariations) drop the particle before it is deleted; set before processing events
+        static void setRemoveHook(RemoveHook hook)
+        {
+            getRemoveHook() = hook;
+        }
+
+        //calls of get(), rebuilds and event views plus particles scanned by the rebuilds of the calling thread
+        static void getStatistics(uint64_t& nRequests, uint64_t& nBuilds, uint64_t& nScannedObjects)
+        {
+            const EventIndex& index = getInstance();
+            nRequests = index._nRequests;
+            nBuilds = index._nBuilds;
+            nScannedObjects = index._nScannedObjects;
+        }
+
+        static Key intern(const std::string& name)
+        {
+            NameTable& table = getNameTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            std::unordered_map<std::string,Key>::const_iterator it = table.keys.find(name);
+            if (it!=table.keys.end())
+            {
+                return it->second;
+            }
+            const Key key = table.names.size();
+            table.names.push_back(name);
+            table.keys[name]=key;
+            return key;
+        }
+
+        static const std::string& getName(Key key)
+        {
+            NameTable& table = getNameTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            return table.names[key];
+        }
+
+        inline unsigned int getNEventViews() const
+        {
+            return _nViews;
+        }
+
+        inline pxl::EventView* getEventView(unsigned int iview) const
+        {
+            return _views[iview].eventView;
+        }
+
+        inline Key getEventViewName(unsigned int iview) const
+        {
+            return _views[iview].name;
+        }
+
+        //returns the n-th event view of the given name or nullptr
+        pxl::EventView* findEventView(Key name, unsigned int n=0) const
+        {
+            for (unsigned int iview = 0; iview < _nViews; ++iview)
+            {
+                if (_views[iview].name==name)
+                {
+                    if (n==0)
+                    {
+                        return _views[iview].eventView;
+                    }
+                    --n;
+                }
+            }
+            return nullptr;
+        }
+
+        //particles of the given name in the event view in the order of the event view
+        const std::vector<pxl::Particle*>& getParticles(const pxl::EventView* eventView, Key name) const
+        {
+            const ViewEntry* entry = findView(eventView);
+            if (entry)
+            {
+                for (unsigned int ibucket = 0; ibucket < entry->nBuckets; ++ibucket)
+                {
+                    if (entry->buckets[ibucket].name==name)
+                    {
+                        return entry->buckets[ibucket].particles;
+                    }
+                }
+            }
+            return getEmpty();
+        }
+
+        //generation of the last change of the particles of the given name in the event view; 0 if there are none
+        uint64_t getCollectionGeneration(const pxl::EventView* eventView, Key name) const
+        {
+            const ViewEntry* entry = findView(eventView);
+            if (entry)
+            {
+                for (unsigned int ibucket = 0; ibucket < entry->nBuckets; ++ibucket)
+                {
+                    if (entry->buckets[ibucket].name==name)
+                    {
+                        return entry->buckets[ibucket].generation;
+                    }
+                }
+            }
+            return 0;
+        }
+
+        //positions in the event view of the particles returned by getParticles(eventView,name)
+        const std::vector<unsigned int>& getOrdinals(const pxl::EventView* eventView, Key name) const
+        {
+            static const std::vector<unsigned int> empty;
+            const ViewEntry* entry = findView(eventView);
+            if (entry)
+            {
+                for (unsigned int ibucket = 0; ibucket < entry->nBuckets; ++ibucket)
+                {
+                    if (entry->buckets[ibucket].name==name)
+                    {
+                        return entry->buckets[ibucket].ordinals;
+                    }
+                }
+            }
+            return empty;
+        }
+
+        //appends the particles of all given names in the order of the event view
+        void getParticles(const pxl::EventView* eventView, const std::vector<Key>& names, std::vector<pxl::Particle*>& particles) const
+        {
+            const ViewEntry* entry = findView(eventView);
+            if (!entry)
+            {
+                return;
+            }
+            std::vector<std::pair<unsigned int,pxl::Particle*>> ordered;
+            for (unsigned int ibucket = 0; ibucket < entry->nBuckets; ++ibucket)
+            {
+                const Bucket& bucket = entry->buckets[ibucket];
+                if (std::find(names.begin(),names.end(),bucket.name)==names.end())
+                {
+                    continue;
+                }
+                for (unsigned int iparticle = 0; iparticle < bucket.particles.size(); ++iparticle)
+                {
+                    ordered.push_back(std::make_pair(bucket.ordinals[iparticle],bucket.particles[iparticle]));
+                }
+            }
+            std::sort(ordered.begin(),ordered.end());
+            for (const std::pair<unsigned int,pxl::Particle*>& p: ordered)
+            {
+                particles.push_back(p.second);
+            }
+        }
+
+        void setName(pxl::EventView* eventView, pxl::Particle* particle, Key name)
+        {
+            ++_generation;
+            particle->setName(getName(name));
+            ViewEntry* entry = findView(eventView);
+            unsigned int ordinal = 0;
+            if (!entry || !takeFromBuckets(*entry,particle,ordinal))
+            {
+                _valid=false;
+                return;
+            }
+            addToBucket(getBucket(*entry,name),particle,ordinal);
+        }
+
+        void removeObject(pxl::EventView* eventView, pxl::Particle* particle)
+        {
+            ++_generation;
+            if (getRemoveHook())
+            {
+                getRemoveHook()(particle);
+            }
+            ViewEntry* entry = findView(eventView);
+            unsigned int ordinal = 0;
+            if (!entry || !takeFromBuckets(*entry,particle,ordinal))
+            {
+                _valid=false;
+            }
+            eventView->removeObject(particle);
+        }
+
+        void insertObject(pxl::EventView* eventView, pxl::Particle* particle)
+        {
+            ++_generation;
+            eventView->insertObject(particle);
+            ViewEntry* entry = findView(eventView);
+            if (!entry)
+            {
+                _valid=false;
+                return;
+            }
+            Bucket& bucket = getBucket(*entry,intern(particle->getName()));
+            bucket.particles.push_back(particle);
+            bucket.ordinals.push_back(entry->nextOrdinal);
+            ++entry->nextOrdinal;
+        }
+
+        template<class PARTICLE>
+        PARTICLE* create(pxl::EventView* eventView, Key name)
+        {
+            PARTICLE* particle = new PARTICLE();
+            particle->setName(getName(name));
+            insertObject(eventView,particle);
+            return particle;
+        }
+
+        pxl::EventView* createEventView(pxl::Event* event, Key name)
+        {
+            ++_generation;
+            pxl::EventView* eventView = event->create<pxl::EventView>();
+            eventView->setName(getName(name));
+            if (_valid && _event==event)
+            {
+                addView(eventView,name);
+            }
+            return eventView;
+        }
+
+        inline void invalidate()
+        {
+            ++_generation;
+            _valid=false;
+        }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "EventIndex.hpp"
+
+#include <cstdio>
+#include <string>
+
+/*
+* Checks of the EventIndex validity without an analysis: a chain of modules
+* asking for the index of the same event has to scan the event once, changes
+* through the index must not cause a rebuild, and a new event or markChanged
+* after a direct PXL change must. Prints the number of scanned objects per
+* event for the chain.
+*
+* usage: EventIndexTest; returns non-zero if a check fails
+*/
+
+static const unsigned int N_MODULES = 12;
+static const unsigned int N_JETS = 8;
+
+static unsigned int nFailed = 0;
+
+static void check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        fprintf(stderr,"FAILED: %s\n",description.c_str());
+        ++nFailed;
+    }
+}
+
+struct Statistics
+{
+    uint64_t nRequests;
+    uint64_t nBuilds;
+    uint64_t nScannedObjects;
+
+    Statistics()
+    {
+        EventIndex::getStatistics(nRequests,nBuilds,nScannedObjects);
+    }
+};
+
+//objects in the event: the event view, a muon, the jets and the MET
+static void fillEvent(pxl::Event& event)
+{
+    pxl::EventView* eventView = event.create<pxl::EventView>();
+    eventView->setName("Reconstructed");
+    eventView->create<pxl::Particle>()->setName("Muon");
+    for (unsigned int ijet = 0; ijet < N_JETS; ++ijet)
+    {
+        eventView->create<pxl::Particle>()->setName("Jet");
+    }
+    eventView->create<pxl::Particle>()->setName("MET");
+}
+
+//a module of the chain: looks up the jets as the selection modules do
+static unsigned int countJets(const pxl::Event& event)
+{
+    static const EventIndex::Key eventViewName = EventIndex::intern("Reconstructed");
+    static const EventIndex::Key jetName = EventIndex::intern("Jet");
+    const EventIndex& index = EventIndex::get(&event);
+    return index.getParticles(index.findEventView(eventViewName),jetName).size();
+}
+
+int main()
+{
+    const unsigned int nObjects = 1+1+N_JETS+1;
+
+    pxl::Event event;
+    fillEvent(event);
+    const Statistics before;
+    for (unsigned int imodule = 0; imodule < N_MODULES; ++imodule)
+    {
+        check(countJets(event)==N_JETS,"chain: all jets are found");
+    }
+    const Statistics chain;
+    check(chain.nRequests-before.nRequests==N_MODULES,"chain: every module requests the index");
+    check(chain.nBuilds-before.nBuilds==1,"chain: the index is built once");
+    check(chain.nScannedObjects-before.nScannedObjects==nObjects,"chain: every object is scanned once");
+    printf("%u modules: %llu objects scanned per event (%u with a scan per request)\n",
+        N_MODULES,(unsigned long long)(chain.nScannedObjects-before.nScannedObjects),N_MODULES*nObjects);
+
+    //changes through the index keep it valid
+    EventIndex& index = EventIndex::get(&event);
+    pxl::EventView* eventView = index.findEventView(EventIndex::intern("Reconstructed"));
+    index.create<pxl::Particle>(eventView,EventIndex::intern("Jet"));
+    index.removeObject(eventView,index.getParticles(eventView,EventIndex::intern("MET")).front());
+    check(countJets(event)==N_JETS+1,"index: the created jet is found");
+    check(Statistics().nBuilds==chain.nBuilds,"index: changes through the index do not rebuild it");
+
+    //direct changes are only seen after markChanged
+    eventView->create<pxl::Particle>()->setName("Jet");
+    EventIndex::markChanged(&event);
+    check(countJets(event)==N_JETS+2,"markChanged: the jet created through PXL is found");
+    check(Statistics().nBuilds==chain.nBuilds+1,"markChanged: the index is rebuilt");
+
+    //a new event is scanned again
+    pxl::Event next;
+    fillEvent(next);
+    check(countJets(next)==N_JETS,"new event: the jets of the new event are found");
+    check(Statistics().nBuilds==chain.nBuilds+2,"new event: the index is rebuilt");
+
+    if (nFailed>0)
+    {
+        fprintf(stderr,"%u checks failed\n",nFailed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
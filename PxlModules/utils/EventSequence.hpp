@@ -0,0 +1,103 @@
+#ifndef __EVENTSEQUENCE_H__
+#define __EVENTSEQUENCE_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+
+/*
+* Order of the events when several clones of the module chain process events
+* in parallel (see ParallelAnalysis.cpp). The driver numbers the events in the
+* order of the input, sets the number of the event handled by a thread with
+* setCurrent and calls complete once the chain has returned. In ordered mode
+* an output module calls waitForTurn before writing which blocks until all
+* events before the current one are completed, either written or dropped by
+* a selection. Without the driver the mode is unordered and waitForTurn
+* returns immediately.
+*/
+class EventSequence
+{
+    private:
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _ordered;
+        //all events before are completed
+        uint64_t _next;
+        std::set<uint64_t> _completed;
+
+        EventSequence():
+            _ordered(false),
+            _next(0)
+        {
+        }
+
+        EventSequence(const EventSequence&);
+        EventSequence& operator=(const EventSequence&);
+
+        static uint64_t& getCurrentNumber()
+        {
+            static thread_local uint64_t number = 0;
+            return number;
+        }
+
+    public:
+        static EventSequence& get()
+        {
+            static EventSequence sequence;
+            return sequence;
+        }
+
+        //has to be called before processing events
+        void setOrdered(bool ordered)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _ordered = ordered;
+            _next = 0;
+            _completed.clear();
+        }
+
+        inline bool isOrdered() const
+        {
+            return _ordered;
+        }
+
+        static inline void setCurrent(uint64_t number)
+        {
+            getCurrentNumber() = number;
+        }
+
+        static inline uint64_t getCurrent()
+        {
+            return getCurrentNumber();
+        }
+
+        void waitForTurn()
+        {
+            if (!_ordered)
+            {
+                return;
+            }
+            const uint64_t number = getCurrent();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock,[this,number]{ return _next>=number; });
+        }
+
+        void complete(uint64_t number)
+        {
+            if (!_ordered)
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _completed.insert(number);
+            while (!_completed.empty() and *_completed.begin()==_next)
+            {
+                _completed.erase(_completed.begin());
+                ++_next;
+            }
+            _condition.notify_all();
+        }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "EventSequence.hpp"
+#include "WorkQueues.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+* Stress test of the ParallelAnalysis scheduling without PXL: the events are
+* numbers pushed to WorkQueues and processed by worker threads with a random
+* amount of work. A random fraction of the events is dropped (completed
+* without writing) as by a selection; the others are "written" after
+* EventSequence::waitForTurn. In ordered mode the written events have to be
+* exactly the kept ones in input order, in unordered mode each kept event has
+* to be written once.
+*
+* usage: EventSequenceStress [events] [threads]
+*/
+
+struct StressEvent
+{
+    bool keep;
+    unsigned int work;
+};
+
+static bool run(bool ordered, unsigned int nEvents, unsigned int nThreads)
+{
+    std::mt19937 random(12345);
+    std::bernoulli_distribution keep(0.7);
+    std::uniform_int_distribution<unsigned int> work(0,50);
+    std::vector<StressEvent> events(nEvents);
+    for (StressEvent& event: events)
+    {
+        event.keep = keep(random);
+        //mostly short events with a few long ones so that the workers overtake each other
+        event.work = work(random);
+        event.work = event.work>45 ? 20*event.work : event.work;
+    }
+
+    EventSequence& sequence = EventSequence::get();
+    sequence.setOrdered(ordered);
+    WorkQueues<StressEvent> queues(nThreads,64*nThreads);
+    std::mutex outputMutex;
+    std::vector<uint64_t> written;
+
+    std::vector<std::thread> workers;
+    for (unsigned int ithread = 0; ithread < nThreads; ++ithread)
+    {
+        workers.push_back(std::thread([&,ithread]()
+        {
+            std::pair<uint64_t,StressEvent*> item;
+            while (queues.pop(ithread,item))
+            {
+                EventSequence::setCurrent(item.first);
+                std::this_thread::sleep_for(std::chrono::microseconds(item.second->work));
+                if (item.second->keep)
+                {
+                    sequence.waitForTurn();
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    written.push_back(item.first);
+                }
+                sequence.complete(item.first);
+            }
+        }));
+    }
+    for (unsigned int ievent = 0; ievent < nEvents; ++ievent)
+    {
+        queues.push(ievent%nThreads,ievent,&events[ievent]);
+    }
+    queues.close();
+    for (std::thread& worker: workers)
+    {
+        worker.join();
+    }
+
+    std::vector<uint64_t> expected;
+    for (unsigned int ievent = 0; ievent < nEvents; ++ievent)
+    {
+        if (events[ievent].keep)
+        {
+            expected.push_back(ievent);
+        }
+    }
+    if (!ordered)
+    {
+        std::sort(written.begin(),written.end());
+    }
+    if (written!=expected)
+    {
+        fprintf(stderr,"%s output: %llu events written, %llu expected",ordered ? "ordered" : "unordered",(unsigned long long)written.size(),(unsigned long long)expected.size());
+        for (unsigned int ievent = 0; ievent < written.size() and ievent < expected.size(); ++ievent)
+        {
+            if (written[ievent]!=expected[ievent])
+            {
+                fprintf(stderr,"; first difference at position %u: event %llu instead of %llu",ievent,(unsigned long long)written[ievent],(unsigned long long)expected[ievent]);
+                break;
+            }
+        }
+        fprintf(stderr,"\n");
+        return false;
+    }
+    printf("%s output: %llu of %u events written with %u threads\n",ordered ? "ordered" : "unordered",(unsigned long long)written.size(),nEvents,nThreads);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const unsigned int nEvents = argc>1 ? atoi(argv[1]) : 20000;
+    const unsigned int nThreads = argc>2 ? std::max(1,atoi(argv[2])) : 4;
+    const bool passed = run(true,nEvents,nThreads) and run(false,nEvents,nThreads);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#ifndef __EVENTSNAPSHOT_H__
+#define __EVENTSNAPSHOT_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "EventIndex.hpp"
+#include "UserRecordKey.hpp"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+* Structure-of-arrays copy of the kinematics and of selected user records of
+* particle collections, each given by an event view and a particle name. It is
+* filled by the EventSnapshotProducer module and read by the following modules
+* instead of the pxl::Particle objects. Like the EventIndex the snapshot is a
+* thread local static shared by all plugins; get returns nullptr if no
+* snapshot exists for the event and findCollection returns nullptr for
+* collections which are not part of it, in which case the modules fall back
+* to the particles.
+*
+* Each collection remembers the generation of its last change in the
+* EventIndex. A later change of the collection through the index (a particle
+* renamed from or to its name, removed or inserted) or a rebuild of the index
+* invalidates the snapshot, so that e.g. a producer placed before a selection
+* renaming Jet to SelectedJet makes the following modules fall back to the
+* particles instead of reading stale collections. Objects created in other
+* collections (neutrino, W boson, top) keep it valid. Changes of four vectors
+* or user records are not tracked; the producer has to run after the last
+* module changing them.
+*/
+class EventSnapshot
+{
+    public:
+        struct Collection
+        {
+            //nullptr if the event has no such event view
+            const pxl::EventView* eventView;
+            EventIndex::Key eventViewName;
+            EventIndex::Key name;
+            uint64_t generation;
+            std::vector<pxl::Particle*> particles;
+            //position in the event view
+            std::vector<unsigned int> ordinals;
+
+            std::vector<double> px;
+            std::vector<double> py;
+            std::vector<double> pz;
+            std::vector<double> e;
+            std::vector<double> pt;
+            std::vector<double> eta;
+            std::vector<double> phi;
+            std::vector<double> p;
+            std::vector<double> mass;
+
+            //one column per user record of the snapshot; NaN if the particle has no such record
+            std::vector<std::vector<float>> userRecords;
+
+            inline unsigned int size() const
+            {
+                return particles.size();
+            }
+        };
+
+    private:
+        const pxl::Event* _event;
+        pxl::Id _eventId;
+        uint64_t _generation;
+        bool _valid;
+
+        //collections are reused between events; only the first _nCollections are in use
+        std::vector<Collection> _collections;
+        unsigned int _nCollections;
+        std::vector<UserRecordKey> _userRecords;
+
+        EventSnapshot():
+            _event(nullptr),
+            _generation(0),
+            _valid(false),
+            _nCollections(0)
+        {
+        }
+
+        EventSnapshot(const EventSnapshot&);
+        EventSnapshot& operator=(const EventSnapshot&);
+
+        static EventSnapshot& getInstance()
+        {
+            static thread_local EventSnapshot snapshot;
+            return snapshot;
+        }
+
+        bool isValidFor(const pxl::Event* event, const EventIndex& index) const
+        {
+            if (!_valid || _event!=event || _eventId!=event->getId())
+            {
+                return false;
+            }
+            if (_generation==EventIndex::getGeneration())
+            {
+                return true;
+            }
+            for (unsigned int icollection = 0; icollection < _nCollections; ++icollection)
+            {
+                const Collection& collection = _collections[icollection];
+                if (index.findEventView(collection.eventViewName)!=collection.eventView or index.getCollectionGeneration(collection.eventView,collection.name)!=collection.generation)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void fillCollection(Collection& collection, const EventIndex& index)
+        {
+            const std::vector<pxl::Particle*>& particles = index.getParticles(collection.eventView,collection.name);
+            collection.generation=index.getCollectionGeneration(collection.eventView,collection.name);
+            collection.particles=particles;
+            collection.ordinals=index.getOrdinals(collection.eventView,collection.name);
+
+            const unsigned int n = particles.size();
+            collection.px.resize(n);
+            collection.py.resize(n);
+            collection.pz.resize(n);
+            collection.e.resize(n);
+            collection.pt.resize(n);
+            collection.eta.resize(n);
+            collection.phi.resize(n);
+            collection.p.resize(n);
+            collection.mass.resize(n);
+            collection.userRecords.resize(_userRecords.size());
+            for (std::vector<float>& column: collection.userRecords)
+            {
+                column.resize(n);
+            }
+
+            for (unsigned int iparticle = 0; iparticle < n; ++iparticle)
+            {
+                const pxl::Particle* particle = particles[iparticle];
+                collection.px[iparticle]=particle->getPx();
+                collection.py[iparticle]=particle->getPy();
+                collection.pz[iparticle]=particle->getPz();
+                collection.e[iparticle]=particle->getE();
+                collection.pt[iparticle]=particle->getPt();
+                collection.eta[iparticle]=particle->getEta();
+                collection.phi[iparticle]=particle->getPhi();
+                collection.p[iparticle]=particle->getP();
+                collection.mass[iparticle]=particle->getMass();
+                for (unsigned int icolumn = 0; icolumn < _userRecords.size(); ++icolumn)
+                {
+                    const pxl::Variant* value = _userRecords[icolumn].find(particle);
+                    collection.userRecords[icolumn][iparticle] = value ? value->toFloat() : std::numeric_limits<float>::quiet_NaN();
+                }
+            }
+        }
+
+    public:
+        //returns the snapshot if one was filled for this event or nullptr
+        static const EventSnapshot* get(const pxl::Event* event)
+        {
+            const EventSnapshot& snapshot = getInstance();
+            if (!snapshot.isValidFor(event,EventIndex::get(event)))
+            {
+                return nullptr;
+            }
+            return &snapshot;
+        }
+
+        //collections are given as (event view name, particle name); the first event view of the name is used
+        static void fill(const pxl::Event* event, const EventIndex& index, const std::vector<std::pair<EventIndex::Key,EventIndex::Key>>& collections, const std::vector<UserRecordKey>& userRecords)
+        {
+            EventSnapshot& snapshot = getInstance();
+            snapshot._event=event;
+            snapshot._eventId=event->getId();
+            snapshot._generation=EventIndex::getGeneration();
+            snapshot._userRecords=userRecords;
+
+            if (snapshot._collections.size()<collections.size())
+            {
+                snapshot._collections.resize(collections.size());
+            }
+            snapshot._nCollections=collections.size();
+            for (unsigned int icollection = 0; icollection < collections.size(); ++icollection)
+            {
+                Collection& collection = snapshot._collections[icollection];
+                collection.eventViewName=collections[icollection].first;
+                collection.eventView=index.findEventView(collection.eventViewName);
+                collection.name=collections[icollection].second;
+                snapshot.fillCollection(collection,index);
+            }
+            snapshot._valid=true;
+        }
+
+        inline unsigned int getNCollections() const
+        {
+            return _nCollections;
+        }
+
+        inline const Collection& getCollection(unsigned int icollection) const
+        {
+            return _collections[icollection];
+        }
+
+        //returns nullptr if the particles of this name in the event view are not part of the snapshot
+        const Collection* findCollection(const pxl::EventView* eventView, EventIndex::Key name) const
+        {
+            for (unsigned int icollection = 0; icollection < _nCollections; ++icollection)
+            {
+                if (_collections[icollection].eventView==eventView and _collections[icollection].name==name)
+                {
+                    return &_collections[icollection];
+                }
+            }
+            return nullptr;
+        }
+
+        //returns the column of the user record in Collection::userRecords or -1
+        int findUserRecord(const std::string& name) const
+        {
+            for (unsigned int icolumn = 0; icolumn < _userRecords.size(); ++icolumn)
+            {
+                if (_userRecords[icolumn].getName()==name)
+                {
+                    return icolumn;
+                }
+            }
+            return -1;
+        }
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "EventIndex.hpp"
+#include "EventSnapshot.hpp"
+#include "UserRecordKey.hpp"
+#include "ModuleTimer.hpp"
+
+#include <utility>
+
+static pxl::Logger logger("EventSnapshotProducer");
+
+class EventSnapshotProducer:
+    public pxl::Module
+{
+    private:
+        pxl::Source* _outputSource;
+
+        std::string _inputEventViewName;
+        std::vector<std::string> _particleNames;
+        std::vector<std::string> _userRecordNames;
+
+        //(event view, particle name)
+        std::vector<std::pair<EventIndex::Key,EventIndex::Key>> _collectionKeys;
+        std::vector<UserRecordKey> _userRecordKeys;
+
+        ModuleTimer _timer;
+
+    public:
+        EventSnapshotProducer():
+            Module(),
+            _inputEventViewName("Reconstructed"),
+            _particleNames({"TightMuon","TightElectron","SelectedJet","SelectedBJet","SingleTop:Neutrino"})
+        {
+            addSink("input", "input");
+            _outputSource = addSource("output","output");
+
+            addOption("event view","name of the event view",_inputEventViewName);
+            addOption("particles","names of the particles to copy into the snapshot; 'event view:name' takes them from another event view (NeutrinoPz stores the neutrino in 'SingleTop')",_particleNames);
+            addOption("user records","user records of the particles to copy into the snapshot",_userRecordNames);
+        }
+
+        ~EventSnapshotProducer()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("EventSnapshotProducer");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("event view",_inputEventViewName);
+            getOption("particles",_particleNames);
+            getOption("user records",_userRecordNames);
+
+            _collectionKeys.clear();
+            for (const std::string& name: _particleNames)
+            {
+                const size_t separator = name.find(':');
+                if (separator==std::string::npos)
+                {
+                    _collectionKeys.push_back(std::make_pair(EventIndex::intern(_inputEventViewName),EventIndex::intern(name)));
+                }
+                else
+                {
+                    _collectionKeys.push_back(std::make_pair(EventIndex::intern(name.substr(0,separator)),EventIndex::intern(name.substr(separator+1))));
+                }
+            }
+            _userRecordKeys.clear();
+            for (const std::string& name: _userRecordNames)
+            {
+                _userRecordKeys.push_back(UserRecordKey(name));
+            }
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    EventSnapshot::fill(event,EventIndex::get(event),_collectionKeys,_userRecordKeys);
+                    _outputSource->setTargets(event);
+                    return _outputSource->processTargets();
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(EventSnapshotProducer)
+PXL_PLUGIN_INIT
@@ -5,8 +5,15 @@
 #include "pxl/modules/Module.hh"
 #include "pxl/modules/ModuleFactory.hh"
 
+#include "UserRecordKey.hpp"
+#include "ModuleTimer.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 static pxl::Logger logger("EventWeight");
 
@@ -14,9 +21,20 @@ struct FileInfo
 {
     double nEvents;
     double crossSection;
+    //from the normalisation file; replaces nEvents if set
+    double sumOfWeights;
+
+    //the built-in table lists only the number of events and the cross section
+    FileInfo(double nEvents=0, double crossSection=0, double sumOfWeights=0):
+        nEvents(nEvents),
+        crossSection(crossSection),
+        sumOfWeights(sumOfWeights)
+    {
+    }
 };
 
-const std::unordered_map<std::string,FileInfo> eventWeights = {
+//used if no cross section file is given
+const std::unordered_map<std::string,FileInfo> defaultEventWeights = {
     {"TToLeptons_t-channel-CSA14_Tune4C_13TeV-aMCatNLO-tauola",
         {
             1037660,
@@ -160,16 +178,40 @@ class EventWeight:
         pxl::Source* _outputSource;
 
         std::string _processNameField;
+        std::string _crossSectionFile;
+        std::string _eventCountFile;
+        std::string _normalisationFile;
+        std::string _generatorWeightField;
+        
+        UserRecordKey _processNameKey;
+        UserRecordKey _generatorWeightKey;
+        std::unordered_map<std::string,FileInfo> _eventWeights;
+        
+        //the weight is resolved only if the process name differs from the one of the previous event
+        std::string _lastProcessName;
+        bool _lastValid;
+        double _lastWeight;
+        bool _lastUsesGeneratorWeight;
+
+        ModuleTimer _timer;
 
     public:
         EventWeight():
             Module(),
-            _processNameField("ProcessName")
+            _processNameField("ProcessName"),
+            _generatorWeightField("genweight"),
+            _lastValid(false),
+            _lastWeight(1.0),
+            _lastUsesGeneratorWeight(false)
         {
             addSink("input", "input");
             _outputSource = addSource("output","output");
             
             addOption("name of process field","",_processNameField);
+            addOption("cross section file","lines of 'process nEvents crossSection' where the cross section can be a product like '136.02*0.324'; '#' starts a comment; the built-in table is used if empty",_crossSectionFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("event count file","count events on the fly: lines of 'process nEvents' from a pre-scan of the input files which replace the event counts of the cross section table",_eventCountFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("normalisation file","lines of 'process nEvents sumOfWeights sumOfSquaredWeights' written by the SumOfWeights tool; processes in this file are normalised to the sum of the generator weights",_normalisationFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("generator weight field","event user record with the generator weight; multiplied to the weight of processes from the normalisation file",_generatorWeightField);
         }
 
         ~EventWeight()
@@ -199,28 +241,175 @@ class EventWeight:
         {
         }
 
+        static double parseNumber(const std::string& s, const std::string& where)
+        {
+            //products like '136.02*0.324'
+            double result = 1.0;
+            std::istringstream ss(s);
+            std::string factor;
+            while (std::getline(ss,factor,'*'))
+            {
+                char* end = nullptr;
+                const double value = strtod(factor.c_str(),&end);
+                if (factor.empty() or *end!=0)
+                {
+                    throw std::runtime_error(where+": invalid number '"+s+"'");
+                }
+                result *= value;
+            }
+            return result;
+        }
+        
+        //whitespace separated columns per line; '#' starts a comment
+        static std::vector<std::vector<std::string>> readColumns(const std::string& fileName, unsigned int minColumns)
+        {
+            std::ifstream file(fileName.c_str());
+            if (!file)
+            {
+                throw std::runtime_error("cannot open file '"+fileName+"'");
+            }
+            std::vector<std::vector<std::string>> lines;
+            std::string line;
+            unsigned int nline = 0;
+            while (std::getline(file,line))
+            {
+                ++nline;
+                std::istringstream ss(line.substr(0,line.find('#')));
+                std::vector<std::string> columns;
+                std::string column;
+                while (ss>>column)
+                {
+                    columns.push_back(column);
+                }
+                if (columns.empty())
+                {
+                    continue;
+                }
+                if (columns.size()<minColumns)
+                {
+                    throw std::runtime_error(fileName+":"+std::to_string(nline)+": expected at least "+std::to_string(minColumns)+" columns");
+                }
+                columns.push_back(fileName+":"+std::to_string(nline));
+                lines.push_back(columns);
+            }
+            return lines;
+        }
+
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("name of process field",_processNameField);
+            getOption("cross section file",_crossSectionFile);
+            getOption("event count file",_eventCountFile);
+            getOption("normalisation file",_normalisationFile);
+            getOption("generator weight field",_generatorWeightField);
+            
+            _processNameKey = UserRecordKey(_processNameField);
+            _generatorWeightKey = UserRecordKey(_generatorWeightField);
+            _lastProcessName.clear();
+            _lastValid = false;
+            
+            try
+            {
+                if (_crossSectionFile.empty())
+                {
+                    _eventWeights = defaultEventWeights;
+                }
+                else
+                {
+                    _eventWeights.clear();
+                    for (const std::vector<std::string>& columns: readColumns(_crossSectionFile,3))
+                    {
+                        FileInfo info;
+                        info.nEvents = parseNumber(columns[1],columns.back());
+                        info.crossSection = parseNumber(columns[2],columns.back());
+                        _eventWeights[columns[0]] = info;
+                    }
+                }
+                if (!_eventCountFile.empty())
+                {
+                    for (const std::vector<std::string>& columns: readColumns(_eventCountFile,2))
+                    {
+                        auto it = _eventWeights.find(columns[0]);
+                        if (it==_eventWeights.end())
+                        {
+                            logger(pxl::LOG_LEVEL_WARNING,"no cross section for counted process '"+columns[0]+"'");
+                            continue;
+                        }
+                        it->second.nEvents = parseNumber(columns[1],columns.back());
+                    }
+                }
+                if (!_normalisationFile.empty())
+                {
+                    for (const std::vector<std::string>& columns: readColumns(_normalisationFile,3))
+                    {
+                        auto it = _eventWeights.find(columns[0]);
+                        if (it==_eventWeights.end())
+                        {
+                            logger(pxl::LOG_LEVEL_WARNING,"no cross section for normalised process '"+columns[0]+"'");
+                            continue;
+                        }
+                        it->second.nEvents = parseNumber(columns[1],columns.back());
+                        it->second.sumOfWeights = parseNumber(columns[2],columns.back());
+                    }
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+        }
+        
+        void resolveWeight(const std::string& processName)
+        {
+            _lastProcessName = processName;
+            auto it = _eventWeights.find(processName);
+            _lastUsesGeneratorWeight = false;
+            if (it!=_eventWeights.end() and it->second.sumOfWeights!=0)
+            {
+                //negative weights reduce the effective number of events
+                _lastValid = true;
+                _lastUsesGeneratorWeight = true;
+                _lastWeight = 1.0*it->second.crossSection/it->second.sumOfWeights;
+            }
+            else if (it==_eventWeights.end() or it->second.nEvents<=0)
+            {
+                _lastValid = false;
+                logger(pxl::LOG_LEVEL_ERROR,"no event weight information available for process name '"+processName+"'");
+                //throw std::runtime_error(getName()+": no event weight information available for process name '"+processName+"'");
+            }
+            else
+            {
+                _lastValid = true;
+                _lastWeight = 1.0*it->second.crossSection/it->second.nEvents;
+            }
         }
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
                 if (event)
                 {
-                    std::string processName = event->getUserRecord(_processNameField).toString();
-                    auto it = eventWeights.find(processName);
-                    if (it==eventWeights.end())
+                    const std::string& processName = _processNameKey.get(event).asString();
+                    if (processName!=_lastProcessName or _lastProcessName.empty())
                     {
-                        logger(pxl::LOG_LEVEL_ERROR,"no event weight information available for process name '"+processName+"'");
-                        //throw std::runtime_error(getName()+": no event weight information available for process name '"+processName+"'");
+                        resolveWeight(processName);
                     }
-                    else
+                    if (_lastValid)
                     {
-                        event->setUserRecord("mc_weight",1.0*it->second.crossSection/it->second.nEvents);
+                        double weight = _lastWeight;
+                        if (_lastUsesGeneratorWeight)
+                        {
+                            const pxl::Variant* generatorWeight = _generatorWeightKey.find(event);
+                            if (generatorWeight)
+                            {
+                                weight *= generatorWeight->toDouble();
+                            }
+                        }
+                        event->setUserRecord("mc_weight",weight);
                     }
 
                     _outputSource->setTargets(event);
@@ -240,6 +429,11 @@ class EventWeight:
             return false;
         }
 
+        void endJob()
+        {
+            _timer.report();
+        }
+
         void shutdown() throw(std::runtime_error)
         {
         }
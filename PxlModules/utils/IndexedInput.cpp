@@ -0,0 +1,348 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/core/InputFile.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "PxlioIndex.hpp"
+#include "ModuleTimer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static pxl::Logger logger("IndexedInput");
+
+/*
+* Runnable module reading pxlio files through their sidecar indices written
+* by PxlioIndexer. The events are preselected on the mapped index by process
+* name and by ranges of the indexed event user records ('record:min:max',
+* empty bounds are open); only the selected events are deserialised, the
+* objects in between are skipped. The selected events can be restricted to a
+* window ('first event', 'number of events') and split into contiguous
+* ranges for parallel workers: worker w of n processes the selected events
+* [N*w/n,N*(w+1)/n) so that the workers together process every event once.
+*/
+class IndexedInput:
+    public pxl::Module
+{
+    private:
+        struct RecordCut
+        {
+            std::string name;
+            double min;
+            double max;
+        };
+
+        struct Selected
+        {
+            uint32_t file;
+            uint64_t object;
+        };
+
+        pxl::Source* _outputSource;
+
+        std::vector<std::string> _fileNames;
+        std::vector<std::string> _processNames;
+        std::vector<std::string> _recordCutDefinitions;
+        int64_t _firstEvent;
+        int64_t _nEvents;
+        int64_t _worker;
+        int64_t _nWorkers;
+
+        std::vector<RecordCut> _recordCuts;
+        std::vector<Selected> _selected;
+        size_t _next;
+
+        //file currently read and the number of objects read from it
+        std::unique_ptr<pxl::InputFile> _input;
+        int64_t _currentFile;
+        uint64_t _nObjectsRead;
+        uint64_t _nSkipped;
+
+        ModuleTimer _timer;
+
+        static std::string trim(const std::string& s)
+        {
+            const size_t begin = s.find_first_not_of(" \t");
+            if (begin==std::string::npos)
+            {
+                return "";
+            }
+            return s.substr(begin,s.find_last_not_of(" \t")-begin+1);
+        }
+
+        static std::vector<std::string> split(const std::string& s, char delimiter)
+        {
+            std::vector<std::string> tokens;
+            std::istringstream ss(s);
+            std::string token;
+            while (std::getline(ss,token,delimiter))
+            {
+                tokens.push_back(trim(token));
+            }
+            if (not s.empty() and s[s.size()-1]==delimiter)
+            {
+                tokens.push_back("");
+            }
+            return tokens;
+        }
+
+        static double parseBound(const std::string& value, double open, const std::string& definition)
+        {
+            if (value.empty())
+            {
+                return open;
+            }
+            char* end = nullptr;
+            const double bound = strtod(value.c_str(),&end);
+            if (*end!=0)
+            {
+                throw std::runtime_error("invalid bound '"+value+"' in '"+definition+"'");
+            }
+            return bound;
+        }
+
+        void parseRecordCuts()
+        {
+            _recordCuts.clear();
+            for (const std::string& definition: _recordCutDefinitions)
+            {
+                const std::vector<std::string> tokens = split(definition,':');
+                if (tokens.size()!=3 or tokens[0].empty())
+                {
+                    throw std::runtime_error("invalid record cut '"+definition+"', expected 'record:min:max'");
+                }
+                RecordCut cut;
+                cut.name = tokens[0];
+                cut.min = parseBound(tokens[1],-INFINITY,definition);
+                cut.max = parseBound(tokens[2],INFINITY,definition);
+                _recordCuts.push_back(cut);
+            }
+        }
+
+        //appends the events of the file passing the process and record selection
+        void selectEvents(uint32_t ifile)
+        {
+            PxlioIndex index;
+            index.open(_fileNames[ifile]);
+
+            std::vector<bool> acceptedProcesses(index.getProcessNames().size(),_processNames.empty());
+            for (unsigned int iprocess = 0; iprocess < index.getProcessNames().size(); ++iprocess)
+            {
+                if (std::find(_processNames.begin(),_processNames.end(),index.getProcessNames()[iprocess])!=_processNames.end())
+                {
+                    acceptedProcesses[iprocess] = true;
+                }
+            }
+            std::vector<int> records;
+            for (const RecordCut& cut: _recordCuts)
+            {
+                records.push_back(index.findRecord(cut.name));
+                if (records.back()<0)
+                {
+                    throw std::runtime_error("record '"+cut.name+"' is not indexed in '"+_fileNames[ifile]+"'");
+                }
+            }
+
+            for (uint64_t ientry = 0; ientry < index.getNEntries(); ++ientry)
+            {
+                if (not acceptedProcesses[index.getProcess(ientry)])
+                {
+                    continue;
+                }
+                bool accepted = true;
+                for (unsigned int icut = 0; icut < _recordCuts.size() and accepted; ++icut)
+                {
+                    //NaN (missing record) fails every cut
+                    const double value = index.getRecord(ientry,records[icut]);
+                    accepted = value>=_recordCuts[icut].min and value<=_recordCuts[icut].max;
+                }
+                if (accepted)
+                {
+                    Selected selected = {ifile,index.getObject(ientry)};
+                    _selected.push_back(selected);
+                }
+            }
+        }
+
+        //reads the object at the given position of the file, skipping the objects before it
+        pxl::Event* readEvent(const Selected& selected)
+        {
+            if (_currentFile!=int64_t(selected.file) or selected.object<_nObjectsRead)
+            {
+                _input.reset(new pxl::InputFile(_fileNames[selected.file]));
+                _currentFile = selected.file;
+                _nObjectsRead = 0;
+            }
+            const uint64_t nSkip = selected.object-_nObjectsRead;
+            if (nSkip>0)
+            {
+                if (uint64_t(_input->skip(nSkip))!=nSkip)
+                {
+                    throw std::runtime_error("'"+_fileNames[selected.file]+"' is shorter than its index; run PxlioIndexer again");
+                }
+                _nSkipped += nSkip;
+            }
+            std::unique_ptr<pxl::Serializable> object(_input->readNextObject());
+            _nObjectsRead = selected.object+1;
+            pxl::Event* event = dynamic_cast<pxl::Event*>(object.get());
+            if (!event)
+            {
+                throw std::runtime_error("no event at the indexed position in '"+_fileNames[selected.file]+"'; run PxlioIndexer again");
+            }
+            object.release();
+            return event;
+        }
+
+    public:
+        IndexedInput():
+            Module(),
+            _firstEvent(0),
+            _nEvents(-1),
+            _worker(0),
+            _nWorkers(1),
+            _next(0),
+            _currentFile(-1),
+            _nObjectsRead(0),
+            _nSkipped(0)
+        {
+            _outputSource = addSource("output","output");
+
+            addOption("input files","pxlio files with an index from PxlioIndexer",_fileNames);
+            addOption("process names","process names to read; all if empty",_processNames);
+            addOption("record cuts","ranges of indexed event user records as 'record:min:max'; empty bounds are open",_recordCutDefinitions);
+            addOption("first event","first selected event to read",_firstEvent);
+            addOption("number of events","number of selected events to read; all if negative",_nEvents);
+            addOption("worker","index of this worker",_worker);
+            addOption("number of workers","the selected events are split into this many contiguous ranges",_nWorkers);
+        }
+
+        ~IndexedInput()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("IndexedInput");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module provides the events
+            return true;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("input files",_fileNames);
+            getOption("process names",_processNames);
+            getOption("record cuts",_recordCutDefinitions);
+            getOption("first event",_firstEvent);
+            getOption("number of events",_nEvents);
+            getOption("worker",_worker);
+            getOption("number of workers",_nWorkers);
+
+            try
+            {
+                if (_nWorkers<1 or _worker<0 or _worker>=_nWorkers)
+                {
+                    throw std::runtime_error("worker must be in [0,number of workers)");
+                }
+                if (_firstEvent<0)
+                {
+                    throw std::runtime_error("first event must not be negative");
+                }
+                parseRecordCuts();
+                _selected.clear();
+                for (uint32_t ifile = 0; ifile < _fileNames.size(); ++ifile)
+                {
+                    selectEvents(ifile);
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+
+            //window of the selected events, then the range of this worker
+            const uint64_t nSelected = _selected.size();
+            const uint64_t first = std::min<uint64_t>(_firstEvent,nSelected);
+            const uint64_t last = _nEvents<0 ? nSelected : std::min<uint64_t>(first+_nEvents,nSelected);
+            const uint64_t begin = first+(last-first)*_worker/_nWorkers;
+            const uint64_t end = first+(last-first)*(_worker+1)/_nWorkers;
+            _selected.erase(_selected.begin()+end,_selected.end());
+            _selected.erase(_selected.begin(),_selected.begin()+begin);
+            logger(pxl::LOG_LEVEL_INFO,"selected ",nSelected," events; reading ",_selected.size());
+
+            _next = 0;
+            _input.reset();
+            _currentFile = -1;
+            _nObjectsRead = 0;
+            _nSkipped = 0;
+        }
+
+        //reads one event per call; returns false once all events of the range are read
+        bool analyse(pxl::Sink *) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            if (_next>=_selected.size())
+            {
+                return false;
+            }
+            try
+            {
+                std::unique_ptr<pxl::Event> event(readEvent(_selected[_next]));
+                ++_next;
+                _outputSource->setTargets(event.get());
+                _outputSource->processTargets();
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+            return true;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+            _input.reset();
+            logger(pxl::LOG_LEVEL_INFO,"read ",_next," events, skipped ",_nSkipped," objects");
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(IndexedInput)
+PXL_PLUGIN_INIT
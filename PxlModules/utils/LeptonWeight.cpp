@@ -0,0 +1,173 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "EventIndex.hpp"
+#include "ScaleFactorTable.hpp"
+#include "ModuleTimer.hpp"
+
+#include <string>
+#include <vector>
+
+static pxl::Logger logger("LeptonWeight");
+
+/*
+* Event weight from the product of the ID, isolation and trigger scale factors
+* (see ScaleFactorTable.hpp) of the selected leptons. The down/up weights vary
+* all scale factors coherently by their uncertainties.
+*/
+class LeptonWeight:
+    public pxl::Module
+{
+    private:
+        pxl::Source* _outputSource;
+
+        std::string _inputEventViewName;
+        std::string _leptonName;
+        std::vector<std::string> _scaleFactorDefinitions;
+        std::string _weightName;
+
+        EventIndex::Key _inputEventViewKey;
+        EventIndex::Key _leptonKey;
+
+        std::vector<ScaleFactorTable> _scaleFactors;
+        std::string _weightNames[ScaleFactorTable::NVARIATIONS];
+
+        ModuleTimer _timer;
+
+    public:
+        LeptonWeight():
+            Module(),
+            _inputEventViewName("Reconstructed"),
+            _leptonName("TightMuon"),
+            _weightName("muon_sf")
+        {
+            addSink("input", "input");
+            _outputSource = addSource("output","output");
+
+            addOption("event view","name of the event view with the leptons",_inputEventViewName);
+            addOption("lepton name","name of the leptons to weight",_leptonName);
+            addOption("scale factors","list of 'file:histogram:variables' with the variables pt, eta or abseta per histogram axis, e.g. 'MuonID.root:TightID/abseta_pt:abseta,pt'",_scaleFactorDefinitions);
+            addOption("weight name","name of the event user record; the variations get the suffixes _down and _up",_weightName);
+        }
+
+        ~LeptonWeight()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("LeptonWeight");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("event view",_inputEventViewName);
+            getOption("lepton name",_leptonName);
+            getOption("scale factors",_scaleFactorDefinitions);
+            getOption("weight name",_weightName);
+
+            _inputEventViewKey = EventIndex::intern(_inputEventViewName);
+            _leptonKey = EventIndex::intern(_leptonName);
+
+            _weightNames[ScaleFactorTable::NOMINAL] = _weightName;
+            _weightNames[ScaleFactorTable::DOWN] = _weightName+"_down";
+            _weightNames[ScaleFactorTable::UP] = _weightName+"_up";
+
+            _scaleFactors.clear();
+            try
+            {
+                for (const std::string& definition: _scaleFactorDefinitions)
+                {
+                    _scaleFactors.push_back(ScaleFactorTable::fromDefinition(definition));
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    const EventIndex& index = EventIndex::get(event);
+                    const pxl::EventView* eventView = index.findEventView(_inputEventViewKey);
+
+                    ScaleFactorTable::Values weights = {{1,1,1}};
+                    if (eventView)
+                    {
+                        for (const pxl::Particle* lepton: index.getParticles(eventView,_leptonKey))
+                        {
+                            for (const ScaleFactorTable& scaleFactor: _scaleFactors)
+                            {
+                                scaleFactor.multiply(lepton,weights);
+                            }
+                        }
+                    }
+                    for (unsigned int ivariation = 0; ivariation < ScaleFactorTable::NVARIATIONS; ++ivariation)
+                    {
+                        event->setUserRecord(_weightNames[ivariation],weights[ivariation]);
+                    }
+
+                    _outputSource->setTargets(event);
+                    return _outputSource->processTargets();
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(LeptonWeight)
+PXL_PLUGIN_INIT
@@ -0,0 +1,360 @@
+#ifndef __MODULETIMER_H__
+#define __MODULETIMER_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//defined by libAllocationCounter.so if preloaded, otherwise null
+extern "C" uint64_t pxlmodules_allocation_count() __attribute__((weak));
+
+/*
+* Timing of the analyse method of the modules, switched on by the environment
+* variable PXLMODULES_TIMING=1. A module holds a ModuleTimer and opens a scope
+* with MODULE_TIMER_SCOPE(_timer) at the beginning of analyse. As analyse of a
+* module calls the following modules through processTargets, the time spent
+* in nested scopes is subtracted so that each module is charged only for its
+* own work (exclusive time); the inclusive time is reported as well.
+*
+* report() (in endJob) prints the number of events, mean/p50/p99 exclusive
+* latency, events/s and mean inclusive latency. The percentiles are taken
+* from a fixed size histogram with log2 bins split into 16 linear sub-bins
+* (at most 3% off), so recording neither allocates nor grows with the number
+* of events. If the allocation counter
+* libAllocationCounter.so is preloaded (LD_PRELOAD) also the number of
+* allocations per event are reported. With PXLMODULES_TRACE=file.json the
+* scopes of the first million events are written as Chrome trace (see
+* chrome://tracing) once all timers have reported.
+*
+* Disabled timers cost a branch per event.
+*/
+class ModuleTimer
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        class Scope;
+
+    private:
+        struct TraceEvent
+        {
+            const ModuleTimer* timer;
+            unsigned int thread;
+            uint64_t start;
+            uint64_t duration;
+        };
+
+        struct TraceBuffer
+        {
+            unsigned int thread;
+            std::vector<TraceEvent> events;
+        };
+
+        struct Settings
+        {
+            bool enabled;
+            std::string traceFile;
+            bool countAllocations;
+            Clock::time_point start;
+
+            std::mutex mutex;
+            std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+            std::vector<ModuleTimer*> timers;
+            unsigned int nReported;
+
+            Settings():
+                enabled(false),
+                countAllocations(pxlmodules_allocation_count!=nullptr),
+                start(Clock::now()),
+                nReported(0)
+            {
+                const char* timing = getenv("PXLMODULES_TIMING");
+                const char* trace = getenv("PXLMODULES_TRACE");
+                enabled = (timing and std::string(timing)!="0") or trace;
+                if (trace)
+                {
+                    traceFile = trace;
+                }
+            }
+        };
+
+        static const unsigned int MAX_TRACE_EVENTS = 1000000;
+
+        //exclusive times below SUB_BINS ns have their own bin, longer ones than 2^MAX_EXPONENT ns are in the last bin
+        static const unsigned int SUB_BINS = 16;
+        static const unsigned int MAX_EXPONENT = 40;
+        static const unsigned int N_BINS = (MAX_EXPONENT-3)*SUB_BINS;
+
+        std::string _name;
+        uint64_t _events;
+        uint64_t _exclusiveSum;
+        uint64_t _inclusiveSum;
+        uint64_t _allocations;
+        //number of events per bin of the exclusive time
+        uint64_t _histogram[N_BINS];
+
+        static Settings& getSettings()
+        {
+            static Settings settings;
+            return settings;
+        }
+
+        static TraceBuffer* getTraceBuffer()
+        {
+            static thread_local TraceBuffer* buffer = nullptr;
+            if (!buffer)
+            {
+                Settings& settings = getSettings();
+                std::lock_guard<std::mutex> lock(settings.mutex);
+                settings.traceBuffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer()));
+                buffer = settings.traceBuffers.back().get();
+                buffer->thread = settings.traceBuffers.size()-1;
+            }
+            return buffer;
+        }
+
+        static inline unsigned int getBin(uint64_t time)
+        {
+            if (time<SUB_BINS)
+            {
+                return time;
+            }
+            const unsigned int exponent = 63-__builtin_clzll(time);
+            if (exponent>=MAX_EXPONENT)
+            {
+                return N_BINS-1;
+            }
+            return (exponent-3)*SUB_BINS+((time>>(exponent-4))&(SUB_BINS-1));
+        }
+
+        static double getBinCenter(unsigned int bin)
+        {
+            if (bin<SUB_BINS)
+            {
+                return bin;
+            }
+            const unsigned int exponent = bin/SUB_BINS+3;
+            const double width = double(uint64_t(1)<<(exponent-4));
+            return double(uint64_t(1)<<exponent)+(bin%SUB_BINS+0.5)*width;
+        }
+
+        //exclusive time of the event with the given rank (0: fastest)
+        double getPercentile(uint64_t rank) const
+        {
+            uint64_t count = 0;
+            for (unsigned int bin = 0; bin < N_BINS; ++bin)
+            {
+                count += _histogram[bin];
+                if (count>rank)
+                {
+                    return getBinCenter(bin);
+                }
+            }
+            return getBinCenter(N_BINS-1);
+        }
+
+        static inline uint64_t getAllocations()
+        {
+            return getSettings().countAllocations ? pxlmodules_allocation_count() : 0;
+        }
+
+        void record(Clock::time_point start, uint64_t inclusive, uint64_t exclusive, uint64_t allocations)
+        {
+            ++_events;
+            _inclusiveSum += inclusive;
+            _exclusiveSum += exclusive;
+            _allocations += allocations;
+            ++_histogram[getBin(exclusive)];
+
+            Settings& settings = getSettings();
+            if (!settings.traceFile.empty())
+            {
+                TraceBuffer* buffer = getTraceBuffer();
+                if (buffer->events.size()<MAX_TRACE_EVENTS)
+                {
+                    const uint64_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start-settings.start).count();
+                    TraceEvent event = {this,buffer->thread,offset,inclusive};
+                    buffer->events.push_back(event);
+                }
+            }
+        }
+
+        static std::string escape(const std::string& s)
+        {
+            std::string escaped;
+            for (char c: s)
+            {
+                if (c=='"' or c=='\\')
+                {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        //called with the settings locked
+        static void writeTrace(const Settings& settings)
+        {
+            std::ofstream file(settings.traceFile.c_str());
+            if (!file)
+            {
+                fprintf(stderr,"ModuleTimer: cannot open trace file '%s'\n",settings.traceFile.c_str());
+                return;
+            }
+            file<<"{\"traceEvents\": [\n";
+            bool first = true;
+            char line[128];
+            for (const std::unique_ptr<TraceBuffer>& buffer: settings.traceBuffers)
+            {
+                for (const TraceEvent& event: buffer->events)
+                {
+                    snprintf(line,sizeof(line),"\"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",event.thread,event.start*1e-3,event.duration*1e-3);
+                    file<<(first ? "" : ",\n")<<"{\"name\": \""<<escape(event.timer->_name)<<"\", "<<line;
+                    first = false;
+                }
+            }
+            file<<"\n]}\n";
+        }
+
+        ModuleTimer(const ModuleTimer&);
+        ModuleTimer& operator=(const ModuleTimer&);
+
+    public:
+        ModuleTimer():
+            _events(0),
+            _exclusiveSum(0),
+            _inclusiveSum(0),
+            _allocations(0)
+        {
+            std::fill(_histogram,_histogram+N_BINS,0);
+            Settings& settings = getSettings();
+            std::lock_guard<std::mutex> lock(settings.mutex);
+            settings.timers.push_back(this);
+        }
+
+        ~ModuleTimer()
+        {
+            Settings& settings = getSettings();
+            std::lock_guard<std::mutex> lock(settings.mutex);
+            settings.timers.erase(std::find(settings.timers.begin(),settings.timers.end(),this));
+        }
+
+        static inline bool isEnabled()
+        {
+            return getSettings().enabled;
+        }
+
+        //name used in the summary, e.g. the module name
+        inline void setName(const std::string& name)
+        {
+            _name = name;
+        }
+
+        //prints the summary; the trace is written when all timers have reported
+        void report()
+        {
+            Settings& settings = getSettings();
+            if (!settings.enabled)
+            {
+                return;
+            }
+            if (_events>0)
+            {
+                printSummary();
+            }
+            std::lock_guard<std::mutex> lock(settings.mutex);
+            ++settings.nReported;
+            if (!settings.traceFile.empty() and settings.nReported>=settings.timers.size())
+            {
+                writeTrace(settings);
+            }
+        }
+
+        void printSummary() const
+        {
+            const double median = getPercentile(_events/2);
+            const double tail = getPercentile(std::min<uint64_t>(_events*99/100,_events-1));
+
+            char summary[512];
+            int length = snprintf(summary,sizeof(summary),
+                "ModuleTimer %-24s %10llu events, exclusive mean %9.2f us, p50 %9.2f us, p99 %9.2f us, %10.0f events/s, inclusive mean %9.2f us",
+                _name.c_str(),
+                (unsigned long long)_events,
+                1e-3*_exclusiveSum/_events,
+                1e-3*median,
+                1e-3*tail,
+                _exclusiveSum>0 ? 1e9*_events/_exclusiveSum : 0.0,
+                1e-3*_inclusiveSum/_events
+            );
+            if (getSettings().countAllocations and length>0 and length<(int)sizeof(summary))
+            {
+                snprintf(summary+length,sizeof(summary)-length,", %.1f allocations/event",1.0*_allocations/_events);
+            }
+            printf("%s\n",summary);
+        }
+
+        class Scope
+        {
+            private:
+                ModuleTimer* _timer;
+                Scope* _parent;
+                Clock::time_point _start;
+                uint64_t _childTime;
+                uint64_t _startAllocations;
+                uint64_t _childAllocations;
+
+                static Scope*& getCurrent()
+                {
+                    static thread_local Scope* current = nullptr;
+                    return current;
+                }
+
+                Scope(const Scope&);
+                Scope& operator=(const Scope&);
+
+            public:
+                Scope(ModuleTimer& timer):
+                    _timer(isEnabled() ? &timer : nullptr)
+                {
+                    if (!_timer)
+                    {
+                        return;
+                    }
+                    _parent = getCurrent();
+                    getCurrent() = this;
+                    _childTime = 0;
+                    _childAllocations = 0;
+                    _startAllocations = getAllocations();
+                    _start = Clock::now();
+                }
+
+                ~Scope()
+                {
+                    if (!_timer)
+                    {
+                        return;
+                    }
+                    const uint64_t inclusive = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-_start).count();
+                    const uint64_t allocations = getAllocations()-_startAllocations;
+                    getCurrent() = _parent;
+                    if (_parent)
+                    {
+                        _parent->_childTime += inclusive;
+                        _parent->_childAllocations += allocations;
+                    }
+                    _timer->record(_start,inclusive,inclusive-std::min(inclusive,_childTime),allocations-std::min(allocations,_childAllocations));
+                }
+        };
+};
+
+#define MODULE_TIMER_SCOPE(timer) ModuleTimer::Scope moduleTimerScope(timer)
+
+#endif
@@ -0,0 +1,200 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/InputFile.hh"
+#include "pxl/modules.hh"
+
+#include "EventSequence.hpp"
+#include "WorkQueues.hpp"
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Runs N independent clones of a module chain in parallel on the events of
+* pxlio files. Every clone is imported from the same analysis XML and has its
+* own module instances, so the members of the modules are never shared
+* between threads; the process wide state (EventIndex, EventSnapshot,
+* SystematicVariations, CutFlow, RootTreeWriter output) is thread local or
+* synchronised.
+*
+* The events are read on the main thread, numbered and distributed to one
+* queue per worker. A worker takes the oldest event of its own queue and
+* steals the oldest event of another queue if its own is empty. With ordered
+* output the RootTreeWriter clones fill the tree in input order (see
+* EventSequence.hpp); unordered output fills as soon as an event arrives.
+*
+* usage: ParallelAnalysis [-j threads] [-u] [-m module] [-s sink] analysis.xml files...
+*   -m/-s  module and sink receiving the events (default: 'input' for both)
+*   -u     unordered output
+*/
+
+static void usage(const char* program)
+{
+    fprintf(stderr,"usage: %s [-j threads] [-u] [-m module] [-s sink] analysis.xml files...\n",program);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int nThreads = std::thread::hardware_concurrency();
+    bool ordered = true;
+    std::string moduleName = "input";
+    std::string sinkName = "input";
+    std::vector<std::string> arguments;
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        const std::string arg = argv[iarg];
+        if ((arg=="-j" or arg=="-m" or arg=="-s") and iarg+1<argc)
+        {
+            const std::string value = argv[++iarg];
+            if (arg=="-j")
+            {
+                nThreads = atoi(value.c_str());
+            }
+            else if (arg=="-m")
+            {
+                moduleName = value;
+            }
+            else
+            {
+                sinkName = value;
+            }
+        }
+        else if (arg=="-u")
+        {
+            ordered = false;
+        }
+        else if (arg.size()>1 and arg[0]=='-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            arguments.push_back(arg);
+        }
+    }
+    if (arguments.size()<2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    nThreads = std::max(1u,nThreads);
+
+    pxl::Core::initialize();
+    pxl::Hep::initialize();
+    //the modules of all clones use ROOT (histograms, files, trees) from the worker threads
+    ROOT::EnableThreadSafety();
+
+    try
+    {
+        std::vector<std::unique_ptr<pxl::Analysis>> analyses;
+        std::vector<pxl::Module*> modules;
+        std::vector<pxl::Sink*> sinks;
+        for (unsigned int ithread = 0; ithread < nThreads; ++ithread)
+        {
+            analyses.push_back(std::unique_ptr<pxl::Analysis>(new pxl::Analysis()));
+            pxl::AnalysisXmlImport importer;
+            if (!importer.open(arguments[0]))
+            {
+                throw std::runtime_error("cannot open analysis '"+arguments[0]+"'");
+            }
+            importer.parseInto(analyses.back().get());
+            importer.close();
+            pxl::Module* module = analyses.back()->getModule(moduleName);
+            pxl::Sink* sink = module ? module->getSink(sinkName) : nullptr;
+            if (!sink)
+            {
+                throw std::runtime_error("no module '"+moduleName+"' with sink '"+sinkName+"' in analysis '"+arguments[0]+"'");
+            }
+            modules.push_back(module);
+            sinks.push_back(sink);
+            analyses.back()->beginJob();
+        }
+
+        EventSequence& sequence = EventSequence::get();
+        sequence.setOrdered(ordered);
+        WorkQueues<pxl::Event> queues(nThreads,64*nThreads);
+        std::atomic<bool> failed(false);
+        std::mutex errorMutex;
+        std::string error;
+
+        std::vector<std::thread> workers;
+        for (unsigned int ithread = 0; ithread < nThreads; ++ithread)
+        {
+            workers.push_back(std::thread([&,ithread]()
+            {
+                std::pair<uint64_t,pxl::Event*> item;
+                while (queues.pop(ithread,item))
+                {
+                    std::unique_ptr<pxl::Event> event(item.second);
+                    if (!failed)
+                    {
+                        try
+                        {
+                            EventSequence::setCurrent(item.first);
+                            sinks[ithread]->set(event.get());
+                            modules[ithread]->analyse(sinks[ithread]);
+                        }
+                        catch(std::exception &e)
+                        {
+                            std::lock_guard<std::mutex> lock(errorMutex);
+                            error = e.what();
+                            failed = true;
+                        }
+                    }
+                    sequence.complete(item.first);
+                }
+            }));
+        }
+
+        uint64_t nEvents = 0;
+        for (unsigned int ifile = 1; ifile < arguments.size() and !failed; ++ifile)
+        {
+            pxl::InputFile input(arguments[ifile]);
+            while (!failed)
+            {
+                std::unique_ptr<pxl::Event> event(new pxl::Event());
+                if (!input.readEvent(event.get()))
+                {
+                    break;
+                }
+                queues.push(nEvents%nThreads,nEvents,event.release());
+                ++nEvents;
+            }
+            input.close();
+        }
+        queues.close();
+        for (std::thread& worker: workers)
+        {
+            worker.join();
+        }
+
+        for (std::unique_ptr<pxl::Analysis>& analysis: analyses)
+        {
+            analysis->endJob();
+            analysis->shutdown();
+        }
+        if (failed)
+        {
+            fprintf(stderr,"%s\n",error.c_str());
+            return 1;
+        }
+        printf("processed %llu events with %u threads\n",(unsigned long long)nEvents,nThreads);
+    }
+    catch(std::exception &e)
+    {
+        fprintf(stderr,"%s\n",e.what());
+        return 1;
+    }
+    return 0;
+}
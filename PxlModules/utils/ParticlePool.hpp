@@ -0,0 +1,133 @@
+#ifndef __PARTICLEPOOL_H__
+#define __PARTICLEPOOL_H__
+
+#include "pxl/hep.hh"
+
+#include <cstddef>
+#include <new>
+
+/*
+* pxl::Particle whose memory is recycled through a per thread free list
+* instead of going back to the heap. The reconstruction modules create their
+* particles (neutrinos, W bosons, tops, CM systems, clones of the input
+* objects) as PooledParticle; when the event is released the owning event
+* view deletes them as usual and the class specific operator delete keeps
+* the block for the next event processed on the thread. In steady state no
+* heap allocation is left for the particle objects themselves. The user
+* records (a map node and a key string per record), the relation sets of
+* linked particles and the object owner of the event view are not pooled and
+* still allocate; benchmarks/ParticleAllocations counts both per event.
+*
+* Only blocks of exactly sizeof(PooledParticle) are recycled. This relies on
+* the size passed to the sized operator delete being the size of the
+* allocated object: the event view deletes through pxl::Particle*, whose
+* virtual destructor makes the deleting destructor of the dynamic type pass
+* its size. A class derived from PooledParticle gets a different size and
+* goes to the heap in both operator new and delete; deleting a
+* PooledParticle through a pointer to a base without virtual destructor
+* would pass the wrong size and is not allowed.
+*
+* A PooledParticle is a pxl::Particle for all purposes: it adds no data, has
+* the type id of pxl::Particle and is written and read back as such. Blocks
+* freed on another thread (e.g. an event released by a different worker) go
+* to the free list of that thread; each list keeps at most MAX_FREE blocks.
+*/
+class PooledParticle:
+    public pxl::Particle
+{
+    private:
+        static const size_t MAX_FREE = 4096;
+
+        struct Block
+        {
+            Block* next;
+        };
+
+        //trivially destructible so that it is usable during the destruction of other thread locals
+        struct FreeList
+        {
+            Block* head;
+            size_t size;
+            bool closed;
+        };
+
+        //returns the blocks to the heap at thread exit
+        struct Drain
+        {
+            ~Drain()
+            {
+                FreeList& list = getFreeList();
+                while (list.head)
+                {
+                    Block* block = list.head;
+                    list.head = block->next;
+                    ::operator delete(block);
+                }
+                list.size = 0;
+                list.closed = true;
+            }
+        };
+
+        static inline FreeList& getFreeList()
+        {
+            static thread_local FreeList list = {nullptr,0,false};
+            return list;
+        }
+
+    public:
+        PooledParticle():
+            pxl::Particle()
+        {
+        }
+
+        //copy of the four vector, charge, PDG number and user records; as pxl::Particle::clone
+        explicit PooledParticle(const pxl::Particle& original):
+            pxl::Particle(original)
+        {
+        }
+
+        virtual pxl::Serializable* clone() const
+        {
+            return new PooledParticle(*this);
+        }
+
+        static void* operator new(size_t size)
+        {
+            FreeList& list = getFreeList();
+            if (size!=sizeof(PooledParticle) or !list.head)
+            {
+                return ::operator new(size);
+            }
+            Block* block = list.head;
+            list.head = block->next;
+            --list.size;
+            return block;
+        }
+
+        static void operator delete(void* pointer, size_t size)
+        {
+            if (!pointer)
+            {
+                return;
+            }
+            FreeList& list = getFreeList();
+            if (size!=sizeof(PooledParticle) or list.closed or list.size>=MAX_FREE)
+            {
+                ::operator delete(pointer);
+                return;
+            }
+            static thread_local Drain drain;
+            Block* block = static_cast<Block*>(pointer);
+            block->next = list.head;
+            list.head = block;
+            ++list.size;
+        }
+
+        //number of blocks kept by the calling thread
+        static size_t getNFree()
+        {
+            return getFreeList().size;
+        }
+};
+
+#endif
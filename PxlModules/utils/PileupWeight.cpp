@@ -0,0 +1,249 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "BinnedTable.hpp"
+#include "UserRecordKey.hpp"
+#include "ModuleTimer.hpp"
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+static pxl::Logger logger("PileupWeight");
+
+/*
+* Event weight from the ratio of the pileup distribution in data to the one
+* of the simulation as function of the true number of interactions. The data
+* profiles (nominal and with the minimum bias cross section varied down/up)
+* and the MC profile are normalised and divided once in beginJob; the bins of
+* the ratio table are found by direct index for the usual equidistant binning.
+* Events without the true number of interactions (e.g. data) get weight 1.
+*/
+class PileupWeight:
+    public pxl::Module
+{
+    private:
+        enum Variation
+        {
+            NOMINAL=0,DOWN,UP,NVARIATIONS
+        };
+
+        pxl::Source* _outputSource;
+
+        std::string _dataFile;
+        std::string _dataDownFile;
+        std::string _dataUpFile;
+        std::string _dataHistogramName;
+        std::string _mcFile;
+        std::string _mcHistogramName;
+        std::string _trueInteractionsField;
+        std::string _weightName;
+
+        UserRecordKey _trueInteractionsKey;
+        BinnedTable _ratios;
+        std::string _weightNames[NVARIATIONS];
+
+        ModuleTimer _timer;
+
+        struct Profile
+        {
+            std::vector<double> edges;
+            std::vector<double> contents;
+        };
+
+        //normalised bin contents of the histogram without under- and overflow
+        static Profile readProfile(const std::string& fileName, const std::string& histogramName)
+        {
+            std::unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+            if (!file or file->IsZombie())
+            {
+                throw std::runtime_error("cannot open file '"+fileName+"'");
+            }
+            TH1* histogram = dynamic_cast<TH1*>(file->Get(histogramName.c_str()));
+            if (!histogram or histogram->GetDimension()!=1)
+            {
+                throw std::runtime_error("no 1D histogram '"+histogramName+"' in file '"+fileName+"'");
+            }
+            TAxis* axis = histogram->GetXaxis();
+            Profile profile;
+            double sum = 0;
+            for (int ibin = 1; ibin <= axis->GetNbins(); ++ibin)
+            {
+                profile.edges.push_back(axis->GetBinLowEdge(ibin));
+                profile.contents.push_back(histogram->GetBinContent(ibin));
+                sum += profile.contents.back();
+            }
+            profile.edges.push_back(axis->GetBinUpEdge(axis->GetNbins()));
+            if (not (sum>0))
+            {
+                throw std::runtime_error("histogram '"+histogramName+"' in file '"+fileName+"' is empty");
+            }
+            for (double& content: profile.contents)
+            {
+                content /= sum;
+            }
+            return profile;
+        }
+
+    public:
+        PileupWeight():
+            Module(),
+            _dataHistogramName("pileup"),
+            _mcHistogramName("pileup"),
+            _trueInteractionsField("nTrueInteractions"),
+            _weightName("pu_weight")
+        {
+            addSink("input", "input");
+            _outputSource = addSource("output","output");
+
+            addOption("data file","ROOT file with the pileup distribution in data",_dataFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("data down file","ROOT file with the pileup distribution in data for the down variation of the minimum bias cross section",_dataDownFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("data up file","ROOT file with the pileup distribution in data for the up variation of the minimum bias cross section",_dataUpFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("data histogram","name of the histogram in the data files",_dataHistogramName);
+            addOption("MC file","ROOT file with the pileup distribution of the simulation; needs the same binning as the data",_mcFile,pxl::OptionDescription::USAGE_FILE_OPEN);
+            addOption("MC histogram","name of the histogram in the MC file",_mcHistogramName);
+            addOption("true interactions field","event user record with the true number of interactions",_trueInteractionsField);
+            addOption("weight name","name of the event user record; the variations get the suffixes _down and _up",_weightName);
+        }
+
+        ~PileupWeight()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("PileupWeight");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("data file",_dataFile);
+            getOption("data down file",_dataDownFile);
+            getOption("data up file",_dataUpFile);
+            getOption("data histogram",_dataHistogramName);
+            getOption("MC file",_mcFile);
+            getOption("MC histogram",_mcHistogramName);
+            getOption("true interactions field",_trueInteractionsField);
+            getOption("weight name",_weightName);
+
+            _trueInteractionsKey = UserRecordKey(_trueInteractionsField);
+
+            _weightNames[NOMINAL] = _weightName;
+            _weightNames[DOWN] = _weightName+"_down";
+            _weightNames[UP] = _weightName+"_up";
+
+            try
+            {
+                const Profile mc = readProfile(_mcFile,_mcHistogramName);
+                //the variations fall back to the nominal profile if no file is given
+                const std::string dataFiles[NVARIATIONS] = {
+                    _dataFile,
+                    _dataDownFile.empty() ? _dataFile : _dataDownFile,
+                    _dataUpFile.empty() ? _dataFile : _dataUpFile
+                };
+                std::vector<BinnedTable::Axis> axes(1,BinnedTable::Axis(mc.edges));
+                _ratios = BinnedTable(axes,NVARIATIONS);
+                for (unsigned int ivariation = 0; ivariation < NVARIATIONS; ++ivariation)
+                {
+                    const Profile data = readProfile(dataFiles[ivariation],_dataHistogramName);
+                    if (data.edges!=mc.edges)
+                    {
+                        throw std::runtime_error("binning of the data profile in '"+dataFiles[ivariation]+"' differs from the MC profile");
+                    }
+                    for (unsigned int ibin = 0; ibin < mc.contents.size(); ++ibin)
+                    {
+                        _ratios.getValues(ibin)[ivariation] = mc.contents[ibin]>0 ? data.contents[ibin]/mc.contents[ibin] : 0.0;
+                    }
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    const pxl::Variant* trueInteractions = _trueInteractionsKey.find(event);
+                    if (trueInteractions)
+                    {
+                        const double* weights = _ratios.lookup(trueInteractions->toDouble());
+                        for (unsigned int ivariation = 0; ivariation < NVARIATIONS; ++ivariation)
+                        {
+                            event->setUserRecord(_weightNames[ivariation],weights[ivariation]);
+                        }
+                    }
+                    else
+                    {
+                        for (unsigned int ivariation = 0; ivariation < NVARIATIONS; ++ivariation)
+                        {
+                            event->setUserRecord(_weightNames[ivariation],1.0);
+                        }
+                    }
+
+                    _outputSource->setTargets(event);
+                    return _outputSource->processTargets();
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(PileupWeight)
+PXL_PLUGIN_INIT
@@ -0,0 +1,304 @@
+#ifndef __PXLIOINDEX_H__
+#define __PXLIOINDEX_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+* Sidecar index of the events of a pxlio file, written by PxlioIndexer next to
+* the file as '<file>.idx'. Per event it stores the position of the event in
+* the object sequence of the file (the number of objects before it), the
+* process name and the values of selected event user records, so that an
+* input module can select events and seek to them without deserialising the
+* events in between. The pxlio file itself is not changed.
+*
+* The index is a binary file which is mapped into memory when reading:
+*
+*   header (magic, version, number of entries/records/processes, size and
+*           modification time of the pxlio file)
+*   entries (object number, process number, record values as double)
+*   string table (process names, then record names; length prefixed)
+*
+* A changed size or modification time of the pxlio file invalidates the
+* index.
+*/
+class PxlioIndex
+{
+    public:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t nRecords;
+            uint64_t nEntries;
+            uint64_t nProcesses;
+            uint64_t fileSize;
+            int64_t fileTime;
+        };
+
+        struct Entry
+        {
+            uint64_t object;
+            uint32_t process;
+            uint32_t reserved;
+            //followed by nRecords doubles
+        };
+
+        static const uint32_t VERSION = 1;
+
+        //collects the entries while indexing a file
+        class Writer
+        {
+            private:
+                std::vector<std::string> _recordNames;
+                std::vector<std::string> _processNames;
+                std::map<std::string,uint32_t> _processes;
+                std::vector<char> _entries;
+                uint64_t _nEntries;
+
+            public:
+                Writer(const std::vector<std::string>& recordNames):
+                    _recordNames(recordNames),
+                    _nEntries(0)
+                {
+                }
+
+                //record values which are not available have to be NaN
+                void add(uint64_t object, const std::string& processName, const std::vector<double>& records)
+                {
+                    auto it = _processes.find(processName);
+                    if (it==_processes.end())
+                    {
+                        it = _processes.insert(std::make_pair(processName,uint32_t(_processNames.size()))).first;
+                        _processNames.push_back(processName);
+                    }
+                    Entry entry = {object,it->second,0};
+                    const char* begin = reinterpret_cast<const char*>(&entry);
+                    _entries.insert(_entries.end(),begin,begin+sizeof(Entry));
+                    for (unsigned int irecord = 0; irecord < _recordNames.size(); ++irecord)
+                    {
+                        const double value = irecord<records.size() ? records[irecord] : NAN;
+                        const char* data = reinterpret_cast<const char*>(&value);
+                        _entries.insert(_entries.end(),data,data+sizeof(double));
+                    }
+                    ++_nEntries;
+                }
+
+                void write(const std::string& indexFileName, const std::string& fileName) const
+                {
+                    struct stat info;
+                    if (stat(fileName.c_str(),&info)!=0)
+                    {
+                        throw std::runtime_error("cannot stat '"+fileName+"'");
+                    }
+                    Header header;
+                    memset(&header,0,sizeof(Header));
+                    memcpy(header.magic,"PXLIDX\0\0",8);
+                    header.version = VERSION;
+                    header.nRecords = _recordNames.size();
+                    header.nEntries = _nEntries;
+                    header.nProcesses = _processNames.size();
+                    header.fileSize = info.st_size;
+                    header.fileTime = info.st_mtime;
+
+                    //written to a temporary file and renamed so that readers never see a partial index
+                    const std::string temporaryName = indexFileName+".tmp";
+                    std::ofstream file(temporaryName.c_str(),std::ios::binary);
+                    file.write(reinterpret_cast<const char*>(&header),sizeof(Header));
+                    file.write(_entries.data(),_entries.size());
+                    for (const std::vector<std::string>* names: {&_processNames,&_recordNames})
+                    {
+                        for (const std::string& name: *names)
+                        {
+                            const uint32_t length = name.size();
+                            file.write(reinterpret_cast<const char*>(&length),sizeof(uint32_t));
+                            file.write(name.data(),length);
+                        }
+                    }
+                    file.close();
+                    if (!file or rename(temporaryName.c_str(),indexFileName.c_str())!=0)
+                    {
+                        unlink(temporaryName.c_str());
+                        throw std::runtime_error("cannot write index '"+indexFileName+"'");
+                    }
+                }
+        };
+
+    private:
+        const char* _data;
+        size_t _size;
+        const Header* _header;
+        size_t _entrySize;
+        std::vector<std::string> _processNames;
+        std::vector<std::string> _recordNames;
+
+        PxlioIndex(const PxlioIndex&);
+        PxlioIndex& operator=(const PxlioIndex&);
+
+        void unmap()
+        {
+            if (_data)
+            {
+                munmap(const_cast<char*>(_data),_size);
+            }
+            _data = nullptr;
+            _size = 0;
+            _header = nullptr;
+        }
+
+        inline const Entry* getEntry(uint64_t ientry) const
+        {
+            return reinterpret_cast<const Entry*>(_data+sizeof(Header)+ientry*_entrySize);
+        }
+
+    public:
+        PxlioIndex():
+            _data(nullptr),
+            _size(0),
+            _header(nullptr),
+            _entrySize(0)
+        {
+        }
+
+        ~PxlioIndex()
+        {
+            unmap();
+        }
+
+        static std::string getIndexFileName(const std::string& fileName)
+        {
+            return fileName+".idx";
+        }
+
+        //maps the index of the pxlio file; throws if it is missing, corrupt or outdated
+        void open(const std::string& fileName)
+        {
+            unmap();
+            _processNames.clear();
+            _recordNames.clear();
+            const std::string indexFileName = getIndexFileName(fileName);
+            const int fd = ::open(indexFileName.c_str(),O_RDONLY);
+            if (fd<0)
+            {
+                throw std::runtime_error("no index '"+indexFileName+"'; run PxlioIndexer first");
+            }
+            struct stat info;
+            if (fstat(fd,&info)!=0 or size_t(info.st_size)<sizeof(Header))
+            {
+                ::close(fd);
+                throw std::runtime_error("invalid index '"+indexFileName+"'");
+            }
+            _size = info.st_size;
+            void* data = mmap(nullptr,_size,PROT_READ,MAP_PRIVATE,fd,0);
+            ::close(fd);
+            if (data==MAP_FAILED)
+            {
+                _size = 0;
+                throw std::runtime_error("cannot map index '"+indexFileName+"'");
+            }
+            _data = static_cast<const char*>(data);
+            _header = reinterpret_cast<const Header*>(_data);
+            _entrySize = sizeof(Entry)+_header->nRecords*sizeof(double);
+
+            if (memcmp(_header->magic,"PXLIDX\0\0",8)!=0 or _header->version!=VERSION
+                or sizeof(Header)+_header->nEntries*_entrySize>_size)
+            {
+                unmap();
+                throw std::runtime_error("invalid index '"+indexFileName+"'");
+            }
+            struct stat fileInfo;
+            if (stat(fileName.c_str(),&fileInfo)!=0 or uint64_t(fileInfo.st_size)!=_header->fileSize or int64_t(fileInfo.st_mtime)!=_header->fileTime)
+            {
+                unmap();
+                throw std::runtime_error("index '"+indexFileName+"' does not match '"+fileName+"'; run PxlioIndexer again");
+            }
+
+            const char* position = _data+sizeof(Header)+_header->nEntries*_entrySize;
+            const char* end = _data+_size;
+            for (uint64_t iname = 0; iname < _header->nProcesses+_header->nRecords; ++iname)
+            {
+                uint32_t length = 0;
+                if (position+sizeof(uint32_t)>end)
+                {
+                    unmap();
+                    throw std::runtime_error("invalid index '"+indexFileName+"'");
+                }
+                memcpy(&length,position,sizeof(uint32_t));
+                position += sizeof(uint32_t);
+                if (position+length>end)
+                {
+                    unmap();
+                    throw std::runtime_error("invalid index '"+indexFileName+"'");
+                }
+                (iname<_header->nProcesses ? _processNames : _recordNames).push_back(std::string(position,length));
+                position += length;
+            }
+        }
+
+        inline uint64_t getNEntries() const
+        {
+            return _header ? _header->nEntries : 0;
+        }
+
+        //number of objects before the event in the pxlio file
+        inline uint64_t getObject(uint64_t ientry) const
+        {
+            return getEntry(ientry)->object;
+        }
+
+        inline uint32_t getProcess(uint64_t ientry) const
+        {
+            return getEntry(ientry)->process;
+        }
+
+        inline const std::string& getProcessName(uint64_t ientry) const
+        {
+            return _processNames[getProcess(ientry)];
+        }
+
+        inline const std::vector<std::string>& getProcessNames() const
+        {
+            return _processNames;
+        }
+
+        inline const std::vector<std::string>& getRecordNames() const
+        {
+            return _recordNames;
+        }
+
+        //-1 if the record was not indexed
+        int findRecord(const std::string& name) const
+        {
+            for (unsigned int irecord = 0; irecord < _recordNames.size(); ++irecord)
+            {
+                if (_recordNames[irecord]==name)
+                {
+                    return irecord;
+                }
+            }
+            return -1;
+        }
+
+        //NaN if the event has no such record
+        inline double getRecord(uint64_t ientry, unsigned int irecord) const
+        {
+            double value;
+            memcpy(&value,reinterpret_cast<const char*>(getEntry(ientry)+1)+irecord*sizeof(double),sizeof(double));
+            return value;
+        }
+};
+
+#endif
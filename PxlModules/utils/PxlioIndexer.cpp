@@ -0,0 +1,162 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/InputFile.hh"
+
+#include "PxlioIndex.hpp"
+#include "UserRecordKey.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Writes the sidecar index '<file>.idx' (see PxlioIndex.hpp) for each pxlio
+* file: the position of every event in the object sequence of the file, its
+* process name and the values of the selected event user records. Records
+* which are missing or not numeric are stored as NaN. The events are read
+* once; the pxlio files are not modified. Files are processed in parallel.
+*
+* usage: PxlioIndexer [-j threads] [-p process record] [-r record]... files...
+*/
+
+struct Configuration
+{
+    UserRecordKey processKey;
+    std::vector<std::string> recordNames;
+    std::vector<UserRecordKey> recordKeys;
+};
+
+static uint64_t indexFile(const Configuration& configuration, const std::string& fileName)
+{
+    PxlioIndex::Writer writer(configuration.recordNames);
+    pxl::InputFile input(fileName);
+    std::vector<double> records(configuration.recordKeys.size());
+    uint64_t nObjects = 0;
+    uint64_t nEvents = 0;
+    while (true)
+    {
+        std::unique_ptr<pxl::Serializable> object(input.readNextObject());
+        if (!object)
+        {
+            break;
+        }
+        const pxl::Event* event = dynamic_cast<const pxl::Event*>(object.get());
+        if (event)
+        {
+            const pxl::Variant* process = configuration.processKey.find(event);
+            for (unsigned int irecord = 0; irecord < records.size(); ++irecord)
+            {
+                records[irecord] = NAN;
+                const pxl::Variant* value = configuration.recordKeys[irecord].find(event);
+                if (value)
+                {
+                    try
+                    {
+                        records[irecord] = value->toDouble();
+                    }
+                    catch(std::exception &e)
+                    {
+                    }
+                }
+            }
+            writer.add(nObjects,process ? process->asString() : "",records);
+            ++nEvents;
+        }
+        ++nObjects;
+    }
+    input.close();
+    writer.write(PxlioIndex::getIndexFileName(fileName),fileName);
+    return nEvents;
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr,"usage: %s [-j threads] [-p process record] [-r record]... files...\n",program);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int nThreads = std::thread::hardware_concurrency();
+    Configuration configuration;
+    std::string processRecord = "ProcessName";
+    std::vector<std::string> files;
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        const std::string arg = argv[iarg];
+        if ((arg=="-j" or arg=="-p" or arg=="-r") and iarg+1<argc)
+        {
+            const std::string value = argv[++iarg];
+            if (arg=="-j")
+            {
+                nThreads = atoi(value.c_str());
+            }
+            else if (arg=="-p")
+            {
+                processRecord = value;
+            }
+            else
+            {
+                configuration.recordNames.push_back(value);
+                configuration.recordKeys.push_back(UserRecordKey(value));
+            }
+        }
+        else if (arg.size()>1 and arg[0]=='-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    nThreads = std::max(1u,std::min<unsigned int>(nThreads,files.size()));
+    configuration.processKey = UserRecordKey(processRecord);
+
+    pxl::Core::initialize();
+    pxl::Hep::initialize();
+
+    std::atomic<unsigned int> nextFile(0);
+    std::mutex outputMutex;
+    bool failed = false;
+    std::vector<std::thread> threads;
+    for (unsigned int ithread = 0; ithread < nThreads; ++ithread)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (unsigned int ifile = nextFile++; ifile < files.size(); ifile = nextFile++)
+            {
+                try
+                {
+                    const uint64_t nEvents = indexFile(configuration,files[ifile]);
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    printf("%s: %llu events\n",files[ifile].c_str(),(unsigned long long)nEvents);
+                }
+                catch(std::exception &e)
+                {
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    fprintf(stderr,"%s: %s\n",files[ifile].c_str(),e.what());
+                    failed = true;
+                }
+            }
+        }));
+    }
+    for (std::thread& thread: threads)
+    {
+        thread.join();
+    }
+    return failed ? 1 : 0;
+}
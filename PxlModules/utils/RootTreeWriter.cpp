@@ -6,6 +6,9 @@
 #include "pxl/modules/ModuleFactory.hh"
 
 #include "OutputStore.hpp"
+#include "SyntaxTree.hpp"
+#include "EventSequence.hpp"
+#include "ModuleTimer.hpp"
 
 #include <vector>
 #include <string>
@@ -13,226 +16,11 @@
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 
 static pxl::Logger logger("RootTreeWriter");
 
-
-class SyntaxNode
-{
-    private:
-        SyntaxNode* _parent;
-        std::vector<SyntaxNode*> _children;
-        const std::string _field;
-    public:
-
-        SyntaxNode(const std::string& field="", SyntaxNode* parent=nullptr):
-            _field(field),
-            _parent(parent)
-        {
-        }
-        
-        inline const std::string& getField() const
-        {
-            return _field;
-        }
-        
-        inline void print(unsigned int ident=0) const
-        {
-            for (unsigned int i = 0; i < ident; ++i)
-            {
-                std::cout<<" - ";
-            }
-            std::cout<<_field<<std::endl;
-            for (SyntaxNode* child: _children)
-            {
-                child->print(ident+1);
-            }
-        }
-        
-        void buildTree(const std::string& s)
-        {
-            std::string::size_type pos = s.find("->");
-            std::string childField = "";
-            if (pos!=std::string::npos)
-            {
-                childField = s.substr(0,pos);
-            }
-            else
-            {
-                childField=s;
-            }
-            SyntaxNode* foundChild = nullptr;
-            for (SyntaxNode* child: _children)
-            {
-                if (child->getField()==childField)
-                {
-                    foundChild=child;
-                    break;
-                }
-            }
-
-            if (!foundChild)
-            {
-                foundChild = new SyntaxNode(childField,this);
-                _children.push_back(foundChild);
-            }
-            if (pos!=std::string::npos)
-            {
-                foundChild->buildTree(s.substr(pos+2));
-            }
-        }
-        
-        template<class TYPE>
-        void evaluateChildren(const TYPE* object, Tree* tree, const std::string& prefix)
-        {
-            for (SyntaxNode* child: _children)
-            {
-                child->evaluate(object,tree,prefix);
-            }
-        }
-        
-        void evaluate(const pxl::Event* event, Tree* tree, const std::string& prefix)
-        {
-            std::vector<pxl::EventView*> eventViews;
-            event->getObjectsOfType(eventViews);
-            unsigned int multiplicity = 1;
-            for (pxl::EventView* eventView: eventViews)
-            {
-                if (eventView->getName()==_field)
-                {
-                    evaluateChildren(eventView,tree,prefix+getField()+"_"+std::to_string(multiplicity)+"__");
-                    ++multiplicity;
-                }
-            }
-            parseUserRecords(&event->getUserRecords(),tree,prefix);
-
-        }
-        
-        void evaluate(const pxl::EventView* eventView, Tree* tree, const std::string& prefix)
-        {
-            std::vector<pxl::Particle*> particles;
-            eventView->getObjectsOfType(particles);
-            unsigned int multiplicity = 1;
-            for (pxl::Particle* particle: particles)
-            {
-                if (particle->getName()==_field)
-                {
-                    evaluateChildren(particle,tree,prefix+getField()+"_"+std::to_string(multiplicity)+"__");
-                    ++multiplicity;
-                }
-            }
-            parseUserRecords(&eventView->getUserRecords(),tree,prefix);
-        }
-
-        void evaluate(const pxl::Particle* particle, Tree* tree, const std::string& prefix)
-        {
-            const static std::map<std::string,std::function<float(const pxl::Particle* particle)>> fct = {
-                {"Pt",[](const pxl::Particle* particle){ return particle->getPt();}},
-                {"Eta",[](const pxl::Particle* particle){ return particle->getEta();}},
-                {"Phi",[](const pxl::Particle* particle){ return particle->getPhi();}},
-                {"E",[](const pxl::Particle* particle){ return particle->getE();}},
-                {"P",[](const pxl::Particle* particle){ return particle->getP();}},
-                {"Mass",[](const pxl::Particle* particle){ return particle->getMass();}},
-                {"Px",[](const pxl::Particle* particle){ return particle->getPx();}},
-                {"Py",[](const pxl::Particle* particle){ return particle->getPy();}},
-                {"Pz",[](const pxl::Particle* particle){ return particle->getPz();}}
-            };
-            if (getField()=="ALL" or getField()=="KIN")
-            {
-                for (auto it: fct)
-                {
-                    tree->storeVariable(prefix+it.first,it.second(particle));
-                }
-            }
-            else
-            {
-                auto it = fct.find(getField());
-                if (it!=fct.end())
-                {
-                    tree->storeVariable(prefix+getField(),it->second(particle));
-                }
-            }
-
-            parseUserRecords(&particle->getUserRecords(),tree,prefix);
-        }
-
-        void parseUserRecords(const pxl::UserRecords* ur, Tree* tree, const std::string& prefix)
-        {
-            if (getField()=="ALL" or getField()=="UR")
-            {
-                for (auto it: *ur->getContainer())
-                {
-                    std::string urName=it.first;
-                    std::replace(urName.begin(), urName.end(), ' ', '_');
-                    std::replace(urName.begin(), urName.end(), ':', '_');
-                    tree->storeVariable(prefix+urName,it.second);
-                }
-            }
-        }
-};
-
-
-class SyntaxTree
-{
-    public:
-        std::vector<SyntaxNode*> _children;
-    public:
-
-        SyntaxTree()
-        {
-        }
-        
-        void evaluate(pxl::Event* event, Tree* tree)
-        {
-            for (SyntaxNode* child: _children)
-            {
-                child->evaluate(event,tree,"");
-            }
-        }
-
-        inline void print() const
-        {
-            for (SyntaxNode* child: _children)
-            {
-                child->print();
-            }
-        }
-       
-
-        void buildTree(const std::string& s)
-        {
-            std::string::size_type pos = s.find("->");
-            std::string childField = "";
-            if (pos!=std::string::npos)
-            {
-                childField = s.substr(0,pos);
-            }
-            else
-            {
-                childField=s;
-            }
-            SyntaxNode* foundChild = nullptr;
-            for (SyntaxNode* child: _children)
-            {
-                if (child->getField()==childField)
-                {
-                    foundChild=child;
-                    break;
-                }
-            }
-
-            if (!foundChild)
-            {
-                foundChild = new SyntaxNode(childField);
-                _children.push_back(foundChild);
-            }
-            if (pos!=std::string::npos)
-            {
-                foundChild->buildTree(s.substr(pos+2));
-            }
-        }
-};
-
 /*
 #include <boost/spirit/include/qi.hpp>
 
@@ -279,6 +67,47 @@ class AccessorGrammar:
 
 
 
+/*
+* Clones of the writer in parallel copies of the module chain (see
+* ParallelAnalysis.cpp) write into one store per output file. Filling is
+* serialised by the mutex; the last user closes the file.
+*/
+struct SharedOutput
+{
+    std::mutex mutex;
+    OutputStore* store;
+    unsigned int users;
+    
+    static std::shared_ptr<SharedOutput> open(const std::string& fileName)
+    {
+        static std::mutex registryMutex;
+        static std::map<std::string,std::weak_ptr<SharedOutput>> outputs;
+        std::lock_guard<std::mutex> registryLock(registryMutex);
+        std::shared_ptr<SharedOutput> output = outputs[fileName].lock();
+        if (!output)
+        {
+            output.reset(new SharedOutput());
+            output->store = new OutputStore(fileName);
+            output->users = 0;
+            outputs[fileName] = output;
+        }
+        std::lock_guard<std::mutex> lock(output->mutex);
+        ++output->users;
+        return output;
+    }
+    
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--users==0)
+        {
+            store->close();
+            delete store;
+            store = nullptr;
+        }
+    }
+};
+
 class RootTreeWriter:
     public pxl::Module
 {
@@ -287,16 +116,17 @@ class RootTreeWriter:
         
         std::string _outputFileName;
         
-        OutputStore* _store;
+        std::shared_ptr<SharedOutput> _output;
         
         std::vector<std::string> _selections;
         
         SyntaxTree* _syntaxTree;
         
+        ModuleTimer _timer;
+
     public:
         RootTreeWriter():
             Module(),
-            _store(nullptr),
             _syntaxTree(nullptr)
         {
             addSink("input", "input");
@@ -336,8 +166,9 @@ class RootTreeWriter:
 
         void beginJob() throw (std::runtime_error)
         {
+            _timer.setName(getName());
             getOption("root file",_outputFileName);
-            _store = new OutputStore(_outputFileName);
+            _output = SharedOutput::open(_outputFileName);
             _syntaxTree = new SyntaxTree();
             getOption("variables",_selections);
             for (const std::string& s: _selections)
@@ -349,12 +180,15 @@ class RootTreeWriter:
 
         bool analyse(pxl::Sink *sink) throw (std::runtime_error)
         {
+            MODULE_TIMER_SCOPE(_timer);
             try
             {
                 pxl::Event *event  = dynamic_cast<pxl::Event *> (sink->get());
                 if (event)
                 {
-                    Tree* tree = _store->getTree(event->getUserRecord("ProcessName"));
+                    EventSequence::get().waitForTurn();
+                    std::unique_lock<std::mutex> lock(_output->mutex);
+                    Tree* tree = _output->store->getTree(event->getUserRecord("ProcessName"));
                     //tree->storeVariable("event_number",(int)event->getUserRecord("Event number").asUInt64());
                     _syntaxTree->evaluate(event,tree);
                     /*
@@ -381,6 +215,7 @@ class RootTreeWriter:
                     }
                     */
                     tree->fill();
+                    lock.unlock();
                     
                      _outputSource->setTargets(event);
                     return _outputSource->processTargets();
@@ -401,10 +236,11 @@ class RootTreeWriter:
         
         void endJob()
         {
-            if (_store)
+            _timer.report();
+            if (_output)
             {
-                _store->close();
-                delete _store;
+                _output->close();
+                _output.reset();
             }
         }
 
@@ -0,0 +1,233 @@
+#ifndef __SCALEFACTORTABLE_H__
+#define __SCALEFACTORTABLE_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "BinnedTable.hpp"
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <array>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* Scale factors binned in pt, eta or |eta| of a particle, e.g. of a lepton
+* ID, isolation or trigger. The TH1/TH2/TH3 holding the scale factors (bin
+* content) and their uncertainties (bin error) is copied once into a flat
+* BinnedTable and shared by all users of the same file and histogram in the
+* process. A lookup returns the nominal, down and up values in a fixed size
+* array without allocating; particles outside of the histogram get the values
+* of the closest bin.
+*
+* A table is defined by 'file:histogram:variables' with one variable per axis
+* of the histogram, e.g. 'MuonID.root:TightID/abseta_pt:abseta,pt'. The
+* histogram and the variables are taken from the right, hence the file name
+* may contain colons (e.g. 'root://host//path/MuonID.root:...').
+*/
+class ScaleFactorTable
+{
+    public:
+        enum Variation
+        {
+            NOMINAL=0,DOWN,UP,NVARIATIONS
+        };
+
+        typedef std::array<double,NVARIATIONS> Values;
+
+        enum Variable
+        {
+            PT,ETA,ABSETA
+        };
+
+    private:
+        std::shared_ptr<const BinnedTable> _table;
+        std::vector<Variable> _variables;
+
+        static std::vector<std::string> split(const std::string& s, char delimiter)
+        {
+            std::vector<std::string> tokens;
+            std::istringstream ss(s);
+            std::string token;
+            while (std::getline(ss,token,delimiter))
+            {
+                tokens.push_back(token);
+            }
+            return tokens;
+        }
+
+        static Variable parseVariable(const std::string& name)
+        {
+            if (name=="pt")
+            {
+                return PT;
+            }
+            if (name=="eta")
+            {
+                return ETA;
+            }
+            if (name=="abseta")
+            {
+                return ABSETA;
+            }
+            throw std::runtime_error("unknown scale factor variable '"+name+"', expected pt, eta or abseta");
+        }
+
+        static std::vector<double> getEdges(const TAxis* axis)
+        {
+            std::vector<double> edges;
+            for (int ibin = 1; ibin <= axis->GetNbins(); ++ibin)
+            {
+                edges.push_back(axis->GetBinLowEdge(ibin));
+            }
+            edges.push_back(axis->GetBinUpEdge(axis->GetNbins()));
+            return edges;
+        }
+
+        static std::shared_ptr<const BinnedTable> readHistogram(const std::string& fileName, const std::string& histogramName)
+        {
+            std::unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+            if (!file or file->IsZombie())
+            {
+                throw std::runtime_error("cannot open file '"+fileName+"'");
+            }
+            TH1* histogram = dynamic_cast<TH1*>(file->Get(histogramName.c_str()));
+            if (!histogram)
+            {
+                throw std::runtime_error("no histogram '"+histogramName+"' in file '"+fileName+"'");
+            }
+
+            const unsigned int nDimensions = histogram->GetDimension();
+            TAxis* axes[3] = {histogram->GetXaxis(),histogram->GetYaxis(),histogram->GetZaxis()};
+            std::vector<BinnedTable::Axis> tableAxes;
+            for (unsigned int iaxis = 0; iaxis < nDimensions; ++iaxis)
+            {
+                tableAxes.push_back(BinnedTable::Axis(getEdges(axes[iaxis])));
+            }
+            std::shared_ptr<BinnedTable> table(new BinnedTable(tableAxes,NVARIATIONS));
+
+            //the table is ordered with the last axis varying fastest
+            int nBins[3] = {1,1,1};
+            for (unsigned int iaxis = 0; iaxis < nDimensions; ++iaxis)
+            {
+                nBins[iaxis] = axes[iaxis]->GetNbins();
+            }
+            unsigned int bin = 0;
+            for (int ix = 1; ix <= nBins[0]; ++ix)
+            {
+                for (int iy = 1; iy <= nBins[1]; ++iy)
+                {
+                    for (int iz = 1; iz <= nBins[2]; ++iz)
+                    {
+                        const int histogramBin = histogram->GetBin(ix,iy,iz);
+                        const double value = histogram->GetBinContent(histogramBin);
+                        const double error = histogram->GetBinError(histogramBin);
+                        double* values = table->getValues(bin);
+                        values[NOMINAL] = value;
+                        values[DOWN] = value-error;
+                        values[UP] = value+error;
+                        ++bin;
+                    }
+                }
+            }
+            return table;
+        }
+
+    public:
+        ScaleFactorTable()
+        {
+        }
+
+        //throws std::runtime_error if the file or histogram cannot be read
+        ScaleFactorTable(const std::string& fileName, const std::string& histogramName, const std::vector<Variable>& variables):
+            _variables(variables)
+        {
+            static std::mutex mutex;
+            static std::map<std::string,std::shared_ptr<const BinnedTable>> tables;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            std::shared_ptr<const BinnedTable>& table = tables[fileName+":"+histogramName];
+            if (!table)
+            {
+                table = readHistogram(fileName,histogramName);
+            }
+            _table = table;
+            if (_variables.size()!=_table->getNDimensions())
+            {
+                std::ostringstream message;
+                message<<"histogram '"<<histogramName<<"' has "<<_table->getNDimensions()<<" dimensions but "<<_variables.size()<<" variables are given";
+                throw std::runtime_error(message.str());
+            }
+        }
+
+        //parses 'file:histogram:variable,variable'; split from the right so that the file may contain colons (e.g. root://host//path.root)
+        static ScaleFactorTable fromDefinition(const std::string& definition)
+        {
+            const size_t last = definition.rfind(':');
+            const size_t first = (last==std::string::npos or last==0) ? std::string::npos : definition.rfind(':',last-1);
+            if (first==std::string::npos or first==0)
+            {
+                throw std::runtime_error("invalid scale factor definition '"+definition+"', expected 'file:histogram:variables'");
+            }
+            std::vector<Variable> variables;
+            for (const std::string& name: split(definition.substr(last+1),','))
+            {
+                variables.push_back(parseVariable(name));
+            }
+            return ScaleFactorTable(definition.substr(0,first),definition.substr(first+1,last-first-1),variables);
+        }
+
+        inline bool isValid() const
+        {
+            return _table.get()!=nullptr;
+        }
+
+        //nominal, down and up values
+        inline const double* lookup(const pxl::Particle* particle) const
+        {
+            double coordinates[3];
+            for (unsigned int ivariable = 0; ivariable < _variables.size(); ++ivariable)
+            {
+                switch (_variables[ivariable])
+                {
+                    case PT:
+                        coordinates[ivariable] = particle->getPt();
+                        break;
+                    case ETA:
+                        coordinates[ivariable] = particle->getEta();
+                        break;
+                    default:
+                        coordinates[ivariable] = std::fabs(particle->getEta());
+                        break;
+                }
+            }
+            return _table->lookup(coordinates);
+        }
+
+        inline Values get(const pxl::Particle* particle) const
+        {
+            const double* values = lookup(particle);
+            Values result = {{values[NOMINAL],values[DOWN],values[UP]}};
+            return result;
+        }
+
+        //multiplies each variation of the weights by the corresponding scale factor
+        inline void multiply(const pxl::Particle* particle, Values& weights) const
+        {
+            const double* values = lookup(particle);
+            for (unsigned int ivariation = 0; ivariation < NVARIATIONS; ++ivariation)
+            {
+                weights[ivariation] *= values[ivariation];
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "EventSequence.hpp"
+#include "ModuleTimer.hpp"
+
+#include "selection/TriggerExpression.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static pxl::Logger logger("SkimWriter");
+
+/*
+* Clones of the writer in parallel copies of the module chain (see
+* ParallelAnalysis.cpp) write into one file per output file name, as
+* SharedOutput of RootTreeWriter. Writing is serialised by the mutex and
+* ordered by EventSequence; the last user closes the file.
+*/
+struct SharedSkimFile
+{
+    std::mutex mutex;
+    pxl::OutputFile* file;
+    unsigned int users;
+
+    static std::shared_ptr<SharedSkimFile> open(const std::string& fileName, int64_t compressionLevel)
+    {
+        static std::mutex registryMutex;
+        static std::map<std::string,std::weak_ptr<SharedSkimFile>> files;
+        std::lock_guard<std::mutex> registryLock(registryMutex);
+        std::shared_ptr<SharedSkimFile> output = files[fileName].lock();
+        if (!output)
+        {
+            output.reset(new SharedSkimFile());
+            output->file = new pxl::OutputFile(fileName,1048576,compressionLevel);
+            output->users = 0;
+            files[fileName] = output;
+        }
+        std::lock_guard<std::mutex> lock(output->mutex);
+        ++output->users;
+        return output;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--users==0)
+        {
+            file->close();
+            delete file;
+            file = nullptr;
+        }
+    }
+};
+
+/*
+* Writes the events arriving at its sink to a pxlio file, e.g. connected to the
+* '1 iso muon' source of MuonSelection, so that later iterations of the ntuple
+* production can start from the skim instead of rerunning the selection on the
+* full input. Optionally the skim is made smaller by keeping only the listed
+* event views and particle names and by dropping user records matching the
+* given patterns (wildcards '*' and '?') from the event, the event views and
+* the particles. Pruning is done on a copy since the event is shared with the
+* other branches of the chain; without pruning the event is written as is.
+*
+* The kept event views and particles are given explicitly: they are not
+* derived from the options of the downstream modules, which are not known to
+* the writer and which would not cover later iterations of the ntuple
+* production that use other collections.
+*/
+class SkimWriter:
+    public pxl::Module
+{
+    private:
+        std::string _outputFileName;
+        std::vector<std::string> _eventViewNames;
+        std::vector<std::string> _particleNames;
+        std::vector<std::string> _dropUserRecords;
+        int64_t _compressionLevel;
+
+        std::shared_ptr<SharedSkimFile> _output;
+        uint64_t _nWritten;
+
+        ModuleTimer _timer;
+
+        static bool contains(const std::vector<std::string>& names, const std::string& name)
+        {
+            return std::find(names.begin(),names.end(),name)!=names.end();
+        }
+
+        template<class OBJECT>
+        void dropUserRecords(OBJECT* object) const
+        {
+            std::vector<std::string> dropped;
+            const pxl::UserRecords::ContainerType* container = object->getUserRecords().getContainer();
+            for (pxl::UserRecords::ContainerType::const_iterator it = container->begin(); it != container->end(); ++it)
+            {
+                for (const std::string& pattern: _dropUserRecords)
+                {
+                    if (TriggerExpression::match(pattern,it->first))
+                    {
+                        dropped.push_back(it->first);
+                        break;
+                    }
+                }
+            }
+            for (const std::string& name: dropped)
+            {
+                object->eraseUserRecord(name);
+            }
+        }
+
+        void prune(pxl::Event* event) const
+        {
+            if (not _dropUserRecords.empty())
+            {
+                dropUserRecords(event);
+            }
+            std::vector<pxl::EventView*> eventViews;
+            event->getObjectsOfType(eventViews);
+            for (pxl::EventView* eventView: eventViews)
+            {
+                if (not _eventViewNames.empty() and not contains(_eventViewNames,eventView->getName()))
+                {
+                    event->removeObject(eventView);
+                    continue;
+                }
+                if (not _dropUserRecords.empty())
+                {
+                    dropUserRecords(eventView);
+                }
+                std::vector<pxl::Particle*> particles;
+                eventView->getObjectsOfType(particles);
+                for (pxl::Particle* particle: particles)
+                {
+                    if (not _particleNames.empty() and not contains(_particleNames,particle->getName()))
+                    {
+                        eventView->removeObject(particle);
+                    }
+                    else if (not _dropUserRecords.empty())
+                    {
+                        dropUserRecords(particle);
+                    }
+                }
+            }
+        }
+
+    public:
+        SkimWriter():
+            Module(),
+            _outputFileName("skim.pxlio"),
+            _compressionLevel(6),
+            _nWritten(0)
+        {
+            addSink("input", "input");
+
+            addOption("output file","pxlio file of the skim",_outputFileName,pxl::OptionDescription::USAGE_FILE_SAVE);
+            addOption("event views","event views to keep; all if empty",_eventViewNames);
+            addOption("particles","names of the particles to keep; all if empty",_particleNames);
+            addOption("drop user records","patterns of user records to drop from the event, event views and particles",_dropUserRecords);
+            addOption("compression level","zlib compression level of the output (0-9)",_compressionLevel);
+        }
+
+        ~SkimWriter()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("SkimWriter");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module does not provide events, so return false
+            return false;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("output file",_outputFileName);
+            getOption("event views",_eventViewNames);
+            getOption("particles",_particleNames);
+            getOption("drop user records",_dropUserRecords);
+            getOption("compression level",_compressionLevel);
+
+            if (_compressionLevel<0 or _compressionLevel>9)
+            {
+                throw std::runtime_error(getName()+": compression level must be in [0,9]");
+            }
+            _output = SharedSkimFile::open(_outputFileName,_compressionLevel);
+            _nWritten = 0;
+        }
+
+        bool analyse(pxl::Sink *sink) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            try
+            {
+                pxl::Event *event  = dynamic_cast<pxl::Event*>(sink->get());
+                if (event)
+                {
+                    //pruned outside of the lock
+                    std::unique_ptr<pxl::Event> skimmed;
+                    if (not _eventViewNames.empty() or not _particleNames.empty() or not _dropUserRecords.empty())
+                    {
+                        skimmed.reset(new pxl::Event(*event));
+                        prune(skimmed.get());
+                    }
+                    EventSequence::get().waitForTurn();
+                    std::lock_guard<std::mutex> lock(_output->mutex);
+                    _output->file->writeEvent(skimmed ? skimmed.get() : event);
+                    ++_nWritten;
+                    return true;
+                }
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+
+            logger(pxl::LOG_LEVEL_ERROR , "Analysed event is not an pxl::Event !");
+            return false;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+            if (_output)
+            {
+                _output->close();
+                _output.reset();
+            }
+            logger(pxl::LOG_LEVEL_INFO,"wrote ",_nWritten," events to '",_outputFileName,"'");
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(SkimWriter)
+PXL_PLUGIN_INIT
@@ -0,0 +1,207 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/InputFile.hh"
+
+#include "UserRecordKey.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* Pre-pass over pxlio files which sums the generator weights per process for
+* the normalisation of samples with negative weights (e.g. aMC@NLO). Only the
+* process name and the generator weight are read from the event user records;
+* the files are processed in parallel and the per thread sums are merged at
+* the end. The output is the normalisation file of EventWeight with lines
+*
+*   process nEvents sumOfWeights sumOfSquaredWeights
+*
+* usage: SumOfWeights [-o output] [-j threads] [-w weight record] [-p process record] files...
+*/
+
+struct Sums
+{
+    unsigned long long nEvents;
+    double sumOfWeights;
+    double sumOfSquares;
+
+    Sums():
+        nEvents(0),
+        sumOfWeights(0),
+        sumOfSquares(0)
+    {
+    }
+};
+
+typedef std::map<std::string,Sums> ProcessSums;
+
+struct Configuration
+{
+    std::vector<std::string> files;
+    UserRecordKey weightKey;
+    UserRecordKey processKey;
+};
+
+//the generator weight is 1 if the record does not exist (e.g. for data or LO samples)
+static void sumFile(const Configuration& configuration, const std::string& fileName, ProcessSums& sums)
+{
+    pxl::InputFile input(fileName);
+    //the process name is the same for most events; keep the entry of the last one
+    std::string lastProcess;
+    Sums* entry = nullptr;
+    while (true)
+    {
+        pxl::Event event;
+        if (!input.readEvent(&event))
+        {
+            break;
+        }
+        const pxl::Variant* process = configuration.processKey.find(&event);
+        const std::string& processName = process ? process->asString() : fileName;
+        if (!entry or processName!=lastProcess)
+        {
+            lastProcess = processName;
+            entry = &sums[processName];
+        }
+        const pxl::Variant* weight = configuration.weightKey.find(&event);
+        const double value = weight ? weight->toDouble() : 1.0;
+        entry->nEvents += 1;
+        entry->sumOfWeights += value;
+        entry->sumOfSquares += value*value;
+    }
+    input.close();
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr,"usage: %s [-o output] [-j threads] [-w weight record] [-p process record] files...\n",program);
+}
+
+int main(int argc, char** argv)
+{
+    std::string outputFileName = "sumOfWeights.txt";
+    unsigned int nThreads = std::thread::hardware_concurrency();
+    std::string weightRecord = "genweight";
+    std::string processRecord = "ProcessName";
+    std::vector<std::string> files;
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        const std::string arg = argv[iarg];
+        if ((arg=="-o" or arg=="-j" or arg=="-w" or arg=="-p") and iarg+1<argc)
+        {
+            const std::string value = argv[++iarg];
+            if (arg=="-o")
+            {
+                outputFileName = value;
+            }
+            else if (arg=="-j")
+            {
+                nThreads = atoi(value.c_str());
+            }
+            else if (arg=="-w")
+            {
+                weightRecord = value;
+            }
+            else
+            {
+                processRecord = value;
+            }
+        }
+        else if (arg.size()>1 and arg[0]=='-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    nThreads = std::max(1u,std::min<unsigned int>(nThreads,files.size()));
+
+    pxl::Core::initialize();
+    pxl::Hep::initialize();
+
+    Configuration configuration;
+    configuration.files = files;
+    configuration.weightKey = UserRecordKey(weightRecord);
+    configuration.processKey = UserRecordKey(processRecord);
+
+    //files are taken from a shared counter so that large files do not stall a fixed partition
+    std::atomic<unsigned int> nextFile(0);
+    std::vector<ProcessSums> threadSums(nThreads);
+    std::mutex errorMutex;
+    std::vector<std::string> errors;
+    std::vector<std::thread> threads;
+    for (unsigned int ithread = 0; ithread < nThreads; ++ithread)
+    {
+        threads.push_back(std::thread([&,ithread]()
+        {
+            for (unsigned int ifile = nextFile++; ifile < files.size(); ifile = nextFile++)
+            {
+                try
+                {
+                    sumFile(configuration,files[ifile],threadSums[ithread]);
+                }
+                catch(std::exception &e)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    errors.push_back(files[ifile]+": "+e.what());
+                }
+            }
+        }));
+    }
+    for (std::thread& thread: threads)
+    {
+        thread.join();
+    }
+    if (!errors.empty())
+    {
+        for (const std::string& error: errors)
+        {
+            fprintf(stderr,"%s\n",error.c_str());
+        }
+        return 1;
+    }
+
+    ProcessSums sums;
+    for (const ProcessSums& partial: threadSums)
+    {
+        for (const ProcessSums::value_type& process: partial)
+        {
+            Sums& total = sums[process.first];
+            total.nEvents += process.second.nEvents;
+            total.sumOfWeights += process.second.sumOfWeights;
+            total.sumOfSquares += process.second.sumOfSquares;
+        }
+    }
+
+    std::ofstream output(outputFileName.c_str());
+    if (!output)
+    {
+        fprintf(stderr,"cannot open file '%s'\n",outputFileName.c_str());
+        return 1;
+    }
+    output<<"# process nEvents sumOfWeights sumOfSquaredWeights"<<std::endl;
+    output.precision(17);
+    for (const ProcessSums::value_type& process: sums)
+    {
+        output<<process.first<<" "<<process.second.nEvents<<" "<<process.second.sumOfWeights<<" "<<process.second.sumOfSquares<<std::endl;
+        printf("%s: %llu events, sum of weights %g\n",process.first.c_str(),process.second.nEvents,process.second.sumOfWeights);
+    }
+    return 0;
+}
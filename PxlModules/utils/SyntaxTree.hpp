@@ -0,0 +1,383 @@
+#ifndef __SYNTAXTREE_H__
+#define __SYNTAXTREE_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "OutputStore.hpp"
+#include "EventIndex.hpp"
+#include "EventSnapshot.hpp"
+#include "SystematicVariations.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+* Syntax tree of the RootTreeWriter branch expressions, e.g.
+* 'Reconstructed->SelectedJet->Pt'. Each node is an event view, particle or
+* field name; evaluate walks the event along the tree and stores the selected
+* kinematics and user records in the output tree. With systematic variations
+* the kinematics of a varied collection are stored once more per variation
+* (suffix '__<variation>') for the particles selected in that variation, so
+* that e.g. 'SelectedJet_2' of a variation is its second selected jet.
+*/
+
+struct EvaluationContext
+{
+    const EventIndex& index;
+    //kinematics are taken from the snapshot if it contains the particles
+    const EventSnapshot* snapshot;
+    //varied kinematics are stored with the variation suffixes; null without variations
+    const SystematicVariations* variations;
+    const std::vector<std::string>& suffixes;
+};
+
+typedef std::map<std::string,std::function<float(const pxl::Particle* particle)>> KinematicFunctions;
+
+inline const KinematicFunctions& getKinematicFunctions()
+{
+    const static KinematicFunctions fct = {
+        {"Pt",[](const pxl::Particle* particle){ return particle->getPt();}},
+        {"Eta",[](const pxl::Particle* particle){ return particle->getEta();}},
+        {"Phi",[](const pxl::Particle* particle){ return particle->getPhi();}},
+        {"E",[](const pxl::Particle* particle){ return particle->getE();}},
+        {"P",[](const pxl::Particle* particle){ return particle->getP();}},
+        {"Mass",[](const pxl::Particle* particle){ return particle->getMass();}},
+        {"Px",[](const pxl::Particle* particle){ return particle->getPx();}},
+        {"Py",[](const pxl::Particle* particle){ return particle->getPy();}},
+        {"Pz",[](const pxl::Particle* particle){ return particle->getPz();}}
+    };
+    return fct;
+}
+
+class SyntaxNode
+{
+    private:
+        SyntaxNode* _parent;
+        std::vector<SyntaxNode*> _children;
+        const std::string _field;
+        const EventIndex::Key _key;
+        //particles of this name selected only in some variations
+        const EventIndex::Key _variationsKey;
+        std::vector<pxl::Particle*> _variationParticles;
+    public:
+
+        SyntaxNode(const std::string& field="", SyntaxNode* parent=nullptr):
+            _field(field),
+            _key(EventIndex::intern(field)),
+            _variationsKey(EventIndex::intern(SystematicVariations::getVariationsName(field))),
+            _parent(parent)
+        {
+        }
+        
+        inline const std::string& getField() const
+        {
+            return _field;
+        }
+        
+        inline void print(unsigned int ident=0) const
+        {
+            for (unsigned int i = 0; i < ident; ++i)
+            {
+                std::cout<<" - ";
+            }
+            std::cout<<_field<<std::endl;
+            for (SyntaxNode* child: _children)
+            {
+                child->print(ident+1);
+            }
+        }
+        
+        void buildTree(const std::string& s)
+        {
+            std::string::size_type pos = s.find("->");
+            std::string childField = "";
+            if (pos!=std::string::npos)
+            {
+                childField = s.substr(0,pos);
+            }
+            else
+            {
+                childField=s;
+            }
+            SyntaxNode* foundChild = nullptr;
+            for (SyntaxNode* child: _children)
+            {
+                if (child->getField()==childField)
+                {
+                    foundChild=child;
+                    break;
+                }
+            }
+
+            if (!foundChild)
+            {
+                foundChild = new SyntaxNode(childField,this);
+                _children.push_back(foundChild);
+            }
+            if (pos!=std::string::npos)
+            {
+                foundChild->buildTree(s.substr(pos+2));
+            }
+        }
+        
+        template<class TYPE>
+        void evaluateChildren(const EvaluationContext& context, const TYPE* object, Tree* tree, const std::string& prefix)
+        {
+            for (SyntaxNode* child: _children)
+            {
+                child->evaluate(context,object,tree,prefix);
+            }
+        }
+        
+        void evaluate(const EvaluationContext& context, const pxl::Event* event, Tree* tree, const std::string& prefix)
+        {
+            const EventIndex& index = context.index;
+            unsigned int multiplicity = 1;
+            for (unsigned int ieventView = 0; ieventView < index.getNEventViews(); ++ieventView)
+            {
+                if (index.getEventViewName(ieventView)==_key)
+                {
+                    evaluateChildren(context,index.getEventView(ieventView),tree,prefix+getField()+"_"+std::to_string(multiplicity)+"__");
+                    ++multiplicity;
+                }
+            }
+            parseUserRecords(&event->getUserRecords(),tree,prefix);
+
+        }
+        
+        void evaluate(const EvaluationContext& context, const pxl::EventView* eventView, Tree* tree, const std::string& prefix)
+        {
+            const EventSnapshot::Collection* collection = context.snapshot ? context.snapshot->findCollection(eventView,_key) : nullptr;
+            if (collection)
+            {
+                for (unsigned int iparticle = 0; iparticle < collection->size(); ++iparticle)
+                {
+                    const std::string particlePrefix = prefix+getField()+"_"+std::to_string(iparticle+1)+"__";
+                    for (SyntaxNode* child: _children)
+                    {
+                        child->evaluate(context,*collection,iparticle,tree,particlePrefix);
+                    }
+                }
+            }
+            else
+            {
+                unsigned int multiplicity = 1;
+                for (pxl::Particle* particle: context.index.getParticles(eventView,_key))
+                {
+                    evaluateChildren(context,particle,tree,prefix+getField()+"_"+std::to_string(multiplicity)+"__");
+                    ++multiplicity;
+                }
+            }
+            if (context.variations and isVaried(context,eventView))
+            {
+                evaluateVariations(context,eventView,tree,prefix);
+            }
+            parseUserRecords(&eventView->getUserRecords(),tree,prefix);
+        }
+        
+        //a particle of the collection has varied kinematics or is selected only in some variations
+        bool isVaried(const EvaluationContext& context, const pxl::EventView* eventView) const
+        {
+            if (!context.index.getParticles(eventView,_variationsKey).empty())
+            {
+                return true;
+            }
+            for (const pxl::Particle* particle: context.index.getParticles(eventView,_key))
+            {
+                if (context.variations->has(particle) or SystematicVariations::getMaskKey().has(particle))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        //the collection as selected in each variation
+        void evaluateVariations(const EvaluationContext& context, const pxl::EventView* eventView, Tree* tree, const std::string& prefix)
+        {
+            for (unsigned int ivariation = 0; ivariation < context.suffixes.size(); ++ivariation)
+            {
+                _variationParticles.clear();
+                SystematicVariations::getParticles(context.index,eventView,_key,_variationsKey,ivariation,_variationParticles);
+                for (unsigned int iparticle = 0; iparticle < _variationParticles.size(); ++iparticle)
+                {
+                    const std::string particlePrefix = prefix+getField()+"_"+std::to_string(iparticle+1)+"__";
+                    for (SyntaxNode* child: _children)
+                    {
+                        child->evaluateVariation(context,_variationParticles[iparticle],ivariation,tree,particlePrefix);
+                    }
+                }
+            }
+        }
+
+        //same as for the particle but reads the kinematics from the snapshot columns
+        void evaluate(const EvaluationContext& context, const EventSnapshot::Collection& collection, unsigned int iparticle, Tree* tree, const std::string& prefix)
+        {
+            typedef std::vector<double> EventSnapshot::Collection::*Column;
+            const static std::map<std::string,Column> columns = {
+                {"Pt",&EventSnapshot::Collection::pt},
+                {"Eta",&EventSnapshot::Collection::eta},
+                {"Phi",&EventSnapshot::Collection::phi},
+                {"E",&EventSnapshot::Collection::e},
+                {"P",&EventSnapshot::Collection::p},
+                {"Mass",&EventSnapshot::Collection::mass},
+                {"Px",&EventSnapshot::Collection::px},
+                {"Py",&EventSnapshot::Collection::py},
+                {"Pz",&EventSnapshot::Collection::pz}
+            };
+            if (getField()=="ALL" or getField()=="UR")
+            {
+                //all user records are only available from the particle
+                evaluate(context,collection.particles[iparticle],tree,prefix);
+            }
+            else if (getField()=="KIN")
+            {
+                for (auto it: columns)
+                {
+                    tree->storeVariable(prefix+it.first,float((collection.*(it.second))[iparticle]));
+                }
+            }
+            else
+            {
+                auto it = columns.find(getField());
+                if (it!=columns.end())
+                {
+                    tree->storeVariable(prefix+getField(),float((collection.*(it->second))[iparticle]));
+                }
+            }
+        }
+        
+        //kinematics of the particle in one variation with the variation suffix appended
+        void evaluateVariation(const EvaluationContext& context, const pxl::Particle* particle, unsigned int ivariation, Tree* tree, const std::string& prefix)
+        {
+            const KinematicFunctions& fct = getKinematicFunctions();
+            const bool all = getField()=="ALL" or getField()=="KIN";
+            if (!all and fct.find(getField())==fct.end())
+            {
+                return;
+            }
+            const pxl::LorentzVector vector = context.variations->getVector(particle,ivariation);
+            pxl::Particle varied;
+            varied.setP4(vector.getPx(),vector.getPy(),vector.getPz(),vector.getE());
+            for (auto it: fct)
+            {
+                if (all or it.first==getField())
+                {
+                    tree->storeVariable(prefix+it.first+context.suffixes[ivariation],it.second(&varied));
+                }
+            }
+        }
+
+        void evaluate(const EvaluationContext& context, const pxl::Particle* particle, Tree* tree, const std::string& prefix)
+        {
+            const KinematicFunctions& fct = getKinematicFunctions();
+            if (getField()=="ALL" or getField()=="KIN")
+            {
+                for (auto it: fct)
+                {
+                    tree->storeVariable(prefix+it.first,it.second(particle));
+                }
+            }
+            else
+            {
+                auto it = fct.find(getField());
+                if (it!=fct.end())
+                {
+                    tree->storeVariable(prefix+getField(),it->second(particle));
+                }
+            }
+
+            parseUserRecords(&particle->getUserRecords(),tree,prefix);
+        }
+
+        void parseUserRecords(const pxl::UserRecords* ur, Tree* tree, const std::string& prefix)
+        {
+            if (getField()=="ALL" or getField()=="UR")
+            {
+                for (auto it: *ur->getContainer())
+                {
+                    std::string urName=it.first;
+                    std::replace(urName.begin(), urName.end(), ' ', '_');
+                    std::replace(urName.begin(), urName.end(), ':', '_');
+                    tree->storeVariable(prefix+urName,it.second);
+                }
+            }
+        }
+};
+
+
+class SyntaxTree
+{
+    public:
+        std::vector<SyntaxNode*> _children;
+        std::vector<std::string> _suffixes;
+    public:
+
+        SyntaxTree()
+        {
+        }
+        
+        void evaluate(pxl::Event* event, Tree* tree)
+        {
+            const unsigned int nVariations = SystematicVariations::getNVariations();
+            while (_suffixes.size()<nVariations)
+            {
+                _suffixes.push_back(SystematicVariations::getSuffix(_suffixes.size()));
+            }
+            const SystematicVariations* variations = nVariations>0 ? &SystematicVariations::get(event) : nullptr;
+            const EvaluationContext context = {EventIndex::get(event),EventSnapshot::get(event),variations,_suffixes};
+            for (SyntaxNode* child: _children)
+            {
+                child->evaluate(context,event,tree,"");
+            }
+        }
+
+        inline void print() const
+        {
+            for (SyntaxNode* child: _children)
+            {
+                child->print();
+            }
+        }
+       
+
+        void buildTree(const std::string& s)
+        {
+            std::string::size_type pos = s.find("->");
+            std::string childField = "";
+            if (pos!=std::string::npos)
+            {
+                childField = s.substr(0,pos);
+            }
+            else
+            {
+                childField=s;
+            }
+            SyntaxNode* foundChild = nullptr;
+            for (SyntaxNode* child: _children)
+            {
+                if (child->getField()==childField)
+                {
+                    foundChild=child;
+                    break;
+                }
+            }
+
+            if (!foundChild)
+            {
+                foundChild = new SyntaxNode(childField);
+                _children.push_back(foundChild);
+            }
+            if (pos!=std::string::npos)
+            {
+                foundChild->buildTree(s.substr(pos+2));
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,294 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+#include "pxl/core/macros.hh"
+#include "pxl/core/PluginManager.hh"
+#include "pxl/modules/Module.hh"
+#include "pxl/modules/ModuleFactory.hh"
+
+#include "SyntheticEvents.hpp"
+#include "ModuleTimer.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static pxl::Logger logger("SyntheticEventSource");
+
+/*
+* Runnable module producing a fixed number of random events for benchmarks of
+* the module chain without input files. Each event has an event view with
+* muons, electrons, jets and the MET carrying the user records read by the
+* selection modules (muon/electron IDs and isolation, jet IDs, b-tagging
+* discriminator) and the HLT flags. The multiplicities are drawn from the
+* given distributions, listed as weights of 0, 1, 2, ... objects. The events
+* only depend on the seed.
+*/
+class SyntheticEventSource:
+    public pxl::Module
+{
+    private:
+        pxl::Source* _outputSource;
+
+        int64_t _nEvents;
+        int64_t _seed;
+        std::string _eventViewName;
+        std::string _processName;
+        std::vector<std::string> _muonMultiplicity;
+        std::vector<std::string> _electronMultiplicity;
+        std::vector<std::string> _jetMultiplicity;
+        double _bJetFraction;
+        std::string _bTaggingAlgorithmName;
+        std::vector<std::string> _triggerFlags;
+        double _triggerProbability;
+
+        std::vector<double> _muonWeights;
+        std::vector<double> _electronWeights;
+        std::vector<double> _jetWeights;
+
+        std::unique_ptr<SyntheticEvents> _generator;
+        int64_t _nGenerated;
+
+        ModuleTimer _timer;
+
+        static std::vector<double> parseWeights(const std::string& name, const std::vector<std::string>& values)
+        {
+            std::vector<double> weights;
+            double sum = 0;
+            for (const std::string& value: values)
+            {
+                char* end = nullptr;
+                weights.push_back(strtod(value.c_str(),&end));
+                if (value.empty() or *end!=0 or weights.back()<0)
+                {
+                    throw std::runtime_error("invalid weight '"+value+"' in "+name);
+                }
+                sum += weights.back();
+            }
+            if (not (sum>0))
+            {
+                throw std::runtime_error(name+" needs at least one positive weight");
+            }
+            return weights;
+        }
+
+        void addMuon(pxl::EventView* eventView)
+        {
+            pxl::Particle* muon = eventView->create<pxl::Particle>();
+            muon->setName("Muon");
+            const pxl::LorentzVector vector = _generator->lepton(0.106);
+            SyntheticEvents::setP4(muon,vector);
+            muon->setUserRecord("isTightMuon",_generator->bernoulli(0.9));
+            muon->setUserRecord("isLooseMuon",true);
+            muon->setUserRecord("isGlobalMuon",_generator->bernoulli(0.97));
+            //relative isolation of mostly isolated muons with a tail
+            const double pt = vector.getPt();
+            muon->setUserRecord("R04PFsumChargedHadronPt",float(pt*_generator->exponential(0.04)));
+            muon->setUserRecord("R04PFsumNeutralHadronEt",float(pt*_generator->exponential(0.02)));
+            muon->setUserRecord("R04PFsumPhotonEt",float(pt*_generator->exponential(0.02)));
+            muon->setUserRecord("R04PFsumPUPt",float(pt*_generator->exponential(0.05)));
+        }
+
+        void addElectron(pxl::EventView* eventView)
+        {
+            pxl::Particle* electron = eventView->create<pxl::Particle>();
+            electron->setName("Electron");
+            SyntheticEvents::setP4(electron,_generator->lepton(0.000511));
+            electron->setUserRecord("phys14eleIDTight",_generator->bernoulli(0.85));
+            electron->setUserRecord("phys14eleIDVeto",_generator->bernoulli(0.97));
+            electron->setUserRecord("passConversionVeto",_generator->bernoulli(0.98));
+        }
+
+        void addJet(pxl::EventView* eventView)
+        {
+            pxl::Particle* jet = eventView->create<pxl::Particle>();
+            jet->setName("Jet");
+            const pxl::LorentzVector vector = _generator->jet();
+            SyntheticEvents::setP4(jet,vector);
+            const bool central = std::fabs(vector.getEta())<2.4;
+            const bool bjet = _generator->bernoulli(_bJetFraction);
+            jet->setUserRecord("neutralHadronEnergyFraction",float(_generator->uniform(0,0.4)));
+            jet->setUserRecord("neutralEmEnergyFraction",float(_generator->uniform(0,0.4)));
+            jet->setUserRecord("chargedHadronEnergyFraction",float(central ? _generator->uniform(0.1,0.8) : 0));
+            jet->setUserRecord("chargedEmEnergyFraction",float(central ? _generator->uniform(0,0.2) : 0));
+            jet->setUserRecord("muonEnergyFraction",float(_generator->uniform(0,0.05)));
+            jet->setUserRecord("electronEnergyFraction",float(central ? _generator->uniform(0,0.1) : 0));
+            jet->setUserRecord("nConstituents",2+_generator->poisson(20));
+            jet->setUserRecord("chargedMultiplicity",central ? 1+_generator->poisson(10) : 0);
+            jet->setUserRecord(_bTaggingAlgorithmName,float(bjet ? _generator->uniform(0.5,1) : _generator->uniform(0,0.7)));
+            jet->setUserRecord("partonFlavour",bjet ? 5 : 0);
+            jet->setUserRecord("hadronFlavour",bjet ? 5 : 0);
+        }
+
+        pxl::Event* generateEvent()
+        {
+            pxl::Event* event = new pxl::Event();
+            event->setUserRecord("ProcessName",_processName);
+            event->setUserRecord("Event number",uint64_t(_nGenerated+1));
+            event->setUserRecord("genweight",1.0);
+            event->setUserRecord("nTrueInteractions",float(_generator->poisson(20)));
+
+            pxl::EventView* eventView = event->create<pxl::EventView>();
+            eventView->setName(_eventViewName);
+            eventView->setUserRecord("nPV",1+_generator->poisson(18));
+            for (const std::string& flag: _triggerFlags)
+            {
+                eventView->setUserRecord(flag,_generator->bernoulli(_triggerProbability));
+            }
+
+            const unsigned int nMuons = _generator->discrete(_muonWeights);
+            for (unsigned int imuon = 0; imuon < nMuons; ++imuon)
+            {
+                addMuon(eventView);
+            }
+            const unsigned int nElectrons = _generator->discrete(_electronWeights);
+            for (unsigned int ielectron = 0; ielectron < nElectrons; ++ielectron)
+            {
+                addElectron(eventView);
+            }
+            const unsigned int nJets = _generator->discrete(_jetWeights);
+            for (unsigned int ijet = 0; ijet < nJets; ++ijet)
+            {
+                addJet(eventView);
+            }
+
+            pxl::Particle* met = eventView->create<pxl::Particle>();
+            met->setName("MET");
+            const std::pair<double,double> missing = _generator->met(_generator->phi());
+            met->setP4(missing.first,missing.second,0,std::sqrt(missing.first*missing.first+missing.second*missing.second));
+            return event;
+        }
+
+    public:
+        SyntheticEventSource():
+            Module(),
+            _nEvents(10000),
+            _seed(12345),
+            _eventViewName("Reconstructed"),
+            _processName("tChannel"),
+            _muonMultiplicity({"0.1","0.8","0.1"}),
+            _electronMultiplicity({"0.8","0.18","0.02"}),
+            _jetMultiplicity({"0","0.05","0.25","0.3","0.2","0.12","0.08"}),
+            _bJetFraction(0.25),
+            _bTaggingAlgorithmName("combinedInclusiveSecondaryVertexV2BJetTags"),
+            _triggerFlags({"HLT_IsoMu24_eta2p1_IterTrk02_v1","HLT_IsoMu24_IterTrk02_v1","HLT_Ele27_eta2p1_WP85_Gsf_v1","HLT_PFJet40_v1","HLT_PFMET170_NoiseCleaned_v1"}),
+            _triggerProbability(0.8),
+            _nGenerated(0)
+        {
+            _outputSource = addSource("output","output");
+
+            addOption("number of events","",_nEvents);
+            addOption("seed","seed of the random number generator",_seed);
+            addOption("event view","name of the event view",_eventViewName);
+            addOption("process name","stored as 'ProcessName' event user record",_processName);
+            addOption("muon multiplicity","weights of 0, 1, 2, ... muons per event",_muonMultiplicity);
+            addOption("electron multiplicity","weights of 0, 1, 2, ... electrons per event",_electronMultiplicity);
+            addOption("jet multiplicity","weights of 0, 1, 2, ... jets per event",_jetMultiplicity);
+            addOption("b-jet fraction","fraction of jets with a high b-tagging discriminator and b flavour",_bJetFraction);
+            addOption("b-tagging algorithm","user record of the b-tagging discriminator",_bTaggingAlgorithmName);
+            addOption("trigger flags","HLT flags stored as user records of the event view",_triggerFlags);
+            addOption("trigger probability","probability of each trigger flag to be fired",_triggerProbability);
+        }
+
+        ~SyntheticEventSource()
+        {
+        }
+
+        // every Module needs a unique type
+        static const std::string &getStaticType()
+        {
+            static std::string type ("SyntheticEventSource");
+            return type;
+        }
+
+        // static and dynamic methods are needed
+        const std::string &getType() const
+        {
+            return getStaticType();
+        }
+
+        bool isRunnable() const
+        {
+            // this module provides the events
+            return true;
+        }
+
+        void initialize() throw (std::runtime_error)
+        {
+        }
+
+        void beginJob() throw (std::runtime_error)
+        {
+            _timer.setName(getName());
+            getOption("number of events",_nEvents);
+            getOption("seed",_seed);
+            getOption("event view",_eventViewName);
+            getOption("process name",_processName);
+            getOption("muon multiplicity",_muonMultiplicity);
+            getOption("electron multiplicity",_electronMultiplicity);
+            getOption("jet multiplicity",_jetMultiplicity);
+            getOption("b-jet fraction",_bJetFraction);
+            getOption("b-tagging algorithm",_bTaggingAlgorithmName);
+            getOption("trigger flags",_triggerFlags);
+            getOption("trigger probability",_triggerProbability);
+
+            try
+            {
+                _muonWeights = parseWeights("muon multiplicity",_muonMultiplicity);
+                _electronWeights = parseWeights("electron multiplicity",_electronMultiplicity);
+                _jetWeights = parseWeights("jet multiplicity",_jetMultiplicity);
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+
+            _generator.reset(new SyntheticEvents(_seed));
+            _nGenerated = 0;
+        }
+
+        //produces one event per call; returns false once all events are produced
+        bool analyse(pxl::Sink *) throw (std::runtime_error)
+        {
+            MODULE_TIMER_SCOPE(_timer);
+            if (_nGenerated>=_nEvents)
+            {
+                return false;
+            }
+            try
+            {
+                std::unique_ptr<pxl::Event> event(generateEvent());
+                ++_nGenerated;
+                _outputSource->setTargets(event.get());
+                _outputSource->processTargets();
+            }
+            catch(std::exception &e)
+            {
+                throw std::runtime_error(getName()+": "+e.what());
+            }
+            catch(...)
+            {
+                throw std::runtime_error(getName()+": unknown exception");
+            }
+            return true;
+        }
+
+        void endJob()
+        {
+            _timer.report();
+            logger(pxl::LOG_LEVEL_INFO,"produced ",_nGenerated," events");
+        }
+
+        void shutdown() throw(std::runtime_error)
+        {
+        }
+
+        void destroy() throw (std::runtime_error)
+        {
+            delete this;
+        }
+};
+
+PXL_MODULE_INIT(SyntheticEventSource)
+PXL_PLUGIN_INIT
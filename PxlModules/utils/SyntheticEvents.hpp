@@ -0,0 +1,116 @@
+#ifndef __SYNTHETICEVENTS_H__
+#define __SYNTHETICEVENTS_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+/*
+* Reproducible random four-momenta resembling a single top event: jets with
+* a falling pt spectrum above 30 GeV within |eta|<4.7, leptons above 26 GeV
+* within |eta|<2.4 and MET of a few tens of GeV. Used by the benchmarks and
+* the SyntheticEventSource module.
+*/
+class SyntheticEvents
+{
+    private:
+        std::mt19937 _generator;
+
+    public:
+        SyntheticEvents(unsigned int seed=12345):
+            _generator(seed)
+        {
+        }
+
+        double uniform(double min, double max)
+        {
+            return std::uniform_real_distribution<double>(min,max)(_generator);
+        }
+
+        double exponential(double mean)
+        {
+            return std::exponential_distribution<double>(1.0/mean)(_generator);
+        }
+
+        int poisson(double mean)
+        {
+            return std::poisson_distribution<int>(mean)(_generator);
+        }
+
+        bool bernoulli(double probability)
+        {
+            return std::bernoulli_distribution(probability)(_generator);
+        }
+
+        //index drawn with probabilities proportional to the weights
+        unsigned int discrete(const std::vector<double>& weights)
+        {
+            return std::discrete_distribution<unsigned int>(weights.begin(),weights.end())(_generator);
+        }
+
+        static pxl::LorentzVector fromPtEtaPhiM(double pt, double eta, double phi, double mass)
+        {
+            const double px = pt*std::cos(phi);
+            const double py = pt*std::sin(phi);
+            const double pz = pt*std::sinh(eta);
+            return pxl::LorentzVector(px,py,pz,std::sqrt(px*px+py*py+pz*pz+mass*mass));
+        }
+
+        pxl::LorentzVector jet()
+        {
+            //power law pt spectrum starting at 30 GeV
+            const double pt = std::min(30.0*std::pow(1.0-uniform(0,1),-1.0/2.5),1500.0);
+            return fromPtEtaPhiM(pt,uniform(-4.7,4.7),uniform(-M_PI,M_PI),uniform(5,20));
+        }
+
+        pxl::LorentzVector lepton(double mass=0.106)
+        {
+            const double pt = 26.0+exponential(25.0);
+            return fromPtEtaPhiM(pt,uniform(-2.4,2.4),uniform(-M_PI,M_PI),mass);
+        }
+
+        //transverse MET vector as (px,py)
+        std::pair<double,double> met(double phi)
+        {
+            const double pt = 10.0+exponential(35.0);
+            return std::make_pair(pt*std::cos(phi),pt*std::sin(phi));
+        }
+
+        double phi()
+        {
+            return uniform(-M_PI,M_PI);
+        }
+
+        //lepton, neutrino-like vector and nJets jets
+        std::vector<pxl::LorentzVector> event(unsigned int nJets)
+        {
+            std::vector<pxl::LorentzVector> vectors;
+            vectors.push_back(lepton());
+            const std::pair<double,double> missing = met(phi());
+            vectors.push_back(pxl::LorentzVector(missing.first,missing.second,uniform(-100,100),0));
+            vectors.back().setE(vectors.back().getP());
+            for (unsigned int ijet = 0; ijet < nJets; ++ijet)
+            {
+                vectors.push_back(jet());
+            }
+            return vectors;
+        }
+
+        static void setP4(pxl::Particle* particle, const pxl::LorentzVector& vector)
+        {
+            particle->setP4(vector.getPx(),vector.getPy(),vector.getPz(),vector.getE());
+        }
+
+        static pxl::Particle* makeParticle(const std::string& name, const pxl::LorentzVector& vector)
+        {
+            pxl::Particle* particle = new pxl::Particle();
+            particle->setName(name);
+            setP4(particle,vector);
+            return particle;
+        }
+};
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef __SYSTEMATICVARIATIONS_H__
+#define __SYSTEMATICVARIATIONS_H__
+
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "EventIndex.hpp"
+#include "UserRecordKey.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+* Varied four-momenta (e.g. for JES/JER/unclustered MET) of the particles of
+* an event, so that all variations are evaluated in one pass instead of one
+* job per variation. The variations are registered by name once per process
+* (e.g. in beginJob) and have fixed indices. Each particle with variations has
+* a compact array of px, py, pz, E for the nominal and every variation;
+* particles without an entry are the same in all variations.
+*
+* As the EventIndex the store is a thread local static shared by all plugins
+* and is cleared when a different event is requested. Particles removed
+* through the EventIndex are dropped from the store before they are deleted;
+* particles deleted otherwise have to be removed with remove(). Modules computing
+* derived quantities can temporarily replace the four-momenta of all
+* particles with entries by those of one variation with a Scope and store
+* their results with getSuffix(ivariation) appended to the user record names.
+*
+* A selection whose result depends on the varied kinematics (e.g. the jet pT
+* threshold) is evaluated per variation. A particle selected in some
+* variations only is given the name getVariationsName(name) instead of the
+* nominal name, and the bits of its 'variationMask' user record are the
+* variations in which it is selected; a particle named as the nominal one with
+* a mask is not selected in the variations whose bits are cleared.
+* getParticles returns the particles of a name selected in one variation, so
+* that downstream modules redo their jet assignment and calculations with the
+* particles of the variation. The event user records 'selected' and
+* 'selected__<variation>' tell if the event passes the selection so far in
+* the nominal and in each variation; they are missing until a module sets them.
+*/
+class SystematicVariations
+{
+    private:
+        struct NameTable
+        {
+            std::mutex mutex;
+            std::deque<std::string> names;
+        };
+
+        const pxl::Event* _event;
+        pxl::Id _eventId;
+
+        std::vector<pxl::Particle*> _particles;
+        std::unordered_map<const pxl::Particle*,unsigned int> _slots;
+        //4*(nVariations+1) values per particle; the nominal values first
+        std::vector<double> _values;
+        unsigned int _stride;
+
+        static NameTable& getNameTable()
+        {
+            static NameTable table;
+            return table;
+        }
+
+        static SystematicVariations& getInstance()
+        {
+            static thread_local SystematicVariations variations;
+            return variations;
+        }
+
+        static void removed(const pxl::Particle* particle)
+        {
+            getInstance().remove(particle);
+        }
+
+        SystematicVariations():
+            _event(nullptr),
+            _stride(4)
+        {
+        }
+
+        SystematicVariations(const SystematicVariations&);
+        SystematicVariations& operator=(const SystematicVariations&);
+
+        void reset(const pxl::Event* event)
+        {
+            _event = event;
+            _eventId = event->getId();
+            _particles.clear();
+            _slots.clear();
+            _values.clear();
+            _stride = 4*(getNVariations()+1);
+        }
+
+        static inline void setValues(double* values, const pxl::LorentzVector& vector)
+        {
+            values[0] = vector.getPx();
+            values[1] = vector.getPy();
+            values[2] = vector.getPz();
+            values[3] = vector.getE();
+        }
+
+        //creates the entry with the nominal values in all variations
+        double* getEntry(pxl::Particle* particle)
+        {
+            std::unordered_map<const pxl::Particle*,unsigned int>::const_iterator it = _slots.find(particle);
+            if (it!=_slots.end())
+            {
+                return &_values[it->second*_stride];
+            }
+            const unsigned int slot = _particles.size();
+            _particles.push_back(particle);
+            _slots[particle] = slot;
+            _values.resize((slot+1)*_stride);
+            double* values = &_values[slot*_stride];
+            setValues(values,particle->getVector());
+            for (unsigned int offset = 4; offset < _stride; offset += 4)
+            {
+                std::copy(values,values+4,values+offset);
+            }
+            return values;
+        }
+
+        void setP4(unsigned int slot, unsigned int offset)
+        {
+            const double* values = &_values[slot*_stride+offset];
+            _particles[slot]->setP4(values[0],values[1],values[2],values[3]);
+        }
+
+    public:
+        //returns the store for the event; it is cleared if the event has changed
+        static SystematicVariations& get(const pxl::Event* event)
+        {
+            SystematicVariations& variations = getInstance();
+            if (variations._event!=event || variations._eventId!=event->getId())
+            {
+                variations.reset(event);
+            }
+            return variations;
+        }
+
+        //returns the index of the variation; has to be called before processing events
+        static unsigned int registerVariation(const std::string& name)
+        {
+            NameTable& table = getNameTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            for (unsigned int ivariation = 0; ivariation < table.names.size(); ++ivariation)
+            {
+                if (table.names[ivariation]==name)
+                {
+                    return ivariation;
+                }
+            }
+            table.names.push_back(name);
+            EventIndex::setRemoveHook(&SystematicVariations::removed);
+            return table.names.size()-1;
+        }
+
+        static unsigned int getNVariations()
+        {
+            NameTable& table = getNameTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            return table.names.size();
+        }
+
+        static const std::string& getVariationName(unsigned int ivariation)
+        {
+            NameTable& table = getNameTable();
+            std::lock_guard<std::mutex> lock(table.mutex);
+            return table.names[ivariation];
+        }
+
+        //appended to the names of varied quantities
+        static std::string getSuffix(unsigned int ivariation)
+        {
+            return "__"+getVariationName(ivariation);
+        }
+
+        inline unsigned int getNParticles() const
+        {
+            return _particles.size();
+        }
+
+        inline pxl::Particle* getParticle(unsigned int slot) const
+        {
+            return _particles[slot];
+        }
+
+        inline bool has(const pxl::Particle* particle) const
+        {
+            return _slots.find(particle)!=_slots.end();
+        }
+
+        //adds the particle with its current four-momentum as nominal; not to be called within a Scope
+        inline void add(pxl::Particle* particle)
+        {
+            getEntry(particle);
+        }
+
+        void setVector(pxl::Particle* particle, unsigned int ivariation, const pxl::LorentzVector& vector)
+        {
+            setValues(getEntry(particle)+4*(ivariation+1),vector);
+        }
+
+        //the nominal vector of the particle if it has no variations
+        pxl::LorentzVector getVector(const pxl::Particle* particle, unsigned int ivariation) const
+        {
+            std::unordered_map<const pxl::Particle*,unsigned int>::const_iterator it = _slots.find(particle);
+            if (it==_slots.end())
+            {
+                return particle->getVector();
+            }
+            const double* values = &_values[it->second*_stride+4*(ivariation+1)];
+            return pxl::LorentzVector(values[0],values[1],values[2],values[3]);
+        }
+
+        //drops the entry of the particle, e.g. before it is deleted
+        void remove(const pxl::Particle* particle)
+        {
+            std::unordered_map<const pxl::Particle*,unsigned int>::iterator it = _slots.find(particle);
+            if (it==_slots.end())
+            {
+                return;
+            }
+            //the last entry takes the free slot
+            const unsigned int slot = it->second;
+            const unsigned int last = _particles.size()-1;
+            _slots.erase(it);
+            if (slot!=last)
+            {
+                _particles[slot] = _particles[last];
+                _slots[_particles[slot]] = slot;
+                std::copy(_values.begin()+last*_stride,_values.begin()+(last+1)*_stride,_values.begin()+slot*_stride);
+            }
+            _particles.pop_back();
+            _values.resize(last*_stride);
+        }
+
+        //gives a copy (e.g. a clone in another event view) the variations of the original
+        void copy(const pxl::Particle* original, pxl::Particle* copy)
+        {
+            std::unordered_map<const pxl::Particle*,unsigned int>::const_iterator it = _slots.find(original);
+            if (it==_slots.end())
+            {
+                return;
+            }
+            const unsigned int slot = it->second;
+            double* values = getEntry(copy);
+            std::copy(_values.begin()+slot*_stride,_values.begin()+(slot+1)*_stride,values);
+        }
+
+        static const UserRecordKey& getMaskKey()
+        {
+            static const UserRecordKey key("variationMask");
+            return key;
+        }
+        
+        //name of the particles which are selected in some variations but not in the nominal one
+        static std::string getVariationsName(const std::string& name)
+        {
+            return name+"__variations";
+        }
+        
+        //false if the variationMask of the particle excludes the variation
+        static inline bool isSelected(const pxl::Particle* particle, unsigned int ivariation)
+        {
+            const pxl::Variant* mask = getMaskKey().find(particle);
+            return !mask or (ivariation<64 and ((mask->toUInt64()>>ivariation)&1));
+        }
+        
+        /*
+        * Appends the particles selected in the variation in the order of the
+        * event view: those named 'name' which are not excluded by their mask
+        * and those named 'variationsName' (see getVariationsName) which are
+        * included by it.
+        */
+        static void getParticles(const EventIndex& index, const pxl::EventView* eventView, EventIndex::Key name, EventIndex::Key variationsName, unsigned int ivariation, std::vector<pxl::Particle*>& particles)
+        {
+            const std::vector<pxl::Particle*>& nominal = index.getParticles(eventView,name);
+            const std::vector<unsigned int>& nominalOrdinals = index.getOrdinals(eventView,name);
+            const std::vector<pxl::Particle*>& varied = index.getParticles(eventView,variationsName);
+            const std::vector<unsigned int>& variedOrdinals = index.getOrdinals(eventView,variationsName);
+            unsigned int inominal = 0;
+            unsigned int ivaried = 0;
+            while (inominal<nominal.size() or ivaried<varied.size())
+            {
+                if (ivaried==varied.size() or (inominal<nominal.size() and nominalOrdinals[inominal]<variedOrdinals[ivaried]))
+                {
+                    if (isSelected(nominal[inominal],ivariation))
+                    {
+                        particles.push_back(nominal[inominal]);
+                    }
+                    ++inominal;
+                }
+                else
+                {
+                    if (isSelected(varied[ivaried],ivariation))
+                    {
+                        particles.push_back(varied[ivaried]);
+                    }
+                    ++ivaried;
+                }
+            }
+        }
+        
+        //event user record 'selected'
+        static const UserRecordKey& getSelectedKey()
+        {
+            static const UserRecordKey key("selected");
+            return key;
+        }
+        
+        //event user record 'selected__<variation>'
+        static const UserRecordKey& getSelectedKey(unsigned int ivariation)
+        {
+            //a deque keeps the references valid when keys are added
+            static thread_local std::deque<UserRecordKey> keys;
+            while (keys.size()<=ivariation)
+            {
+                keys.push_back(UserRecordKey("selected"+getSuffix(keys.size())));
+            }
+            return keys[ivariation];
+        }
+        
+        //true if no module has decided on the event yet
+        static bool isEventSelected(const pxl::Event* event, const UserRecordKey& key)
+        {
+            const pxl::Variant* selected = key.find(event);
+            return !selected or selected->toBool();
+        }
+        
+        //the event stays rejected in the variation once a module has rejected it
+        static void selectEvent(pxl::Event* event, const UserRecordKey& key, bool passes)
+        {
+            key.set(event,isEventSelected(event,key) and passes);
+        }
+        
+        /*
+        * Sets the four-momenta of all particles with variations to those of one
+        * variation and restores the nominal ones when going out of scope.
+        */
+        class Scope
+        {
+            private:
+                SystematicVariations& _variations;
+
+                Scope(const Scope&);
+                Scope& operator=(const Scope&);
+
+            public:
+                Scope(SystematicVariations& variations, unsigned int ivariation):
+                    _variations(variations)
+                {
+                    for (unsigned int slot = 0; slot < _variations._particles.size(); ++slot)
+                    {
+                        _variations.setP4(slot,4*(ivariation+1));
+                    }
+                }
+
+                ~Scope()
+                {
+                    for (unsigned int slot = 0; slot < _variations._particles.size(); ++slot)
+                    {
+                        _variations.setP4(slot,0);
+                    }
+                }
+        };
+};
+
+#endif
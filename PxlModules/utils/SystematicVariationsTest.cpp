@@ -0,0 +1,94 @@
+#include "pxl/hep.hh"
+#include "pxl/core.hh"
+
+#include "EventIndex.hpp"
+#include "SystematicVariations.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+* Checks of the per variation selection without an analysis: the jets of a
+* variation are the nominal jets not excluded by their variationMask and the
+* jets selected only in variations which it includes, in the order of the
+* event view. The event flags 'selected__<variation>' stay false once a module
+* has rejected the event in the variation, and particles removed through the
+* EventIndex are dropped from the store.
+*
+* usage: SystematicVariationsTest; returns non-zero if a check fails
+*/
+
+static unsigned int nFailed = 0;
+
+static void check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        fprintf(stderr,"FAILED: %s\n",description.c_str());
+        ++nFailed;
+    }
+}
+
+int main()
+{
+    const unsigned int up = SystematicVariations::registerVariation("jesUp");
+    const unsigned int down = SystematicVariations::registerVariation("jesDown");
+    const uint64_t upBit = uint64_t(1)<<up;
+    const uint64_t downBit = uint64_t(1)<<down;
+
+    const EventIndex::Key eventViewName = EventIndex::intern("Reconstructed");
+    const EventIndex::Key jetName = EventIndex::intern("SelectedJet");
+    const EventIndex::Key variationJetName = EventIndex::intern(SystematicVariations::getVariationsName("SelectedJet"));
+
+    //jets as left by JetSelection: selected in both variations, only in jesUp, nominally but not in jesUp, without mask
+    pxl::Event event;
+    pxl::EventView* eventView = event.create<pxl::EventView>();
+    eventView->setName("Reconstructed");
+    std::vector<pxl::Particle*> jets;
+    for (unsigned int ijet = 0; ijet < 4; ++ijet)
+    {
+        jets.push_back(eventView->create<pxl::Particle>());
+        jets.back()->setName("SelectedJet");
+        jets.back()->setP4(50.0-10*ijet,0,0,50.0-10*ijet);
+    }
+    SystematicVariations::getMaskKey().set(jets[0],upBit|downBit);
+    SystematicVariations::getMaskKey().set(jets[1],upBit);
+    SystematicVariations::getMaskKey().set(jets[2],downBit);
+
+    EventIndex& index = EventIndex::get(&event);
+    check(index.findEventView(eventViewName)==eventView,"setup: the event view is indexed");
+    index.setName(eventView,jets[1],variationJetName);
+
+    std::vector<pxl::Particle*> selected;
+    SystematicVariations::getParticles(index,eventView,jetName,variationJetName,up,selected);
+    check(selected==std::vector<pxl::Particle*>({jets[0],jets[1],jets[3]}),"jesUp: the jet selected only in jesUp is included in the order of the event view");
+    selected.clear();
+    SystematicVariations::getParticles(index,eventView,jetName,variationJetName,down,selected);
+    check(selected==std::vector<pxl::Particle*>({jets[0],jets[2],jets[3]}),"jesDown: the jet selected only in jesUp is left out");
+
+    //flags of the event
+    const UserRecordKey& upSelected = SystematicVariations::getSelectedKey(up);
+    check(SystematicVariations::isEventSelected(&event,upSelected),"flags: an event is selected until a module rejects it");
+    SystematicVariations::selectEvent(&event,upSelected,false);
+    SystematicVariations::selectEvent(&event,upSelected,true);
+    check(!SystematicVariations::isEventSelected(&event,upSelected),"flags: a rejected event stays rejected");
+    check(upSelected.getName()=="selected__jesUp","flags: the flag has the variation suffix");
+
+    //removing a jet through the index drops its variations
+    SystematicVariations& variations = SystematicVariations::get(&event);
+    variations.setVector(jets[2],up,pxl::LorentzVector(44,0,0,44));
+    variations.setVector(jets[3],up,pxl::LorentzVector(33,0,0,33));
+    index.removeObject(eventView,jets[2]);
+    check(!variations.has(jets[2]),"remove: the removed jet is dropped from the store");
+    check(variations.getVector(jets[3],up).getPx()==33,"remove: the variations of the other jets are kept");
+
+    if (nFailed>0)
+    {
+        fprintf(stderr,"%u checks failed\n",nFailed);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef __USERRECORDKEY_H__
+#define __USERRECORDKEY_H__
+
+#include "pxl/core.hh"
+
+#include <stdexcept>
+#include <string>
+
+/*
+* Handle to a user record which is resolved once (e.g. in beginJob) instead of
+* building a std::string from a literal for every hasUserRecord/getUserRecord
+* call. A lookup is a single search in the user record container; find returns
+* nullptr if the record does not exist which replaces the has+get pairs.
+*/
+class UserRecordKey
+{
+    private:
+        std::string _name;
+
+        template<class OBJECT>
+        static inline const pxl::UserRecords::ContainerType* getContainer(const OBJECT* object)
+        {
+            return object->getUserRecords().getContainer();
+        }
+
+    public:
+        UserRecordKey(const std::string& name=""):
+            _name(name)
+        {
+        }
+
+        inline const std::string& getName() const
+        {
+            return _name;
+        }
+
+        template<class OBJECT>
+        inline const pxl::Variant* find(const OBJECT* object) const
+        {
+            const pxl::UserRecords::ContainerType* container = getContainer(object);
+            pxl::UserRecords::ContainerType::const_iterator it = container->find(_name);
+            if (it==container->end())
+            {
+                return nullptr;
+            }
+            return &it->second;
+        }
+
+        template<class OBJECT>
+        inline bool has(const OBJECT* object) const
+        {
+            return find(object)!=nullptr;
+        }
+
+        template<class OBJECT>
+        inline const pxl::Variant& get(const OBJECT* object) const
+        {
+            const pxl::Variant* value = find(object);
+            if (!value)
+            {
+                throw std::runtime_error("user record '"+_name+"' not found");
+            }
+            return *value;
+        }
+
+        template<class OBJECT, class TYPE>
+        inline void set(OBJECT* object, const TYPE& value) const
+        {
+            object->setUserRecord(_name,value);
+        }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __WORKQUEUES_H__
+#define __WORKQUEUES_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+* Bounded queues of numbered events, one per worker thread of
+* ParallelAnalysis. A worker takes the oldest event of its own queue and
+* steals the oldest event of another queue if its own is empty; push blocks
+* while the total number of queued events is at the capacity.
+*/
+template<class EVENT>
+class WorkQueues
+{
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::pair<uint64_t,EVENT*>> events;
+        };
+
+        std::vector<std::unique_ptr<Queue>> _queues;
+        std::mutex _mutex;
+        std::condition_variable _available;
+        std::condition_variable _space;
+        unsigned int _size;
+        unsigned int _capacity;
+        bool _closed;
+
+        bool tryPop(unsigned int iqueue, std::pair<uint64_t,EVENT*>& item)
+        {
+            Queue& queue = *_queues[iqueue];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.events.empty())
+            {
+                return false;
+            }
+            //always the oldest event; needed for the ordered output not to block all workers
+            item = queue.events.front();
+            queue.events.pop_front();
+            return true;
+        }
+
+    public:
+        WorkQueues(unsigned int nQueues, unsigned int capacity):
+            _size(0),
+            _capacity(capacity),
+            _closed(false)
+        {
+            for (unsigned int iqueue = 0; iqueue < nQueues; ++iqueue)
+            {
+                _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+            }
+        }
+
+        //blocks while the number of queued events is at the capacity
+        void push(unsigned int iqueue, uint64_t number, EVENT* event)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _space.wait(lock,[this]{ return _size<_capacity; });
+                ++_size;
+            }
+            {
+                Queue& queue = *_queues[iqueue];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.events.push_back(std::make_pair(number,event));
+            }
+            _available.notify_all();
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+            }
+            _available.notify_all();
+        }
+
+        //returns false if the queues are closed and empty
+        bool pop(unsigned int iqueue, std::pair<uint64_t,EVENT*>& item)
+        {
+            while (true)
+            {
+                if (tryPop(iqueue,item))
+                {
+                    break;
+                }
+                bool stolen = false;
+                for (unsigned int offset = 1; offset < _queues.size() and !stolen; ++offset)
+                {
+                    stolen = tryPop((iqueue+offset)%_queues.size(),item);
+                }
+                if (stolen)
+                {
+                    break;
+                }
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_closed and _size==0)
+                {
+                    return false;
+                }
+                //recheck after a short wait; events are pushed without holding this mutex
+                _available.wait_for(lock,std::chrono::milliseconds(1));
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                --_size;
+            }
+            _space.notify_one();
+            return true;
+        }
+};
+
+#endif